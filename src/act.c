@@ -17,6 +17,7 @@
 #include <math.h>
 
 #include "act.h"
+#include "kernel.h"
 #include "main.h"
 
                 /**********************************
@@ -43,85 +44,137 @@ where f is typically a non-linear activation function.
 void feed_forward(struct network *n, struct group *g)
 {
         /*
-         * Under the assumption that activation levels for the units in the
-         * current group have already been determined, determine the
-         * activation levels of all the groups towards which the current
-         * group maintains a projection.
+         * Under the assumption that activation levels for the units in
+         * group g have already been determined, determine the activation
+         * levels of all groups that follow g in the execution schedule.
+         * Because the schedule is topologically sorted, the activation
+         * levels of all groups that project to a group have been determined
+         * before that group is reached.
+         *
+         * Note: If g is not part of the schedule (e.g., if it is the input
+         * group), the entire schedule is executed.
+         */
+        uint32_t s = schedule_position(n, g);
+        s = s < n->schedule->num_elements ? s + 1 : 0;
+
+        /*
+         * The schedule is executed by a single team of threads, provided
+         * that at least one group is large enough to be divided among
+         * threads (see kernel.c).
          */
-        for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
-                struct projection *op = g->out_projs->elements[i];
-                /*
-                 * During BPTT, we want activation to propagate only through
-                 * the network of the current timestep.
-                 */
-                if (op->flags->recurrent)
-                        continue;
-                
-                /*
-                 * Compute net input for the units in each group that the
-                 * current group projects to.
-                 */
-                struct group *rg = op->to;
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded)
+        bool parallel = false;
+        for (uint32_t i = s; i < n->schedule->num_elements; i++)
+                if (feed_forward_in_parallel(n, n->schedule->elements[i]))
+                        parallel = true;
+#pragma omp parallel if (parallel)
 #endif /* _OPENMP */
-                for (uint32_t j = 0; j < rg->vector->size; j++) {
-                        /* 
-                         * Reset the activation level of the current unit.
-                         */ 
-                        rg->vector->elements[j] = 0.0;
-
-                        /*
-                         * Determine the net input to the current unit:
-                         *
-                         * x_j = sum_i (y_i * w_ij)
-                         *
-                         * Note: A unit can receive activation from units in
-                         * different projecting groups.
-                         */
-                        for (uint32_t x = 0; x < rg->inc_projs->num_elements; x++) {
-                                struct projection *ip = rg->inc_projs->elements[x];
-                                struct group *pg = ip->to;
-                                struct matrix *w = ip->weights;
-                                for (uint32_t z = 0; z < pg->vector->size; z++)
-                                        rg->vector->elements[j] += pg->vector->elements[z]
-                                                * w->elements[z][j];
-                        }
-
-                        /*
-                         * Apply an activation function to the net input
-                         * (unless the softmax function is used, which
-                         * requires all net inputs to be computed first).
-                         *
-                         * y_j = f(x_j)
-                         */
-                        if (rg->act_fun->fun != act_fun_softmax)
-                                rg->vector->elements[j] = rg->act_fun->fun(rg, j);
-                }
+        {
+                for (uint32_t i = s; i < n->schedule->num_elements; i++)
+                        feed_forward_group(n, n->schedule->elements[i]);
+        }
+}
 
-                /* apply softmax activation function (if required) */
-                if (rg->act_fun->fun == act_fun_softmax)
-                        for (uint32_t j = 0; j < rg->vector->size; j++)
-                                rg->vector->elements[j] = rg->act_fun->fun(rg, j);
+/*
+ * Flags whether the net inputs of group g are determined by multiple
+ * threads.
+ */
+bool feed_forward_in_parallel(struct network *n, struct group *g)
+{
+#ifdef _OPENMP
+        uint64_t work = 0;
+        for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
+                struct projection *ip = g->inc_projs->elements[i];
+                uint32_t rows = ip->to->sparse
+                        ? ip->to->sparse->num_elements
+                        : ip->to->vector->size;
+                work += (uint64_t)rows * g->vector->size;
         }
+        return n->flags->omp_mthreaded && work >= n->pars->omp_mac_cutoff;
+#else
+        return false;
+#endif /* _OPENMP */
+}
 
-        /* 
-         * Recursively repeat the above for all of the groups towards which
-         * the current group maintains a projection. Again, we skip
-         * recurrent projections, as we want activation to only propagate
-         * through the network of the current timestep during BPTT.
-         */
-        for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
-                struct projection *op = g->out_projs->elements[i];
-                if (!op->flags->recurrent)
-                        feed_forward(n, op->to);
+/*
+ * This determines the activation levels of the units in group g, on the
+ * basis of the activation levels of all groups that project to g.
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see feed_forward()).
+ */
+void feed_forward_group(struct network *n, struct group *g)
+{
+        uint32_t num_tiles = (g->vector->size + KERNEL_TILE_SIZE - 1)
+                / KERNEL_TILE_SIZE;
+        uint32_t t0, t1;
+        kernel_team_range(num_tiles, feed_forward_in_parallel(n, g),
+                &t0, &t1);
+        for (uint32_t t = t0; t < t1; t++) {
+                uint32_t c0 = t * KERNEL_TILE_SIZE;
+                uint32_t c1 = c0 + KERNEL_TILE_SIZE;
+                if (c1 > g->vector->size)
+                        c1 = g->vector->size;
+
+                /* 
+                 * Reset the activation levels of the units in the current
+                 * tile.
+                 */ 
+                for (uint32_t j = c0; j < c1; j++)
+                        g->vector->elements[j] = 0.0;
+
+                /*
+                 * Determine the net input to the units in the current
+                 * tile:
+                 *
+                 * x_j = sum_i (y_i * w_ij)
+                 *
+                 * Note: A unit can receive activation from units in
+                 * different projecting groups. If a projecting group holds
+                 * a sparse (clamped) vector, only the weights of its
+                 * non-zero units are visited.
+                 */
+                for (uint32_t x = 0; x < g->inc_projs->num_elements; x++) {
+                        struct projection *ip = g->inc_projs->elements[x];
+                        if (ip->to->sparse)
+                                kernel_gemv_trans_sparse(ip->weights,
+                                        ip->to->sparse,
+                                        g->vector->elements, c0, c1);
+                        else
+                                kernel_gemv_trans(ip->weights,
+                                        ip->to->vector->elements,
+                                        g->vector->elements, c0, c1);
+                }
         }
+
+        /*
+         * Once all net inputs are determined, apply the activation
+         * function to them (on a single thread):
+         *
+         * y_j = f(x_j)
+         */
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif /* _OPENMP */
+        g->act_fun->fun(g);
 }
 
                 /******************************
                  **** activation functions ****
                  ******************************/
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Activation functions operate on an entire group at once. An activation
+function f(g) replaces the net inputs x_j in the vector of group g by the
+activation levels y_j = f(x_j). Its derivative f'(g,e) multiplies the error
+derivatives dE/dy_j in vector e by f'(x_j), which is expressed in terms of
+y_j, to obtain the error signals delta_j for group g.
+
+Each function is a single loop over contiguous elements, with its
+parameters loaded once, such that the compiler can vectorize it.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Logistic function:
 
@@ -146,17 +199,22 @@ Fahlman, S. E. (1988). An empirical study of learning speed in back-
         Computer Science, Carnegie Mellon University, Pittsburgh, PA 15213.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_logistic(struct group *g, uint32_t i)
+void act_fun_logistic(struct group *g)
 {
-        return 1.0 / (1.0 + EXP(-(g->pars->logistic_gain
-                * g->vector->elements[i])));
+        real *y    = g->vector->elements;
+        real gain  = g->pars->logistic_gain;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                y[i] = 1.0 / (1.0 + EXP(-(gain * y[i])));
 }
 
-double act_fun_logistic_deriv(struct group *g, uint32_t i)
+void act_fun_logistic_deriv(struct group *g, struct vector *e)
 {
-        return g->pars->logistic_gain
-                * g->vector->elements[i] * (1.0 - g->vector->elements[i])
-                + g->pars->logistic_fsc;
+        real *y    = g->vector->elements;
+        real *d    = e->elements;
+        real gain  = g->pars->logistic_gain;
+        real fsc   = g->pars->logistic_fsc;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] *= gain * y[i] * (1.0 - y[i]) + fsc;
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -169,23 +227,32 @@ and its derivative:
         f'(x) = 0.5 * (1 + y) * (1 - y)
  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_bipolar_sigmoid(struct group *g, uint32_t i)
+void act_fun_bipolar_sigmoid(struct group *g)
 {
-        return (-1.0) + 2.0 / (1.0 + EXP(-g->vector->elements[i]));
+        real *y = g->vector->elements;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                y[i] = (-1.0) + 2.0 / (1.0 + EXP(-y[i]));
 }
 
-double act_fun_bipolar_sigmoid_deriv(struct group *g, uint32_t i)
+void act_fun_bipolar_sigmoid_deriv(struct group *g, struct vector *e)
 {
-        return 0.5 * (1.0 + g->vector->elements[i])
-                * (1.0 - g->vector->elements[i]);
+        real *y = g->vector->elements;
+        real *d = e->elements;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] *= 0.5 * (1.0 + y[i]) * (1.0 - y[i]);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Softmax function:
 
         f(x) = (e ^ x) / sum_j (e ^ x_j)
- 
-and the error signal for unit i:
+
+which is computed as:
+
+        f(x) = (e ^ (x - m)) / sum_j (e ^ (x_j - m))
+
+where m = max_j x_j, such that no exponent is larger than zero, and the
+sum cannot overflow. The error signal for unit i is:
 
         delta_i = J[i,:] * v(dE/dy)
 
@@ -194,49 +261,37 @@ where J is the Jacobian matrix with:
                  | y_i * (1.0 - y_j)  , if i = j
         J[i,j] = |
                  | -1.0 * y_i * y_j   , if i != j
+
+Rather than constructing J, we use that J = diag(y) - y * y^T, so that:
+
+        delta_i = y_i * (dE/dy_i - sum_j y_j * dE/dy_j)
+
+which takes linear, rather than quadratic, time and space. When softmax is
+combined with divergence, the Jacobian is not applied at all (see
+err_fun_divergence_softmax_deriv() in error.c).
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_softmax(struct group *g, uint32_t i)
+void act_fun_softmax(struct group *g)
 {
-        static double sum;
-        if (i == 0) {
-                sum = 0.0;
-                for (uint32_t j = 0; j < g->vector->size; j++)
-                        sum += EXP(g->vector->elements[j]);
+        real *y = g->vector->elements;
+        uint32_t n = g->vector->size;
+        real mx = kernel_max(y, n);
+        double sum = 0.0;
+        for (uint32_t i = 0; i < n; i++) {
+                y[i] = EXP(y[i] - mx);
+                sum += y[i];
         }
-        return EXP(g->vector->elements[i]) / sum;
+        kernel_scale(y, 1.0 / sum, n);
 }
 
-double act_fun_softmax_deriv(struct group *g, uint32_t i)
+void act_fun_softmax_deriv(struct group *g, struct vector *e)
 {
-        static struct matrix *jm;
-        static struct vector *ev;
-        double delta = 0.0;
-        /* compute Jacobian matrix */
-        if (i == 0) {
-                struct vector *v = g->vector;
-                jm = create_matrix(v->size, v->size);
-                ev = create_vector(v->size);
-                copy_vector(g->error, ev);
-                for (uint32_t r = 0; r < v->size; r++)
-                        for (uint32_t c = 0; c < v->size; c++)
-                                if (r == c)
-                                        jm->elements[r][c] = v->elements[r]
-                                                * (1.0 - v->elements[c]);
-                                else
-                                        jm->elements[r][c] = -1.0
-                                                * v->elements[r]
-                                                * v->elements[c];
-        }
-        /* compute delta for current unit */
-        for (uint32_t j = 0; j < g->vector->size; j++)
-                delta += jm->elements[i][j] * ev->elements[j];
-        /* clean up */
-        if (i == g->vector->size - 1) {
-                free_matrix(jm);
-                free_vector(ev);
-        }
-        return delta;
+        real *y = g->vector->elements;
+        real *d = e->elements;
+        uint32_t n = g->vector->size;
+        real s = kernel_dot(y, d, n);
+        for (uint32_t i = 0; i < n; i++)
+                d[i] = y[i] * (d[i] - s);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -249,14 +304,19 @@ and its derivative:
         f'(x) = 1 - y ^ 2
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_tanh(struct group *g, uint32_t i)
+void act_fun_tanh(struct group *g)
 {
-        return tanh(g->vector->elements[i]);
+        real *y = g->vector->elements;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                y[i] = tanh(y[i]);
 }
 
-double act_fun_tanh_deriv(struct group *g, uint32_t i)
+void act_fun_tanh_deriv(struct group *g, struct vector *e)
 {
-        return 1.0 - pow(g->vector->elements[i], 2.0);
+        real *y = g->vector->elements;
+        real *d = e->elements;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] *= 1.0 - y[i] * y[i];
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -269,14 +329,14 @@ and its derivative:
         f'(x) = 1
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_linear(struct group *g, uint32_t i)
+void act_fun_linear(struct group *g)
 {
-        return g->vector->elements[i];
+        return;
 }
 
-double act_fun_linear_deriv(struct group *g, uint32_t i)
+void act_fun_linear_deriv(struct group *g, struct vector *e)
 {
-        return 1.0;
+        return;
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -291,18 +351,22 @@ where x may be clipped by a maximum value, and its derivative:
                 | 0     otherwise
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_relu(struct group *g, uint32_t i)
+void act_fun_relu(struct group *g)
 {
-        return maximum(0.0,
-                minimum(g->vector->elements[i], g->pars->relu_max));
+        real *y   = g->vector->elements;
+        real max  = g->pars->relu_max;
+        for (uint32_t i = 0; i < g->vector->size; i++) {
+                real x = y[i] < max ? y[i] : max;
+                y[i] = x > 0.0 ? x : 0.0;
+        }
 }
 
-double act_fun_relu_deriv(struct group *g, uint32_t i)
+void act_fun_relu_deriv(struct group *g, struct vector *e)
 {
-        if (g->vector->elements[i] > 0.0)
-                return 1.0;
-        else
-                return 0.0;
+        real *y = g->vector->elements;
+        real *d = e->elements;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] = y[i] > 0.0 ? d[i] : 0.0;
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -319,22 +383,24 @@ where x may be clipped by a maximum value, and its derivative:
                 | alpha         otherwise
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_leaky_relu(struct group *g, uint32_t i)
+void act_fun_leaky_relu(struct group *g)
 {
-        if (g->vector->elements[i] > 0.0)
-                return minimum(
-                        g->vector->elements[i],
-                        g->pars->relu_max);
-        else
-                return g->pars->relu_alpha * g->vector->elements[i];
+        real *y     = g->vector->elements;
+        real alpha  = g->pars->relu_alpha;
+        real max    = g->pars->relu_max;
+        for (uint32_t i = 0; i < g->vector->size; i++) {
+                real x = y[i] < max ? y[i] : max;
+                y[i] = y[i] > 0.0 ? x : alpha * y[i];
+        }
 }
 
-double act_fun_leaky_relu_deriv(struct group *g, uint32_t i)
+void act_fun_leaky_relu_deriv(struct group *g, struct vector *e)
 {
-        if (g->vector->elements[i] > 0.0)
-                return 1.0;
-        else
-                return g->pars->relu_alpha;
+        real *y     = g->vector->elements;
+        real *d     = e->elements;
+        real alpha  = g->pars->relu_alpha;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] *= y[i] > 0.0 ? 1.0 : alpha;
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -351,21 +417,23 @@ where x may be clipped by a maximum value, and its derivative:
                 | y + alpha             otherwise
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double act_fun_elu(struct group *g, uint32_t i)
+void act_fun_elu(struct group *g)
 {
-        if (g->vector->elements[i] > 0.0)
-                return minimum(
-                        g->vector->elements[i],
-                        g->pars->relu_max);
-        else
-                return g->pars->relu_alpha
-                        * (EXP(g->vector->elements[i]) - 1.0);
+        real *y     = g->vector->elements;
+        real alpha  = g->pars->relu_alpha;
+        real max    = g->pars->relu_max;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                if (y[i] > 0.0)
+                        y[i] = y[i] < max ? y[i] : max;
+                else
+                        y[i] = alpha * (EXP(y[i]) - 1.0);
 }
 
-double act_fun_elu_deriv(struct group *g, uint32_t i)
+void act_fun_elu_deriv(struct group *g, struct vector *e)
 {
-        if (g->vector->elements[i] > 0.0)
-                return 1.0;
-        else
-                return g->vector->elements[i] + g->pars->relu_alpha;
+        real *y     = g->vector->elements;
+        real *d     = e->elements;
+        real alpha  = g->pars->relu_alpha;
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                d[i] *= y[i] > 0.0 ? 1.0 : y[i] + alpha;
 }
@@ -30,29 +30,31 @@
 #endif /* FAST_EXP */
 
 void feed_forward(struct network *n, struct group *g);
+bool feed_forward_in_parallel(struct network *n, struct group *g);
+void feed_forward_group(struct network *n, struct group *g);
 
-double act_fun_logistic(struct group *g, uint32_t i);
-double act_fun_logistic_deriv(struct group *g, uint32_t i);
+void act_fun_logistic(struct group *g);
+void act_fun_logistic_deriv(struct group *g, struct vector *e);
 
-double act_fun_bipolar_sigmoid(struct group *g, uint32_t i);
-double act_fun_bipolar_sigmoid_deriv(struct group *g, uint32_t i);
+void act_fun_bipolar_sigmoid(struct group *g);
+void act_fun_bipolar_sigmoid_deriv(struct group *g, struct vector *e);
 
-double act_fun_softmax(struct group *g, uint32_t i);
-double act_fun_softmax_deriv(struct group *g, uint32_t i);
+void act_fun_softmax(struct group *g);
+void act_fun_softmax_deriv(struct group *g, struct vector *e);
 
-double act_fun_tanh(struct group *g, uint32_t i);
-double act_fun_tanh_deriv(struct group *g, uint32_t i);
+void act_fun_tanh(struct group *g);
+void act_fun_tanh_deriv(struct group *g, struct vector *e);
 
-double act_fun_linear(struct group *g, uint32_t i);
-double act_fun_linear_deriv(struct group *g, uint32_t i);
+void act_fun_linear(struct group *g);
+void act_fun_linear_deriv(struct group *g, struct vector *e);
 
-double act_fun_relu(struct group *g, uint32_t i);
-double act_fun_relu_deriv(struct group *g, uint32_t i);
+void act_fun_relu(struct group *g);
+void act_fun_relu_deriv(struct group *g, struct vector *e);
 
-double act_fun_leaky_relu(struct group *g, uint32_t i);
-double act_fun_leaky_relu_deriv(struct group *g, uint32_t i);
+void act_fun_leaky_relu(struct group *g);
+void act_fun_leaky_relu_deriv(struct group *g, struct vector *e);
 
-double act_fun_elu(struct group *g, uint32_t i);
-double act_fun_elu_deriv(struct group *g, uint32_t i);
+void act_fun_elu(struct group *g);
+void act_fun_elu_deriv(struct group *g, struct vector *e);
 
 #endif /* ACT_H */
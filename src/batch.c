@@ -0,0 +1,595 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "bp.h"
+#include "kernel.h"
+#include "main.h"
+#include "stream.h"
+
+                /******************
+                 **** batching ****
+                 ******************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+This implements mini-batch processing for feed forward networks. Rather
+than propagating one item at a time through the network, a batch of items
+is clamped onto the input group at once. Each group then holds a matrix of
+unit activations (and of error signals), with one row per item, and the
+forward and backward sweeps become matrix-matrix products:
+
+        X_g = sum_g' Y_g' W_g'g                 (net input)
+
+        E_g' += D_g W_g'g^T                      (error derivatives)
+
+        G_g'g += Y_g'^T D_g                      (weight gradients)
+
+where g' ranges over the groups that project to g. This yields exactly the
+same gradients as processing the items one by one (up to the order in which
+floating point numbers are summed), but each block of weights is read from
+memory once per batch, rather than once per item.
+
+Activation and error functions are applied row by row, on a shallow copy of
+the group whose unit and error vectors point into the relevant row. Groups
+that do not receive any input during a sweep (such as bias groups) have the
+same activation pattern in each row.
+
+If the input vectors of all items in a batch are sparse, the net input
+from the input group is computed item by item, from the rows of W_g'g that
+belong to their non-zero units only (see kernel.c). Likewise, only these
+rows of the gradients G_g'g are computed, and flagged as dirty (see
+matrix.h).
+
+Batches are only used for feed forward networks, in which items consist of
+a single event, and in which no two-stage or DSS processing is involved.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct batch *create_batch(struct network *n, uint32_t max_rows)
+{
+        struct batch *b;
+        if (!(b = malloc(sizeof(struct batch))))
+                goto error_out;
+        memset(b, 0, sizeof(struct batch));
+
+        b->max_rows   = max_rows;
+        b->num_groups = n->groups->num_elements;
+
+        size_t block_size = b->num_groups * sizeof(struct matrix *);
+        if (!(b->vectors = malloc(block_size)))
+                goto error_out;
+        memset(b->vectors, 0, block_size);
+        if (!(b->errors = malloc(block_size)))
+                goto error_out;
+        memset(b->errors, 0, block_size);
+        block_size = max_rows * sizeof(struct sparse_vector *);
+        if (!(b->sparse = malloc(block_size)))
+                goto error_out;
+        memset(b->sparse, 0, block_size);
+
+        for (uint32_t i = 0; i < b->num_groups; i++) {
+                struct group *g = n->groups->elements[i];
+                b->vectors[i] = create_matrix(max_rows, g->vector->size);
+                b->errors[i]  = create_matrix(max_rows, g->vector->size);
+        }
+
+        return b;
+
+error_out:
+        perror("[create_batch()]");
+        return NULL;
+}
+
+void free_batch(struct batch *b)
+{
+        for (uint32_t i = 0; i < b->num_groups; i++) {
+                free_matrix(b->vectors[i]);
+                free_matrix(b->errors[i]);
+        }
+        free(b->vectors);
+        free(b->errors);
+        free(b->sparse);
+        free(b);
+}
+
+/*
+ * Determines whether the active set of a network can be processed in
+ * batches.
+ */
+bool batchable_network(struct network *n)
+{
+        if (n->flags->type != ntype_ffn)
+                return false;
+        if (n->pars->batch_size < 2)
+                return false;
+        if (n->ts_fw_group || n->ts_bw_group || n->flags->dcs)
+                return false;
+        /* items of a streamed set have at least one event each */
+        if (n->asp->stream)
+                return n->asp->stream->header.num_events
+                        == n->asp->stream->header.num_items;
+        for (uint32_t i = 0; i < n->asp->items->num_elements; i++) {
+                struct item *item = n->asp->items->elements[i];
+                if (item->num_events != 1)
+                        return false;
+        }
+        return true;
+}
+
+uint32_t batch_group_index(struct network *n, struct group *g)
+{
+        for (uint32_t i = 0; i < n->groups->num_elements; i++)
+                if (n->groups->elements[i] == g)
+                        return i;
+        return n->groups->num_elements;
+}
+
+/*
+ * Starts a new batch. Each group that is not updated during a forward
+ * sweep holds a copy of its current activation pattern in each row, and
+ * all error signals are reset.
+ */
+void batch_reset(struct network *n, struct batch *b)
+{
+        b->num_rows   = 0;
+        b->num_sparse = 0;
+        for (uint32_t i = 0; i < b->num_groups; i++) {
+                struct group *g = n->groups->elements[i];
+                zero_out_matrix(b->errors[i]);
+                if (g == n->input || schedule_position(n, g)
+                        < n->schedule->num_elements)
+                        continue;
+                for (uint32_t r = 0; r < b->max_rows; r++)
+                        memcpy(matrix_row(b->vectors[i], r),
+                                g->vector->elements,
+                                g->vector->size * sizeof(real));
+        }
+}
+
+/*
+ * Clamps the input vector of an event of an item onto the next row of the
+ * batch. Sparse input vectors are copied into the row as well, but are
+ * also kept, such that the input group is propagated sparsely if all rows
+ * of the batch are sparse.
+ */
+void batch_clamp_input_event(struct network *n, struct batch *b,
+        struct item *item, uint32_t event)
+{
+        uint32_t i = batch_group_index(n, n->input);
+        struct vector row = { n->input->vector->size,
+                matrix_row(b->vectors[i], b->num_rows) };
+        struct sparse_vector *sv = item->sparse_inputs
+                ? item->sparse_inputs[event] : NULL;
+        if (sv) {
+                copy_sparse_vector(sv, &row);
+                b->num_sparse++;
+        } else {
+                copy_vector(item->inputs[event], &row);
+        }
+        b->sparse[b->num_rows] = sv;
+        b->num_rows++;
+}
+
+void batch_forward_sweep(struct network *n, struct batch *b)
+{
+        /*
+         * The schedule is executed by a single team of threads, provided
+         * that at least one group is large enough to be divided among
+         * threads (see kernel.c).
+         */
+#ifdef _OPENMP
+        bool parallel = false;
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                if (batch_feed_forward_in_parallel(n, b, g)
+                        || batch_rows_in_parallel(n, b, g))
+                        parallel = true;
+        }
+#pragma omp parallel if (parallel)
+#endif /* _OPENMP */
+        {
+                for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                        batch_feed_forward_group(n, b,
+                                n->schedule->elements[i]);
+        }
+}
+
+/*
+ * Flags whether the input from projection p is sparse for each item in the
+ * batch.
+ */
+bool batch_sparse_input(struct network *n, struct batch *b,
+        struct projection *p)
+{
+        return p->to == n->input && b->num_sparse == b->num_rows;
+}
+
+/*
+ * Returns the number of rows of the weights of projection p that are
+ * visited for the items in the batch.
+ */
+uint64_t batch_weight_rows(struct network *n, struct batch *b,
+        struct projection *p)
+{
+        if (!batch_sparse_input(n, b, p))
+                return (uint64_t)p->to->vector->size * b->num_rows;
+        uint64_t rows = 0;
+        for (uint32_t r = 0; r < b->num_rows; r++)
+                rows += b->sparse[r]->num_elements;
+        return rows;
+}
+
+/*
+ * Flags whether the net inputs of group g are determined by multiple
+ * threads.
+ */
+bool batch_feed_forward_in_parallel(struct network *n, struct batch *b,
+        struct group *g)
+{
+#ifdef _OPENMP
+        uint64_t work = 0;
+        for (uint32_t i = 0; i < g->inc_projs->num_elements; i++)
+                work += batch_weight_rows(n, b, g->inc_projs->elements[i])
+                        * g->vector->size;
+        return n->flags->omp_mthreaded && work >= n->pars->omp_mac_cutoff;
+#else
+        return false;
+#endif /* _OPENMP */
+}
+
+/*
+ * Flags whether the rows of group g are divided among multiple threads
+ * when applying activation (or error) functions.
+ */
+bool batch_rows_in_parallel(struct network *n, struct batch *b,
+        struct group *g)
+{
+#ifdef _OPENMP
+        uint64_t units = (uint64_t)b->num_rows * g->vector->size;
+        return n->flags->omp_mthreaded && units >= n->pars->omp_unit_cutoff;
+#else
+        return false;
+#endif /* _OPENMP */
+}
+
+/*
+ * Batch counterpart of feed_forward_group().
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see batch_forward_sweep()).
+ */
+void batch_feed_forward_group(struct network *n, struct batch *b,
+        struct group *g)
+{
+        struct matrix *y = b->vectors[batch_group_index(n, g)];
+        struct matrix *ys[g->inc_projs->num_elements];
+        bool sparse[g->inc_projs->num_elements];
+        for (uint32_t x = 0; x < g->inc_projs->num_elements; x++) {
+                struct projection *ip = g->inc_projs->elements[x];
+                ys[x] = b->vectors[batch_group_index(n, ip->to)];
+                sparse[x] = batch_sparse_input(n, b, ip);
+        }
+
+        uint32_t num_tiles = (g->vector->size + KERNEL_TILE_SIZE - 1)
+                / KERNEL_TILE_SIZE;
+        uint32_t t0, t1;
+        kernel_team_range(num_tiles, batch_feed_forward_in_parallel(n, b, g),
+                &t0, &t1);
+        for (uint32_t t = t0; t < t1; t++) {
+                uint32_t c0 = t * KERNEL_TILE_SIZE;
+                uint32_t c1 = c0 + KERNEL_TILE_SIZE;
+                if (c1 > g->vector->size)
+                        c1 = g->vector->size;
+
+                /*
+                 * Determine the net input to the units in the current
+                 * tile, for all items in the batch:
+                 *
+                 * x_bj = sum_i (y_bi * w_ij)
+                 */
+                for (uint32_t r = 0; r < b->num_rows; r++) {
+                        real *yr = matrix_row(y, r);
+                        for (uint32_t j = c0; j < c1; j++)
+                                yr[j] = 0.0;
+                }
+                for (uint32_t x = 0; x < g->inc_projs->num_elements; x++) {
+                        struct projection *ip = g->inc_projs->elements[x];
+                        if (!sparse[x]) {
+                                kernel_gemm(ys[x], ip->weights, y,
+                                        b->num_rows, c0, c1);
+                                continue;
+                        }
+                        for (uint32_t r = 0; r < b->num_rows; r++)
+                                kernel_gemv_trans_sparse(ip->weights,
+                                        b->sparse[r], matrix_row(y, r),
+                                        c0, c1);
+                }
+        }
+
+        /*
+         * Once all net inputs are determined, apply the activation
+         * function to the net inputs of each item.
+         */
+#ifdef _OPENMP
+#pragma omp barrier
+#endif /* _OPENMP */
+        uint32_t r0, r1;
+        kernel_team_range(b->num_rows, batch_rows_in_parallel(n, b, g),
+                &r0, &r1);
+        for (uint32_t r = r0; r < r1; r++) {
+                struct vector v = { g->vector->size, matrix_row(y, r) };
+                struct group bg = *g;
+                bg.vector = &v;
+                g->act_fun->fun(&bg);
+        }
+
+        /* wait until all activation levels are complete */
+#ifdef _OPENMP
+#pragma omp barrier
+#endif /* _OPENMP */
+}
+
+/*
+ * Injects error for each item in the batch, provided a target vector for
+ * each item, and returns the summed output error.
+ */
+double batch_inject_error(struct network *n, struct batch *b,
+        struct vector **targets)
+{
+        struct group *g = n->output;
+        uint32_t i = batch_group_index(n, g);
+        double error = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:error) \
+        if (batch_rows_in_parallel(n, b, g))
+#endif /* _OPENMP */
+        for (uint32_t r = 0; r < b->num_rows; r++) {
+                struct vector v = { g->vector->size,
+                        matrix_row(b->vectors[i], r) };
+                struct vector e = { g->error->size,
+                        matrix_row(b->errors[i], r) };
+                struct group bg = *g;
+                bg.vector = &v;
+                bg.error  = &e;
+                bp_output_error(n, &bg, targets[r]);
+                error += g->err_fun->fun(n, &bg, targets[r]);
+        }
+        return error;
+}
+
+/*
+ * Batch counterpart of bp_backpropagate_error(), starting at the output
+ * group.
+ */
+void batch_backward_sweep(struct network *n, struct batch *b)
+{
+        struct group *g = n->output;
+        uint32_t s = schedule_position(n, g);
+        bool scheduled = s < n->schedule->num_elements;
+        if (!scheduled)
+                s = 0;
+
+        /*
+         * Flag the groups that lie upstream of the output group, i.e., the
+         * groups through which error is backpropagated.
+         */
+        bool upstream[s + 1];
+        memset(upstream, 0, sizeof(upstream));
+        upstream[s] = true;
+        for (uint32_t i = s + 1; i-- > 0 && scheduled;) {
+                struct group *h = n->schedule->elements[i];
+                if (!upstream[i])
+                        continue;
+                for (uint32_t j = 0; j < h->inc_projs->num_elements; j++) {
+                        struct projection *ip = h->inc_projs->elements[j];
+                        for (uint32_t x = 0; x < i; x++)
+                                if (n->schedule->elements[x] == ip->to)
+                                        upstream[x] = true;
+                }
+        }
+
+        /*
+         * Visit the upstream groups by a single team of threads, provided
+         * that at least one group is large enough to be divided among
+         * threads (see kernel.c).
+         */
+#ifdef _OPENMP
+        bool parallel = false;
+        for (uint32_t i = 0; i <= s; i++) {
+                struct group *h = i == s ? g : n->schedule->elements[i];
+                if (!upstream[i])
+                        continue;
+                if (h != g && batch_rows_in_parallel(n, b, h))
+                        parallel = true;
+                for (uint32_t j = 0; j < h->inc_projs->num_elements; j++)
+                        if (batch_backpropagate_in_parallel(n, b, h,
+                                h->inc_projs->elements[j]))
+                                parallel = true;
+        }
+#pragma omp parallel if (parallel)
+#endif /* _OPENMP */
+        {
+                if (!scheduled) {
+                        /* the output group is not part of the schedule */
+                        batch_backpropagate_group(n, b, g);
+                } else {
+                        for (uint32_t i = s + 1; i-- > 0;) {
+                                struct group *h = n->schedule->elements[i];
+                                if (!upstream[i])
+                                        continue;
+                                if (h != g)
+                                        batch_error_signal(n, b, h);
+                                batch_backpropagate_group(n, b, h);
+                        }
+                }
+        }
+}
+
+/*
+ * Flags whether error is backpropagated through projection p to group g by
+ * multiple threads.
+ */
+bool batch_backpropagate_in_parallel(struct network *n, struct batch *b,
+        struct group *g, struct projection *p)
+{
+#ifdef _OPENMP
+        uint64_t work = 2 * batch_weight_rows(n, b, p) * g->vector->size;
+        return n->flags->omp_mthreaded && work >= n->pars->omp_mac_cutoff;
+#else
+        return false;
+#endif /* _OPENMP */
+}
+
+/*
+ * Batch counterpart of bp_error_signal().
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see batch_backward_sweep()).
+ */
+void batch_error_signal(struct network *n, struct batch *b,
+        struct group *g)
+{
+        uint32_t i = batch_group_index(n, g);
+        uint32_t r0, r1;
+        kernel_team_range(b->num_rows, batch_rows_in_parallel(n, b, g),
+                &r0, &r1);
+        for (uint32_t r = r0; r < r1; r++) {
+                struct vector v = { g->vector->size,
+                        matrix_row(b->vectors[i], r) };
+                struct vector e = { g->error->size,
+                        matrix_row(b->errors[i], r) };
+                struct group bg = *g;
+                bg.vector = &v;
+                g->act_fun->deriv(&bg, &e);
+        }
+
+        /* wait until all error signals are complete */
+#ifdef _OPENMP
+#pragma omp barrier
+#endif /* _OPENMP */
+}
+
+/*
+ * Batch counterpart of bp_backpropagate_group().
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see batch_backward_sweep()).
+ */
+void batch_backpropagate_group(struct network *n, struct batch *b,
+        struct group *g)
+{
+        struct matrix *d = b->errors[batch_group_index(n, g)];
+        for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
+                struct projection *ip = g->inc_projs->elements[i];
+                struct group *ng = ip->to;
+                if (ng->inc_projs->num_elements == 0
+                        && batch_sparse_input(n, b, ip)) {
+                        batch_backpropagate_sparse(n, b, g, ip);
+                        continue;
+                }
+                uint32_t x = batch_group_index(n, ng);
+                uint32_t num_tiles = (ng->vector->size + KERNEL_TILE_SIZE - 1)
+                        / KERNEL_TILE_SIZE;
+                uint32_t t0, t1;
+                kernel_team_range(num_tiles,
+                        batch_backpropagate_in_parallel(n, b, g, ip),
+                        &t0, &t1);
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif /* _OPENMP */
+                mark_matrix_rows(ip->gradients);
+                for (uint32_t t = t0; t < t1; t++) {
+                        uint32_t r0 = t * KERNEL_TILE_SIZE;
+                        uint32_t r1 = r0 + KERNEL_TILE_SIZE;
+                        if (r1 > ng->vector->size)
+                                r1 = ng->vector->size;
+
+                        /*
+                         * Compute the error derivatives (for non-terminal
+                         * groups):
+                         *
+                         * dE/dy_bj += sum_k delta_bk w_jk
+                         */
+                        if (ng->inc_projs->num_elements > 0)
+                                kernel_gemm_nt(d, ip->weights,
+                                        b->errors[x], b->num_rows, r0, r1);
+
+                        /*
+                         * Compute the weight gradients, summed over the
+                         * batch:
+                         *
+                         * dE/dw_ij += sum_b delta_bj * y_bi
+                         */
+                        kernel_gemm_tn(b->vectors[x], d, ip->gradients,
+                                b->num_rows, r0, r1);
+                }
+        }
+
+        /* wait until all error derivatives are complete */
+#ifdef _OPENMP
+#pragma omp barrier
+#endif /* _OPENMP */
+}
+
+/*
+ * Computes the gradients of a projection p from the input group to group g,
+ * if the input vectors of all items in the batch are sparse. Only the rows
+ * of the non-zero units of each item are computed:
+ *
+ * dE/dw_ij += sum_b delta_bj * y_bi, for all b with y_bi != 0
+ *
+ * Note: As the non-zero units of different items may coincide, the work is
+ * divided among threads by columns rather than by rows. This is called by
+ * each thread of the team that executes the schedule (see
+ * batch_backward_sweep()).
+ */
+void batch_backpropagate_sparse(struct network *n, struct batch *b,
+        struct group *g, struct projection *p)
+{
+        struct matrix *d = b->errors[batch_group_index(n, g)];
+        uint32_t num_tiles = (g->vector->size + KERNEL_TILE_SIZE - 1)
+                / KERNEL_TILE_SIZE;
+        uint32_t t0, t1;
+        kernel_team_range(num_tiles,
+                batch_backpropagate_in_parallel(n, b, g, p), &t0, &t1);
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif /* _OPENMP */
+        for (uint32_t r = 0; r < b->num_rows; r++)
+                for (uint32_t x = 0; x < b->sparse[r]->num_elements; x++)
+                        mark_matrix_row(p->gradients,
+                                b->sparse[r]->indices[x]);
+        for (uint32_t t = t0; t < t1; t++) {
+                uint32_t c0 = t * KERNEL_TILE_SIZE;
+                uint32_t c1 = c0 + KERNEL_TILE_SIZE;
+                if (c1 > g->vector->size)
+                        c1 = g->vector->size;
+                for (uint32_t r = 0; r < b->num_rows; r++) {
+                        struct sparse_vector *sv = b->sparse[r];
+                        real *dr = matrix_row(d, r);
+                        for (uint32_t x = 0; x < sv->num_elements; x++) {
+                                real *gr = matrix_row(p->gradients,
+                                        sv->indices[x]);
+                                real v = sv->elements[x];
+                                for (uint32_t j = c0; j < c1; j++)
+                                        gr[j] += v * dr[j];
+                        }
+                }
+        }
+}
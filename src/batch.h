@@ -0,0 +1,77 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "matrix.h"
+#include "network.h"
+#include "set.h"
+#include "vector.h"
+
+/*
+ * Maximum number of items that are processed as one batch. Larger batches
+ * are processed in chunks of this size.
+ */
+#define BATCH_MAX_ROWS 64
+
+struct batch
+{
+        uint32_t max_rows;              /* maximum number of rows */
+        uint32_t num_rows;              /* number of rows in use */
+        uint32_t num_groups;            /* number of groups */
+        struct matrix **vectors;        /* unit matrix for each group */
+        struct matrix **errors;         /* error matrix for each group */
+        struct sparse_vector **sparse;  /* sparse input of each row */
+        uint32_t num_sparse;            /* number of sparse input rows */
+};
+
+struct batch *create_batch(struct network *n, uint32_t max_rows);
+void free_batch(struct batch *b);
+bool batchable_network(struct network *n);
+uint32_t batch_group_index(struct network *n, struct group *g);
+
+void batch_reset(struct network *n, struct batch *b);
+void batch_clamp_input_event(struct network *n, struct batch *b,
+        struct item *item, uint32_t event);
+void batch_forward_sweep(struct network *n, struct batch *b);
+bool batch_sparse_input(struct network *n, struct batch *b,
+        struct projection *p);
+uint64_t batch_weight_rows(struct network *n, struct batch *b,
+        struct projection *p);
+bool batch_feed_forward_in_parallel(struct network *n, struct batch *b,
+        struct group *g);
+bool batch_rows_in_parallel(struct network *n, struct batch *b,
+        struct group *g);
+void batch_feed_forward_group(struct network *n, struct batch *b,
+        struct group *g);
+
+double batch_inject_error(struct network *n, struct batch *b,
+        struct vector **targets);
+void batch_backward_sweep(struct network *n, struct batch *b);
+bool batch_backpropagate_in_parallel(struct network *n, struct batch *b,
+        struct group *g, struct projection *p);
+void batch_error_signal(struct network *n, struct batch *b,
+        struct group *g);
+void batch_backpropagate_group(struct network *n, struct batch *b,
+        struct group *g);
+void batch_backpropagate_sparse(struct network *n, struct batch *b,
+        struct group *g, struct projection *p);
+
+#endif /* BATCH_H */
@@ -15,11 +15,14 @@
  */
 
 #include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "act.h"
 #include "bp.h"
 #include "error.h"
+#include "kernel.h"
 #include "main.h"
 #include "math.h"
 
@@ -80,36 +83,139 @@ Rumelhart, D. E., Hinton, G. E., & Williams, R. J. (1986). Learning
 void bp_output_error(struct network *n, struct group *g, struct vector *t)
 {
         /*
-         * First, compute error derivates dE/dy for all units in the output
-         * layer.
+         * If the output layer is a softmax group trained on divergence,
+         * its error signals can be computed directly (see error.c).
+         */
+        if (g->act_fun->fun == act_fun_softmax
+                && g->err_fun->fun == err_fun_divergence) {
+                err_fun_divergence_softmax_deriv(n, g, t);
+                return;
+        }
+
+        /*
+         * Otherwise, first compute error derivates dE/dy for all units in
+         * the output layer.
          */
         g->err_fun->deriv(n, g, t);
 
         /*
          * Multiply all error derivatives dE/dy with the activation function
          * derivative f'(x_j) to obtain the error signal for unit j.
-         *
-         * In case of softmax, the derivative of the activation function
-         * directly outputs the error signal for unit j.
+         */
+        bp_error_signal(n, g);
+}
+
+/*
+ * This is the main BP function. Provided a group g for which error signals
+ * have been determined, it backpropagates these error signals through the
+ * network by executing the network's schedule in reverse order, starting
+ * at g. Each group that precedes g is visited once, after all groups to
+ * which it projects have been visited, and only if it lies upstream of g.
+ */
+void bp_backpropagate_error(struct network *n, struct group *g)
+{
+        uint32_t s = schedule_position(n, g);
+        bool scheduled = s < n->schedule->num_elements;
+
+        /*
+         * Flag the groups that lie upstream of g, i.e., the groups through
+         * which error is backpropagated.
+         */
+        bool upstream[s + 1];
+        memset(upstream, 0, sizeof(upstream));
+        upstream[s] = true;
+        for (uint32_t i = s + 1; i-- > 0 && scheduled;) {
+                struct group *h = n->schedule->elements[i];
+                if (!upstream[i])
+                        continue;
+                for (uint32_t j = 0; j < h->inc_projs->num_elements; j++) {
+                        struct projection *ip = h->inc_projs->elements[j];
+                        /*
+                         * During BPTT, we want to backpropagate error only
+                         * through the network of the current timestep.
+                         */
+                        if (ip->flags->recurrent)
+                                continue;
+                        for (uint32_t x = 0; x < i; x++)
+                                if (n->schedule->elements[x] == ip->to)
+                                        upstream[x] = true;
+                }
+        }
+
+        /*
+         * Visit the upstream groups by a single team of threads, provided
+         * that at least one projection is large enough to be divided among
+         * threads (see kernel.c).
          */
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded && g->act_fun->fun != act_fun_softmax)
+        bool parallel = false;
+        for (uint32_t i = 0; i <= s; i++) {
+                struct group *h = i == s ? g : n->schedule->elements[i];
+                for (uint32_t j = 0; j < h->inc_projs->num_elements; j++)
+                        if (upstream[i] && bp_backpropagate_in_parallel(
+                                n, h, h->inc_projs->elements[j]))
+                                parallel = true;
+        }
+#pragma omp parallel if (parallel)
 #endif /* _OPENMP */
-        for (uint32_t i = 0; i < g->error->size; i++)
-                if (g->act_fun->fun != act_fun_softmax)
-                        g->error->elements[i] *= g->act_fun->deriv(g, i);
-                else
-                        /* softmax */
-                        g->error->elements[i] = g->act_fun->deriv(g, i);
+        {
+                if (!scheduled) {
+                        /* g is not part of the schedule */
+                        bp_backpropagate_group(n, g);
+                } else {
+                        for (uint32_t i = s + 1; i-- > 0;) {
+                                struct group *h = n->schedule->elements[i];
+                                if (!upstream[i])
+                                        continue;
+
+                                /*
+                                 * All groups to which h projects have been
+                                 * visited, so its error derivatives are
+                                 * complete. Multiply them with the relevant
+                                 * activation derivatives to get the error
+                                 * signals (the error signals of g have
+                                 * already been determined).
+                                 */
+                                if (h != g) {
+#ifdef _OPENMP
+#pragma omp single
+#endif /* _OPENMP */
+                                        bp_error_signal(n, h);
+                                }
+                                bp_backpropagate_group(n, h);
+                        }
+                }
+        }
 }
 
 /*
- * This is the main BP function. Provided a group g, it computes the error
- * signals for each group g' that projects to g, as well as the gradients
- * for the weights on the projection between these groups. Next, it
- * recursively propagates these error signals to earlier groups.
+ * Flags whether error is backpropagated through projection p to group g by
+ * multiple threads.
  */
-void bp_backpropagate_error(struct network *n, struct group *g)
+bool bp_backpropagate_in_parallel(struct network *n, struct group *g,
+        struct projection *p)
+{
+#ifdef _OPENMP
+        uint32_t rows = bp_sparse_gradients(p)
+                ? p->to->sparse->num_elements
+                : p->to->vector->size;
+        uint64_t work = 2 * (uint64_t)rows * g->vector->size;
+        return n->flags->omp_mthreaded && work >= n->pars->omp_mac_cutoff;
+#else
+        return false;
+#endif /* _OPENMP */
+}
+
+/*
+ * Provided a group g for which error signals have been determined, this
+ * computes the error derivatives for each group g' that projects to g, as
+ * well as the gradients for the weights on the projections between these
+ * groups.
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see bp_backpropagate_error()).
+ */
+void bp_backpropagate_group(struct network *n, struct group *g)
 {
         /*
          * Note: Each group g' that projects to g can receive error signals
@@ -119,102 +225,348 @@ void bp_backpropagate_error(struct network *n, struct group *g)
          *
          *     dE/dy_j = sum_g'' sum_k delta_k w_jk
          *
-         * where all groups g'' are groups to which g' projects.
+         * where all groups g'' are groups to which g' projects. The
+         * contributions of each g'' are summed into the error vector of g',
+         * as each g'' is visited before g'.
          */
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *ip = g->inc_projs->elements[i];
                 struct group *ng = ip->to;
-
-                for (uint32_t j = 0; j < ng->out_projs->num_elements; j++) {
-                        struct projection *p = ng->out_projs->elements[j];
+                if (bp_sparse_gradients(ip)) {
+                        bp_backpropagate_sparse(n, g, ip);
+                        continue;
+                }
+                uint32_t num_tiles = (ng->vector->size + KERNEL_TILE_SIZE - 1)
+                        / KERNEL_TILE_SIZE;
+                uint32_t t0, t1;
+                kernel_team_range(num_tiles,
+                        bp_backpropagate_in_parallel(n, g, ip), &t0, &t1);
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded)
+#pragma omp single nowait
 #endif /* _OPENMP */
-                        for (uint32_t x = 0; x < ng->error->size; x++) {
-                                for (uint32_t z = 0; z < p->to->vector->size; z++) {                                      
-                                        /*
-                                         * Compute the error derivative
-                                         * (for non-terminal groups):
-                                         *
-                                         * dE/dy_j += sum_k delta_k w_jk
-                                         */
-                                        if (ng->inc_projs->num_elements > 0)
-                                                ng->error->elements[x] += p->to->error->elements[z]
-                                                        * p->weights->elements[x][z];
-
-                                        /*
-                                         * We only compute gradients for
-                                         * projections to g:
-                                         *
-                                         *     0
-                                         *     |
-                                         *     1   3
-                                         *     | \ |
-                                         *     2   4   .
-                                         *         | \ |
-                                         *         5   7
-                                         *             |
-                                         *             . 
-                                         *
-                                         * If the current group is 1, we
-                                         * compute the gradients for the
-                                         * projection between 1 and 2, and
-                                         * the one between 1 and 4. If the
-                                         * current group is 4, we compute
-                                         * the gradients of the projection
-                                         * between 4 and 5, and the one
-                                         * between 4 and 7, and so forth.
-                                         */
-                                        if (p->to != g)
-                                                continue;
-                                                
-                                        /*
-                                         * Compute the weight gradient:
-                                         *
-                                         * dE/dw_ij += delta_j * y_i
-                                         *
-                                         * Note: gradients may sum over an
-                                         * epoch.
-                                         */
-                                        p->gradients->elements[x][z] += p->to->error->elements[z]
-                                                * ng->vector->elements[x];                                        
+                mark_matrix_rows(ip->gradients);
+                for (uint32_t t = t0; t < t1; t++) {
+                        uint32_t r0 = t * KERNEL_TILE_SIZE;
+                        uint32_t r1 = r0 + KERNEL_TILE_SIZE;
+                        if (r1 > ng->vector->size)
+                                r1 = ng->vector->size;
 
-                                }
-                        }
+                        /*
+                         * Compute the error derivatives (for non-terminal
+                         * groups, and for groups that project recurrently
+                         * to g, as these may be views on the error vectors
+                         * of an earlier timestep; see rnn_unfold.c):
+                         *
+                         * dE/dy_j += sum_k delta_k w_jk
+                         */
+                        if (ng->inc_projs->num_elements > 0
+                                || ip->flags->recurrent)
+                                kernel_gemv(ip->weights,
+                                        g->error->elements,
+                                        ng->error->elements, r0, r1);
+
+                        /*
+                         * Compute the weight gradients:
+                         *
+                         * dE/dw_ij += delta_j * y_i
+                         *
+                         * Note: gradients may sum over an epoch.
+                         */
+                        kernel_ger(ip->gradients,
+                                ng->vector->elements,
+                                g->error->elements, r0, r1);
                 }
+        }
 
-                /*
-                 * Multiply each error derivative with its relevant
-                 * activation derivative to get the error signal:
-                 *
-                 * delta_j = f'(x_j) dE/dy_j
-                 *
-                 * In case of softmax, the derivative of the activation function
-                 * directly outputs the error signal for unit j.
-                 */
+        /* wait until all error derivatives are complete */
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded && g->act_fun->fun != act_fun_softmax)
+#pragma omp barrier
 #endif /* _OPENMP */
-                for (uint32_t x = 0; x < ng->error->size; x++)
-                        if (ng->act_fun->fun != act_fun_softmax)
-                                ng->error->elements[x] *= ng->act_fun->deriv(ng, x);
-                        else
-                                ng->error->elements[x] = ng->act_fun->deriv(ng, x);
+}
+
+/*
+ * Flags whether the gradients of a projection p from group g' to group g
+ * are sparse. This is the case if g' is clamped with a sparse vector (see
+ * engine.c), and if no error derivatives are computed for g', so that only
+ * the gradients of the non-zero units of g' need to be computed.
+ */
+bool bp_sparse_gradients(struct projection *p)
+{
+        struct group *ng = p->to;
+        return ng->sparse && ng->inc_projs->num_elements == 0
+                && !p->flags->recurrent;
+}
+
+/*
+ * Computes the gradients of a projection p from group g' to group g, if
+ * g' is clamped with a sparse vector. Only the rows of the non-zero units
+ * of g' are computed, and these are flagged as dirty:
+ *
+ * dE/dw_ij += delta_j * y_i, for all i with y_i != 0
+ *
+ * Note: This is called by each thread of the team that executes the
+ * schedule (see bp_backpropagate_error()).
+ */
+void bp_backpropagate_sparse(struct network *n, struct group *g,
+        struct projection *p)
+{
+        struct sparse_vector *sv = p->to->sparse;
+        uint32_t num_tiles = (sv->num_elements + KERNEL_TILE_SIZE - 1)
+                / KERNEL_TILE_SIZE;
+        uint32_t t0, t1;
+        kernel_team_range(num_tiles, bp_backpropagate_in_parallel(n, g, p),
+                &t0, &t1);
+#ifdef _OPENMP
+#pragma omp single nowait
+#endif /* _OPENMP */
+        for (uint32_t x = 0; x < sv->num_elements; x++)
+                mark_matrix_row(p->gradients, sv->indices[x]);
+        for (uint32_t t = t0; t < t1; t++) {
+                uint32_t x0 = t * KERNEL_TILE_SIZE;
+                uint32_t x1 = x0 + KERNEL_TILE_SIZE;
+                if (x1 > sv->num_elements)
+                        x1 = sv->num_elements;
+                for (uint32_t x = x0; x < x1; x++) {
+                        uint32_t r = sv->indices[x];
+                        kernel_ger(p->gradients, p->to->vector->elements,
+                                g->error->elements, r, r + 1);
+                }
         }
+}
 
-        /*
-         * Recursively backpropagate error.
-         */
-        for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
-                struct projection *ip = g->inc_projs->elements[i];
-                /*
-                 * During BPTT, we want to backpropagate error only through
-                 * the network of the current timestep.
-                 */
-                if (ip->flags->recurrent)
-                        continue;
-                bp_backpropagate_error(n, ip->to);
+/*
+ * Multiply each error derivative of group g with its relevant activation
+ * derivative to get the error signal:
+ *
+ * delta_j = f'(x_j) dE/dy_j
+ *
+ * In case of softmax, the derivative of the activation function directly
+ * outputs the error signal for unit j.
+ */
+void bp_error_signal(struct network *n, struct group *g)
+{
+        g->act_fun->deriv(g, g->error);
+}
+
+/*
+ * Swaps the current and previous weight gradients of a projection p, such
+ * that the gradients of the last update become the previous gradients,
+ * without copying them. The blocks of the gradient matrices are swapped,
+ * rather than the matrices themselves, as these are shared with the
+ * outgoing counterpart of p, and with the projections of unfolded
+ * networks (see rnn_unfold.c).
+ *
+ * Note: The update algorithms reset the previous gradients while
+ * adjusting the weights, such that accumulation of the next gradients
+ * starts from zero.
+ */
+void bp_swap_gradients(struct projection *p)
+{
+        swap_matrices(p->gradients, p->prev_gradients);
+}
+
+/*
+ * This accumulates the status statistics for the weights between unit i
+ * in group g' and all units in group g, before these are adjusted:
+ *
+ *      sum_j (Dw_ij(t-1) * dE/dw_ij)
+ *      sum_j (Dw_ij(t-1) ^ 2)
+ *      sum_j (dE/dw_ij ^ 2)
+ *
+ * If reset is true, gradients that changed sign count as zero, as these
+ * are reset by the update (see Rprop below).
+ */
+void bp_delta_statistics(struct projection *p, uint32_t i, bool reset,
+        double *gradient_linearity, double *last_deltas_length,
+        double *gradients_length)
+{
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        double gl = 0.0, dl = 0.0, gs = 0.0;
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = reset && pg[j] * gr[j] < 0.0 ? 0.0 : gr[j];
+                gl += pd[j] * grad;
+                dl += pd[j] * pd[j];
+                gs += grad * grad;
+        }
+        *gradient_linearity += gl;
+        *last_deltas_length += dl;
+        *gradients_length   += gs;
+}
+
+/*
+ * This returns the weight cost of the weights between unit i in group g'
+ * and all units in group g:
+ *
+ *      wc = sum_j (w_ij ^ 2)
+ */
+double bp_weight_cost(struct projection *p, uint32_t i)
+{
+        real *w = matrix_row(p->weights, i);
+        double wc = 0.0;
+        for (uint32_t j = 0; j < p->weights->cols; j++)
+                wc += w[j] * w[j];
+        return wc;
+}
+
+                /************************
+                 **** sparse updates ****
+                 ************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+If the input vectors are sparse, the gradients of the projections from the
+input group only accumulate in the rows of active input units (see
+bp_backpropagate_sparse()), and the dirty rows of their gradient matrices
+are tracked (see matrix.h). For steepest descent without momentum, and for
+Rprop, a row i without (previous) gradients is adjusted by weight decay
+only:
+
+        w_ij = w_ij - d * w_ij
+
+Such rows are therefore skipped when weights are updated, and the weight
+decay of the skipped updates is applied lazily. Each projection counts its
+updates, as well as the updates that have been applied to each of its rows.
+Once the weights of row i are needed again, after k skipped updates, they
+are decayed at once:
+
+        w_ij = (1 - d)^k * w_ij
+
+The weights of a row are needed again if the row has gradients in a later
+update, or if its unit is active in an item that is processed. Before
+the items of a batch are processed, the rows of their active input units
+are therefore brought up to date (see bp_catch_up_items()), and all rows
+are brought up to date in updates that report statistics, before weight
+decay is scaled, and once training ends.
+
+Rprop also visits the rows that had gradients in the previous update (even
+if these have none in the current one), as these rows still need to reset
+their previous gradients. Other update algorithms adjust weights without
+gradients in ways that depend on their history (through momentum,
+Quickprop steps, or DBD learning rates), and always adjust all rows.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/*
+ * Flags whether only the rows of projection p with (previous) gradients
+ * are adjusted in the current update.
+ */
+bool bp_sparse_update(struct network *n, struct projection *p)
+{
+        return p->row_updates && !n->status->report
+                && matrix_rows_sparse(p->gradients)
+                && (!p->prev_gradients
+                        || matrix_rows_sparse(p->prev_gradients));
+}
+
+/*
+ * Applies the weight decay of the updates that row i of projection p has
+ * skipped. If previous weight deltas are kept, the delta of the last
+ * skipped update is restored as well (which is zero without weight decay).
+ */
+void bp_catch_up_row(struct network *n, struct projection *p, uint32_t i)
+{
+        uint32_t k = p->num_updates - p->row_updates[i];
+        p->row_updates[i] = p->num_updates;
+        double wd = n->pars->weight_decay;
+        if (k == 0 || (wd == 0.0 && !p->prev_deltas))
+                return;
+        real *w  = matrix_row(p->weights, i);
+        real *pd = p->prev_deltas ? matrix_row(p->prev_deltas, i) : NULL;
+        if (wd == 0.0) {
+                memset(pd, 0, p->prev_deltas->cols * sizeof(real));
+                return;
+        }
+        double sf = pow(1.0 - wd, k - 1);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double weight = w[j] * sf;
+                double weight_delta = -wd * weight;
+                w[j] = weight + weight_delta;
+                if (pd)
+                        pd[j] = weight_delta;
+        }
+}
+
+/*
+ * Brings all rows of projection p up to date.
+ */
+void bp_catch_up_projection(struct network *n, struct projection *p)
+{
+        if (!p->row_updates)
+                return;
+        for (uint32_t i = 0; i < p->weights->rows; i++)
+                bp_catch_up_row(n, p, i);
+}
+
+/*
+ * Brings all rows of all projections of network n up to date.
+ */
+void bp_catch_up_network(struct network *n)
+{
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++)
+                        bp_catch_up_projection(n, g->inc_projs->elements[j]);
+        }
+}
+
+/*
+ * Brings the rows of the projections from the input group that are read
+ * while a number of items is processed up to date. These are the rows of
+ * the active units of sparse input vectors, or all rows if an item has
+ * a dense input vector.
+ */
+void bp_catch_up_items(struct network *n, struct item **items,
+        uint32_t num_items)
+{
+        if (n->pars->weight_decay == 0.0)
+                return;
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *p = g->inc_projs->elements[j];
+                        if (!p->row_updates || p->to != n->input)
+                                continue;
+                        if (!bp_catch_up_sparse_items(n, p, items,
+                                num_items))
+                                bp_catch_up_projection(n, p);
+                }
+        }
+}
+
+/*
+ * Brings the rows of projection p for the active units of the sparse input
+ * vectors of a number of items up to date. Returns false as soon as an item
+ * with a dense input vector is encountered.
+ */
+bool bp_catch_up_sparse_items(struct network *n, struct projection *p,
+        struct item **items, uint32_t num_items)
+{
+        for (uint32_t x = 0; x < num_items; x++) {
+                struct item *item = items[x];
+                if (!item->sparse_inputs)
+                        return false;
+                for (uint32_t e = 0; e < item->num_events; e++) {
+                        struct sparse_vector *sv = item->sparse_inputs[e];
+                        if (!sv)
+                                return false;
+                        for (uint32_t k = 0; k < sv->num_elements; k++)
+                                bp_catch_up_row(n, p, sv->indices[k]);
+                }
         }
+        return true;
+}
+
+/*
+ * Counts an update of projection p in which all of its rows have been
+ * adjusted.
+ */
+void bp_count_update(struct projection *p)
+{
+        if (!p->row_updates)
+                return;
+        p->num_updates++;
+        for (uint32_t i = 0; i < p->weights->rows; i++)
+                p->row_updates[i] = p->num_updates;
 }
 
                 /**************************
@@ -243,49 +595,57 @@ void bp_update_sd(struct network *n)
         if (n->flags->sd_type == SD_BOUNDED)
                 determine_sd_scale_factor(n);
 
-        bp_update_inc_projs_sd(n, n->output);
+        /* adjust the incoming projections of all scheduled groups */
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                bp_update_inc_projs_sd(n, n->schedule->elements[i]);
 
         /*
-         * Compute gradient linearity:
+         * Compute gradient linearity (if reported):
          *
          *         sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
          * gl = -( ----------------------------------- )
          *         sqrt(sum_i sum_j (Dw_ij(t-1) ^ 2))
          *         * sqrt(sum_i sum_j (dE/dw_ij ^ 2))
          */
-        n->status->gradient_linearity = -(n->status->gradient_linearity
-                / sqrt(n->status->last_deltas_length
-                        * n->status->gradients_length));
+        if (n->status->report)
+                determine_gradient_linearity(n);
 }
 
 /*
- * Recursively adjusts the weights of all incoming projections of a group g.
+ * Adjusts the weights of all incoming projections of a group g.
  */
 void bp_update_inc_projs_sd(struct network *n, struct group *g)
 {
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *p = g->inc_projs->elements[i];
                 /*
-                 * Adjust weights if projection is not frozen.
+                 * Adjust weights if projection is not frozen. Steepest
+                 * descent does not need the previous weight gradients, so
+                 * the gradients are left in place until the next batch
+                 * (see bp_reset_gradients_sd()).
                  */
                 if (!p->flags->frozen)
                         bp_update_projection_sd(n, g, p);
-                
-                /*
-                 * Make a copy of the weight gradients, and reset the
-                 * current weight gradients.
-                 */
-                copy_matrix(p->gradients, p->prev_gradients);
-                zero_out_matrix(p->gradients);
-
-                /*
-                 * During BPTT, we want to only adjust weights in the
-                 * network of the current timestep.
-                 */
-                if (p->flags->recurrent)
-                        continue;
+        }
+}
 
-                bp_update_inc_projs_sd(n, p->to);
+/*
+ * Resets the gradients of all projections before the items of the next
+ * batch are processed. Steepest descent keeps no previous gradients, so
+ * the gradients of its last update are kept until then, such that they
+ * can be inspected (see cmd_show_matrix()).
+ */
+void bp_reset_gradients_sd(struct network *n)
+{
+        if (n->update_algorithm != bp_update_sd)
+                return;
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *p = g->inc_projs->elements[j];
+                        if (p->gradients)
+                                zero_out_matrix(p->gradients);
+                }
         }
 }
 
@@ -300,6 +660,17 @@ void bp_update_projection_sd(struct network *n, struct group *g,
         double gradient_linearity = 0.0;
         double last_deltas_length = 0.0;
         double gradients_length   = 0.0;
+        bool stats = n->status->report;
+
+        /*
+         * Adjust only the rows with gradients, if possible. Otherwise,
+         * bring all rows up to date (see "sparse updates" above).
+         */
+        if (bp_sparse_update(n, p)) {
+                bp_update_rows_sd(n, g, p);
+                return;
+        }
+        bp_catch_up_projection(n, p);
 
         /*
          * Adjust the weight between unit i in group g' and unit j in group
@@ -307,7 +678,8 @@ void bp_update_projection_sd(struct network *n, struct group *g,
          */
 #ifdef _OPENMP
 #pragma omp parallel for reduction(+:weight_cost, gradient_linearity, last_deltas_length, gradients_length) \
-        if (n->flags->omp_mthreaded)
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)p->to->vector->size * g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < p->to->vector->size; i++) {
                 for (uint32_t j = 0; j < g->vector->size; j++) {
@@ -330,9 +702,14 @@ void bp_update_projection_sd(struct network *n, struct group *g,
                          * Next, we apply momentum:
                          *
                          * Dw_ij = Dw_ij + a * Dw_ij(t-1)
+                         *
+                         * Note: Previous weight deltas are only kept if
+                         * momentum is used. Otherwise, the gradient
+                         * linearity is not reported.
                          */
-                        weight_delta += n->pars->momentum
-                                * p->prev_deltas->elements[i][j];
+                        double prev_delta = p->prev_deltas
+                                ? p->prev_deltas->elements[i][j] : 0.0;
+                        weight_delta += n->pars->momentum * prev_delta;
                         
                         /*
                          * Finally, we apply weight decay:
@@ -350,44 +727,56 @@ void bp_update_projection_sd(struct network *n, struct group *g,
                         p->weights->elements[i][j] += weight_delta;
                         
                         /*
-                         * Compute weight cost:
-                         *
-                         * wc = sum_i sum_j (w_ij ^ 2)
-                         */
-                        weight_cost += pow(p->weights->elements[i][j], 2.0);
-                        
-                        /*
-                         * Compute the numerator of the gradient linearity:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
-                         */
-                        gradient_linearity +=
-                                p->prev_deltas->elements[i][j]
-                                * p->gradients->elements[i][j];
-                        
-                        /*
-                         * Compute the sum of squares of the previous weight
-                         * delta vector:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) ^ 2
+                         * Compute the status statistics, if these
+                         * are reported for this update.
                          */
-                        last_deltas_length +=
-                                 pow(p->prev_deltas->elements[i][j], 2.0);
+                        if (stats) {
+                                /*
+                                 * Compute weight cost:
+                                 *
+                                 * wc = sum_i sum_j (w_ij ^ 2)
+                                 */
+                                weight_cost +=
+                                        pow(p->weights->elements[i][j], 2.0);
 
-                        /*
-                         * Compute the sum of squares of the gradients:
-                         *
-                         * sum_i sum_j (dE/dw_ij ^ 2)
-                         */
-                        gradients_length +=
-                                pow(p->gradients->elements[i][j], 2.0);
+                                /*
+                                 * Compute the numerator of the gradient
+                                 * linearity:
+                                 *
+                                 * sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
+                                 */
+                                gradient_linearity += prev_delta
+                                        * p->gradients->elements[i][j];
+
+                                /*
+                                 * Compute the sum of squares of the
+                                 * previous weight delta vector:
+                                 *
+                                 * sum_i sum_j (Dw_ij(t-1) ^ 2
+                                 */
+                                last_deltas_length += pow(prev_delta, 2.0);
+
+                                /*
+                                 * Compute the sum of squares of the
+                                 * gradients (unless bounded steepest
+                                 * descent already did so):
+                                 *
+                                 * sum_i sum_j (dE/dw_ij ^ 2)
+                                 */
+                                if (n->flags->sd_type == SD_DEFAULT)
+                                        gradients_length += pow(
+                                                p->gradients->elements[i][j],
+                                                2.0);
+                        }
 
                         /* 
                          * Store a copy of the weight change.
                          */
-                        p->prev_deltas->elements[i][j] = weight_delta;
+                        if (p->prev_deltas)
+                                p->prev_deltas->elements[i][j] = weight_delta;
                 }
         }
+        bp_count_update(p);
 
         /*
          * Add the local status statistics to the global status statistics.
@@ -398,6 +787,38 @@ void bp_update_projection_sd(struct network *n, struct group *g,
         n->status->gradients_length   += gradients_length;
 }
 
+/*
+ * This adjusts only the rows of a projection p between a group g' and g
+ * that have gradients (see "sparse updates" above). As momentum is not
+ * used, and statistics are not reported, the weight delta is:
+ *
+ * Dw_ij = -epsilon * dE/dw_ij - d * w_ij
+ */
+void bp_update_rows_sd(struct network *n, struct group *g,
+        struct projection *p)
+{
+        struct matrix *gr = p->gradients;
+#ifdef _OPENMP
+#pragma omp parallel for \
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)gr->num_dirty * g->vector->size >= n->pars->omp_unit_cutoff)
+#endif /* _OPENMP */
+        for (uint32_t x = 0; x < gr->num_dirty; x++) {
+                uint32_t i = gr->dirty_rows[x];
+                bp_catch_up_row(n, p, i);
+                real *w  = matrix_row(p->weights, i);
+                real *gi = matrix_row(gr, i);
+                for (uint32_t j = 0; j < g->vector->size; j++) {
+                        double weight_delta = -n->pars->learning_rate
+                                * n->pars->sd_scale_factor * gi[j];
+                        weight_delta -= n->pars->weight_decay * w[j];
+                        w[j] += weight_delta;
+                }
+                p->row_updates[i] = p->num_updates + 1;
+        }
+        p->num_updates++;
+}
+
                 /**********************************
                  **** bounded steepest descent ****
                  **********************************/
@@ -422,48 +843,169 @@ Rohde, D. L. T. (2002). A connectionist model of sentence comprehension and
 
 void determine_sd_scale_factor(struct network *n)
 {
-        /* reset scaling factor */
-        n->pars->sd_scale_factor = 0.0;
-
         /* 
-         * Resursively compute the sum of squares of the individual weight
-         * gradients.
+         * Compute the sum of squares of the individual weight gradients.
+         * This doubles as the gradients length status statistic, which is
+         * therefore not computed again while the weights are adjusted.
          */
-        determine_gradient_ssq(n, n->output);
+        n->status->gradients_length = 0.0;
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                determine_gradient_ssq(n, n->schedule->elements[i]);
 
         /* determine the scaling factor */
-        if (n->pars->sd_scale_factor > 1.0)
-                n->pars->sd_scale_factor = 1.0 / sqrt(n->pars->sd_scale_factor);
+        if (n->status->gradients_length > 1.0)
+                n->pars->sd_scale_factor =
+                        1.0 / sqrt(n->status->gradients_length);
         else
                 n->pars->sd_scale_factor = 1.0;
 }
 
 /*
- * Resursively compute the sum of squares of the individual weight
- * gradients.
+ * Compute the sum of squares of the individual weight gradients of all
+ * incoming projections of a group g.
  */
 void determine_gradient_ssq(struct network *n, struct group *g)
 {
-        /* local scale factor */
-        double sd_scale_factor = 0.0;
+        /* local sum of squares */
+        double gradients_length = 0.0;
 
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *p = g->inc_projs->elements[i];
 
-                /* sum gradients */
+                /* sum gradients of dirty rows only, if tracked */
+                if (matrix_rows_sparse(p->gradients)) {
+                        struct matrix *m = p->gradients;
+                        for (uint32_t x = 0; x < m->num_dirty; x++) {
+                                real *gr = matrix_row(m, m->dirty_rows[x]);
+                                for (uint32_t j = 0; j < m->cols; j++)
+                                        gradients_length += gr[j] * gr[j];
+                        }
+                        continue;
+                }
+
+                /* sum gradients (padding is zero) */
+                size_t bs = matrix_block_size(p->gradients);
+                real *gr = p->gradients->data;
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+:sd_scale_factor) if (n->flags->omp_mthreaded)
+#pragma omp parallel for reduction(+:gradients_length) \
+        if (n->flags->omp_mthreaded && bs >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
-                for (uint32_t j = 0; j < p->to->vector->size; j++)
-                        for (uint32_t x = 0; x < g->vector->size; x++)
-                                sd_scale_factor +=
-                                        pow(p->gradients->elements[j][x], 2.0);
-                
-                determine_gradient_ssq(n, p->to);
+                for (size_t x = 0; x < bs; x++)
+                        gradients_length += gr[x] * gr[x];
+        }
+
+        /* add local sum of squares to the global sum of squares */
+        n->status->gradients_length += gradients_length;
+}
+
+                /****************************************
+                 **** asynchronous steepest descent ****
+                 ****************************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+This implements the weight update of asynchronous ("Hogwild!") steepest
+descent (Niu et al., 2011). Several threads each train on a different item,
+using their own replica of the network, and immediately adjust the shared
+weights after each item:
+
+        w_ij = w_ij - epsilon * dE/dw_ij - d * w_ij
+
+without any form of locking. Threads may occasionally overwrite each
+other's adjustment of a weight, but if gradients are sparse (e.g., for
+localist input vectors), such collisions are rare and do not hamper
+convergence. Momentum is not applied, as the previous weight deltas would be
+shared between threads.
+
+Niu, F., Recht, B., Re, C., and Wright, S. J. (2011). Hogwild!: A lock-free
+        approach to parallelizing stochastic gradient descent. Advances in
+        Neural Information Processing Systems, 24, 693-701.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void bp_update_hogwild(struct network *n)
+{
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *p = g->inc_projs->elements[j];
+                        if (!p->flags->frozen)
+                                bp_update_projection_hogwild(n, p);
+                        else
+                                zero_out_matrix(p->gradients);
+                }
+        }
+}
+
+/*
+ * If the input vectors are sparse, and weight decay is not used, only the
+ * rows of p with gradients are adjusted (see "sparse updates" above). Weight
+ * decay is not applied lazily, as the rows would then need to be brought up
+ * to date by the threads that share them.
+ */
+void bp_update_projection_hogwild(struct network *n, struct projection *p)
+{
+        real lr = n->pars->learning_rate;
+        real wd = n->pars->weight_decay;
+        struct matrix *m = p->gradients;
+        if (wd == 0.0 && matrix_rows_sparse(m)) {
+                for (uint32_t x = 0; x < m->num_dirty; x++) {
+                        uint32_t i = m->dirty_rows[x];
+                        real *w  = matrix_row(p->weights, i);
+                        real *gr = matrix_row(m, i);
+                        for (uint32_t j = 0; j < m->cols; j++) {
+                                w[j] -= lr * gr[j];
+                                gr[j] = 0.0;
+                        }
+                }
+                clean_matrix_rows(m);
+                return;
         }
+        real *w  = p->weights->data;
+        real *gr = m->data;
+        size_t bs = matrix_block_size(p->weights);
+        for (size_t x = 0; x < bs; x++) {
+                w[x] -= lr * gr[x] + wd * w[x];
+                gr[x] = 0.0;
+        }
+        clean_matrix_rows(m);
+}
 
-        /* add local scale factor to global scale factor */
-        n->pars->sd_scale_factor += sd_scale_factor;
+/*
+ * Completes the gradient linearity of a network from the sums that the
+ * update algorithms accumulate. If either vector has zero length (e.g., as
+ * no weight deltas have been made yet), the linearity is undefined, and
+ * reported as zero.
+ */
+void determine_gradient_linearity(struct network *n)
+{
+        double norm = sqrt(n->status->last_deltas_length
+                * n->status->gradients_length);
+        if (norm > 0.0)
+                n->status->gradient_linearity =
+                        -(n->status->gradient_linearity / norm);
+        else
+                n->status->gradient_linearity = 0.0;
+}
+
+/*
+ * Computes the weight cost of a network:
+ *
+ * wc = sum_i sum_j (w_ij ^ 2)
+ *
+ * which the other update algorithms compute while adjusting weights.
+ */
+void determine_weight_cost(struct network *n)
+{
+        n->status->weight_cost = 0.0;
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *p = g->inc_projs->elements[j];
+                        size_t bs = matrix_block_size(p->weights);
+                        for (size_t x = 0; x < bs; x++)
+                                n->status->weight_cost += p->weights->data[x]
+                                        * p->weights->data[x];
+                }
+        }
 }
 
                 /***********************************
@@ -550,224 +1092,119 @@ void bp_update_rprop(struct network *n)
         n->status->last_deltas_length = 0.0;
         n->status->gradients_length   = 0.0;
 
-        bp_update_inc_projs_rprop(n, n->output);
+        /* adjust the incoming projections of all scheduled groups */
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                bp_update_inc_projs_rprop(n, n->schedule->elements[i]);
 
         /*
-         * Compute gradient linearity:
+         * Compute gradient linearity (if reported):
          *
          *         sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
          * gl = -( ----------------------------------- )
          *         sqrt(sum_i sum_j (Dw_ij(t-1) ^ 2))
          *         * sqrt(sum_i sum_j (dE/dw_ij ^ 2))
          */
-        n->status->gradient_linearity = -(n->status->gradient_linearity
-                / sqrt(n->status->last_deltas_length
-                        * n->status->gradients_length));
+        if (n->status->report)
+                determine_gradient_linearity(n);
 }
 
 /*
- * Recursively adjusts the weights of all incoming projections of a group g.
+ * Adjusts the weights of all incoming projections of a group g.
  */
 void bp_update_inc_projs_rprop(struct network *n, struct group *g)
 {
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *p = g->inc_projs->elements[i];
                 /*
-                 * Adjust weights if projection is not frozen.
+                 * Adjust weights if projection is not frozen, and reset
+                 * the previous weight gradients.
                  */
                 if (!p->flags->frozen)
                         bp_update_projection_rprop(n, g, p);
+                else
+                        zero_out_matrix(p->prev_gradients);
                 
                 /*
-                 * Make a copy of the weight gradients, and reset the
-                 * current weight gradients.
+                 * The current weight gradients become the previous ones,
+                 * and the (reset) previous weight gradients the current
+                 * ones.
                  */
-                copy_matrix(p->gradients, p->prev_gradients);
-                zero_out_matrix(p->gradients);
-
-                /*
-                 * During BPTT, we want to only adjust weights in the
-                 * network of the current timestep.
-                 */
-                if (p->flags->recurrent)
-                        continue;
-
-                bp_update_inc_projs_rprop(n, p->to);
-        }
-}
+                bp_swap_gradients(p);
+        }
+}
 
 /*
  * This adjusts the weights of a projection p between a group g' and g.
+ * Each Rprop flavour has its own kernel, which is selected once per
+ * update. For iRPROP+, weight backtracking depends on whether the
+ * overall error went up, so that it either uses the RPROP+ kernel, or a
+ * kernel that does not change weights whose gradient changed sign.
  */
 void bp_update_projection_rprop(struct network *n, struct group *g,
         struct projection *p)
 {
+        void (*kernel)(struct network *n, struct projection *p, uint32_t i);
+        switch (n->flags->rp_type) {
+        case RPROP_MINUS:
+                kernel = bp_rprop_minus_kernel;
+                break;
+        case IRPROP_PLUS:
+                if (n->status->error > n->status->prev_error)
+                        kernel = bp_rprop_plus_kernel;
+                else
+                        kernel = bp_irprop_plus_kernel;
+                break;
+        case IRPROP_MINUS:
+                kernel = bp_irprop_minus_kernel;
+                break;
+        default:
+                kernel = bp_rprop_plus_kernel;
+                break;
+        }
+
+        /*
+         * All flavours except RPROP- reset gradients that changed sign,
+         * which affects the status statistics.
+         */
+        bool reset = n->flags->rp_type != RPROP_MINUS;
+
+        /*
+         * Adjust only the rows with (previous) gradients, if possible.
+         * Otherwise, bring all rows up to date (see "sparse updates"
+         * above).
+         */
+        if (bp_sparse_update(n, p)) {
+                bp_update_rows_rprop(n, g, p, kernel);
+                return;
+        }
+        bp_catch_up_projection(n, p);
+
         /* local status statistics */
         double weight_cost        = 0.0;
         double gradient_linearity = 0.0;
         double last_deltas_length = 0.0;
         double gradients_length   = 0.0;
+        bool stats = n->status->report;
 
         /*
-         * Adjust the weight between unit i in group g' and unit j in group
-         * g.
+         * Adjust the weights between all units in group g' and group g.
          */
 #ifdef _OPENMP
 #pragma omp parallel for reduction(+:weight_cost, gradient_linearity, last_deltas_length, gradients_length) \
-        if (n->flags->omp_mthreaded)
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)p->to->vector->size * g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < p->to->vector->size; i++) {
-                for (uint32_t j = 0; j < g->vector->size; j++) {
-                        double weight_delta = 0.0;
-
-                        /*
-                         * First, apply weight decay:
-                         *
-                         * Dw_ij = Dw_ij - d * w_ij
-                         */
-                        weight_delta -= n->pars->weight_decay 
-                                * p->weights->elements[i][j];
-
-                        /*
-                         * Sign of dE/dw_ij has not changed:
-                         * 
-                         * dE/dw_ij(t-1) * dE/dw_ij(t) > 0
-                         */
-                        if (p->prev_gradients->elements[i][j]
-                                * p->gradients->elements[i][j] > 0.0) {
-
-                                /*
-                                 * Bind update value u_ij to u_max.
-                                 */
-                                p->dynamic_params->elements[i][j] = minimum(
-                                        p->dynamic_params->elements[i][j]
-                                        * n->pars->rp_eta_plus,
-                                        RP_MAX_STEP_SIZE);
-
-                                /*
-                                 * Perform weight update:
-                                 *
-                                 * Dw_ij = -sign(dE/dw_ij(t)) * u_ij(t)
-                                 *
-                                 * w_ij = w_ij + Dw_ij
-                                 */
-                                weight_delta += -sign(p->gradients->elements[i][j]) 
-                                        * p->dynamic_params->elements[i][j];
-                                p->weights->elements[i][j] += weight_delta;
-
-                        /*
-                         * Sign of dE/dw_ij has changed:
-                         * 
-                         * dE/dw_ij(t-1) * dE/dw_ij(t) < 0
-                         */
-                        } else if (p->prev_gradients->elements[i][j]
-                                * p->gradients->elements[i][j] < 0.0) {
-
-                                /*
-                                 * Bind update value u_ij to u_min.
-                                 */
-                                p->dynamic_params->elements[i][j] = maximum(
-                                        p->dynamic_params->elements[i][j]
-                                        * n->pars->rp_eta_minus,
-                                        RP_MIN_STEP_SIZE);
-
-                                /*
-                                 * Perform weight backtracking for RPROP+.
-                                 */
-                                if (n->flags->rp_type == RPROP_PLUS)
-                                        p->weights->elements[i][j] -=
-                                                p->prev_deltas->elements[i][j];
-
-                                /*
-                                 * Perform weight backtracking for iRPROP+.
-                                 */
-                                if (n->flags->rp_type == IRPROP_PLUS)
-                                        if (n->status->error > n->status->prev_error)
-                                                p->weights->elements[i][j] -=
-                                                        p->prev_deltas->elements[i][j];
-
-                                /*
-                                 * Set dE/dw_ij(t) to 0 for all Rprop
-                                 * flavours except RPROP-.
-                                 */
-                                if (n->flags->rp_type != RPROP_MINUS)
-                                        p->gradients->elements[i][j] = 0.0;
-
-                                /* 
-                                 * Perform weight change for RPROP- and
-                                 * iRPROP-:
-                                 * 
-                                 * Dw_ij = -sign(dE/dw_ij(t)) * u_ij(t)
-                                 *
-                                 * w_ij = w_ij + Dw_ij
-                                 */
-                                if (n->flags->rp_type == RPROP_MINUS || n->flags->rp_type == IRPROP_MINUS) {
-                                        weight_delta += -sign(p->gradients->elements[i][j]) *
-                                                p->dynamic_params->elements[i][j];
-                                        p->weights->elements[i][j] += weight_delta;
-                                }
-
-                        /*
-                         * Otherwise:
-                         *
-                         * dE/dw_ij(t-1) * dE/dw_ij(t) = 0
-                         */
-                        } else if (p->prev_gradients->elements[i][j]
-                                        * p->gradients->elements[i][j] == 0.0) {
-                                /*
-                                 * Perform weight update:
-                                 *
-                                 * Dw_ij = -sign(dE/dw_ij(t)) * u_ij(t)
-                                 *
-                                 * w_ij = w_ij + Dw_ij
-                                 */
-                                weight_delta += -sign(p->gradients->elements[i][j])
-                                        * p->dynamic_params->elements[i][j];
-                                p->weights->elements[i][j] += weight_delta;
-                        }
-
-                        /*
-                         * Compute weight cost:
-                         *
-                         * wc = sum_i sum_j (w_ij ^ 2)
-                         */
-                        weight_cost += pow(p->weights->elements[i][j], 2.0);
-                        
-                        /*
-                         * Compute the numerator of the
-                         * gradient linearity:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
-                         */
-                        gradient_linearity +=
-                                p->prev_deltas->elements[i][j]
-                                * p->gradients->elements[i][j];
-                        
-                        /*
-                         * Compute the sum of squares of the
-                         * previous weight delta vector:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) ^ 2
-                         */
-                        last_deltas_length +=
-                                 pow(p->prev_deltas->elements[i][j], 2.0);
-
-                        /*
-                         * Compute the sum of squares of the
-                         * gradients:
-                         *
-                         * sum_i sum_j (dE/dw_ij ^ 2)
-                         */
-                        gradients_length +=
-                                pow(p->gradients->elements[i][j], 2.0);
-
-                        /* 
-                         * Store a copy of the weight change.
-                         */
-                        p->prev_deltas->elements[i][j] = weight_delta;
-                }
+                if (stats)
+                        bp_delta_statistics(p, i, reset, &gradient_linearity,
+                                &last_deltas_length, &gradients_length);
+                kernel(n, p, i);
+                if (stats)
+                        weight_cost += bp_weight_cost(p, i);
         }
-        
+        clean_matrix_rows(p->prev_gradients);
+        bp_count_update(p);
+
         /*
          * Add the local status statistics to the global status statistics.
          */
@@ -777,6 +1214,192 @@ void bp_update_projection_rprop(struct network *n, struct group *g,
         n->status->gradients_length   += gradients_length;
 }
 
+/*
+ * This adjusts only the rows of a projection p between a group g' and g
+ * that have either current or previous gradients (see "sparse updates"
+ * above), using the kernel of the selected Rprop flavour.
+ */
+void bp_update_rows_rprop(struct network *n, struct group *g,
+        struct projection *p,
+        void (*kernel)(struct network *n, struct projection *p, uint32_t i))
+{
+        struct matrix *gr = p->gradients;
+        struct matrix *pg = p->prev_gradients;
+        uint32_t num_rows = gr->num_dirty + pg->num_dirty;
+#ifdef _OPENMP
+#pragma omp parallel for \
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)num_rows * g->vector->size >= n->pars->omp_unit_cutoff)
+#endif /* _OPENMP */
+        for (uint32_t x = 0; x < num_rows; x++) {
+                uint32_t i = x < gr->num_dirty ? gr->dirty_rows[x]
+                        : pg->dirty_rows[x - gr->num_dirty];
+                /* rows with current gradients are visited only once */
+                if (x >= gr->num_dirty && gr->dirty[i])
+                        continue;
+                bp_catch_up_row(n, p, i);
+                kernel(n, p, i);
+                p->row_updates[i] = p->num_updates + 1;
+        }
+        p->num_updates++;
+        clean_matrix_rows(pg);
+}
+
+/*
+ * The Rprop kernels below adjust the weights between unit i in group g'
+ * and all units in group g. They are written without branches, so that
+ * the compiler can vectorize them. For each weight w_ij, the update value
+ * u_ij is first adjusted according to whether the sign of the gradient
+ * has changed:
+ *
+ *                | min(u_ij(t-1) * eta_plus, u_max) , if prod > 0
+ *                |
+ *      u_ij(t) = | max(u_ij(t-1) * eta_minus, u_min), if prod < 0
+ *                |
+ *                | u_ij(t-1)                        , otherwise
+ *
+ * where prod = dE/dw_ij(t-1) * dE/dw_ij(t). Next, the weight delta is:
+ *
+ *      Dw_ij = -d * w_ij - sign(dE/dw_ij(t)) * u_ij(t)
+ *
+ * where d is the weight decay. The previous weight gradient is reset, as
+ * it becomes the current gradient after the update (see
+ * bp_swap_gradients()).
+ */
+
+/*
+ * RPROP+: If the sign of the gradient has changed, dE/dw_ij(t) is reset
+ * to 0, and the previous weight change is reverted:
+ *
+ *      w_ij = w_ij - Dw_ij(t-1)
+ */
+void bp_rprop_plus_kernel(struct network *n, struct projection *p,
+        uint32_t i)
+{
+        double wd = n->pars->weight_decay;
+        double eta_plus = n->pars->rp_eta_plus;
+        double eta_minus = n->pars->rp_eta_minus;
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        real *u  = matrix_row(p->dynamic_params, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], prod = pg[j] * grad;
+                double up = u[j] * eta_plus, down = u[j] * eta_minus;
+                up = up <= RP_MAX_STEP_SIZE ? up : RP_MAX_STEP_SIZE;
+                down = down >= RP_MIN_STEP_SIZE ? down : RP_MIN_STEP_SIZE;
+                double step = prod > 0.0 ? up
+                        : (prod < 0.0 ? down : u[j]);
+                grad = prod < 0.0 ? 0.0 : grad;
+                double sgn = (double)(grad > 0.0) - (double)(grad < 0.0);
+                double weight_delta = -wd * w[j] - sgn * step;
+                w[j] += prod < 0.0 ? -pd[j] : weight_delta;
+                gr[j] = grad;
+                u[j]  = step;
+                pd[j] = weight_delta;
+                pg[j] = 0.0;
+        }
+}
+
+/*
+ * RPROP-: Weights are adjusted regardless of whether the sign of the
+ * gradient has changed, and dE/dw_ij(t) is never reset.
+ */
+void bp_rprop_minus_kernel(struct network *n, struct projection *p,
+        uint32_t i)
+{
+        double wd = n->pars->weight_decay;
+        double eta_plus = n->pars->rp_eta_plus;
+        double eta_minus = n->pars->rp_eta_minus;
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        real *u  = matrix_row(p->dynamic_params, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], prod = pg[j] * grad;
+                double up = u[j] * eta_plus, down = u[j] * eta_minus;
+                up = up <= RP_MAX_STEP_SIZE ? up : RP_MAX_STEP_SIZE;
+                down = down >= RP_MIN_STEP_SIZE ? down : RP_MIN_STEP_SIZE;
+                double step = prod > 0.0 ? up
+                        : (prod < 0.0 ? down : u[j]);
+                double sgn = (double)(grad > 0.0) - (double)(grad < 0.0);
+                double weight_delta = -wd * w[j] - sgn * step;
+                w[j] += weight_delta;
+                u[j]  = step;
+                pd[j] = weight_delta;
+                pg[j] = 0.0;
+        }
+}
+
+/*
+ * iRPROP+ (if the overall error did not go up): If the sign of the
+ * gradient has changed, dE/dw_ij(t) is reset to 0, and the weight is left
+ * unchanged. Otherwise, iRPROP+ uses the RPROP+ kernel.
+ */
+void bp_irprop_plus_kernel(struct network *n, struct projection *p,
+        uint32_t i)
+{
+        double wd = n->pars->weight_decay;
+        double eta_plus = n->pars->rp_eta_plus;
+        double eta_minus = n->pars->rp_eta_minus;
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        real *u  = matrix_row(p->dynamic_params, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], prod = pg[j] * grad;
+                double up = u[j] * eta_plus, down = u[j] * eta_minus;
+                up = up <= RP_MAX_STEP_SIZE ? up : RP_MAX_STEP_SIZE;
+                down = down >= RP_MIN_STEP_SIZE ? down : RP_MIN_STEP_SIZE;
+                double step = prod > 0.0 ? up
+                        : (prod < 0.0 ? down : u[j]);
+                grad = prod < 0.0 ? 0.0 : grad;
+                double sgn = (double)(grad > 0.0) - (double)(grad < 0.0);
+                double weight_delta = -wd * w[j] - sgn * step;
+                w[j] += prod < 0.0 ? 0.0 : weight_delta;
+                gr[j] = grad;
+                u[j]  = step;
+                pd[j] = weight_delta;
+                pg[j] = 0.0;
+        }
+}
+
+/*
+ * iRPROP-: If the sign of the gradient has changed, dE/dw_ij(t) is reset
+ * to 0, so that only weight decay is applied.
+ */
+void bp_irprop_minus_kernel(struct network *n, struct projection *p,
+        uint32_t i)
+{
+        double wd = n->pars->weight_decay;
+        double eta_plus = n->pars->rp_eta_plus;
+        double eta_minus = n->pars->rp_eta_minus;
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        real *u  = matrix_row(p->dynamic_params, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], prod = pg[j] * grad;
+                double up = u[j] * eta_plus, down = u[j] * eta_minus;
+                up = up <= RP_MAX_STEP_SIZE ? up : RP_MAX_STEP_SIZE;
+                down = down >= RP_MIN_STEP_SIZE ? down : RP_MIN_STEP_SIZE;
+                double step = prod > 0.0 ? up
+                        : (prod < 0.0 ? down : u[j]);
+                grad = prod < 0.0 ? 0.0 : grad;
+                double sgn = (double)(grad > 0.0) - (double)(grad < 0.0);
+                double weight_delta = -wd * w[j] - sgn * step;
+                w[j] += weight_delta;
+                gr[j] = grad;
+                u[j]  = step;
+                pd[j] = weight_delta;
+                pg[j] = 0.0;
+        }
+}
+
                 /***********************************
                  **** quickprop backpropagation ****
                  ***********************************/
@@ -824,49 +1447,44 @@ void bp_update_qprop(struct network *n)
         n->status->last_deltas_length = 0.0;
         n->status->gradients_length   = 0.0;
 
-        bp_update_inc_projs_qprop(n, n->output);
+        /* adjust the incoming projections of all scheduled groups */
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                bp_update_inc_projs_qprop(n, n->schedule->elements[i]);
 
         /*
-         * Compute gradient linearity:
+         * Compute gradient linearity (if reported):
          *
          *         sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
          * gl = -( ----------------------------------- )
          *         sqrt(sum_i sum_j (Dw_ij(t-1) ^ 2))
          *         * sqrt(sum_i sum_j (dE/dw_ij ^ 2))
          */
-        n->status->gradient_linearity = -(n->status->gradient_linearity
-                / sqrt(n->status->last_deltas_length
-                        * n->status->gradients_length));
+        if (n->status->report)
+                determine_gradient_linearity(n);
 }
 
 /*
- * Recursively adjusts the weights of all incoming projections of a group g.
+ * Adjusts the weights of all incoming projections of a group g.
  */
 void bp_update_inc_projs_qprop(struct network *n, struct group *g)
 {
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *p = g->inc_projs->elements[i];
                 /*
-                 * Adjust weights if projection is not frozen.
+                 * Adjust weights if projection is not frozen, and reset
+                 * the previous weight gradients.
                  */
                 if (!p->flags->frozen)
                         bp_update_projection_qprop(n, g, p);
+                else
+                        zero_out_matrix(p->prev_gradients);
                 
                 /*
-                 * Make a copy of the weight gradients, and reset the
-                 * current weight gradients.
+                 * The current weight gradients become the previous ones,
+                 * and the (reset) previous weight gradients the current
+                 * ones.
                  */
-                copy_matrix(p->gradients, p->prev_gradients);
-                zero_out_matrix(p->gradients);
-
-                /*
-                 * During BPTT, we want to only adjust weights in the
-                 * network of the current timestep.
-                 */
-                if (p->flags->recurrent)
-                        continue;
-
-                bp_update_inc_projs_qprop(n, p->to);
+                bp_swap_gradients(p);
         }
 }
 
@@ -876,191 +1494,30 @@ void bp_update_inc_projs_qprop(struct network *n, struct group *g)
 void bp_update_projection_qprop(struct network *n, struct group *g,
         struct projection *p)
 {
-        double shrink_factor = QP_MAX_STEP_SIZE / (1.0 + QP_MAX_STEP_SIZE);
-
         /* local status statistics */
         double weight_cost        = 0.0;
         double gradient_linearity = 0.0;
         double last_deltas_length = 0.0;
         double gradients_length   = 0.0;
+        bool stats = n->status->report;
 
         /*
-         * Adjust the weight between unit i in group g' and unit j in group
-         * g.
+         * Adjust the weights between all units in group g' and group g.
          */
 #ifdef _OPENMP
 #pragma omp parallel for reduction(+:weight_cost, gradient_linearity, last_deltas_length, gradients_length) \
-        if (n->flags->omp_mthreaded)
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)p->to->vector->size * g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < p->to->vector->size; i++) {
-                for (uint32_t j = 0; j < g->vector->size; j++) {
-                        double weight_delta = 0.0;
-                        
-                        /*
-                         * Previous weight delta was positive:
-                         *
-                         * Dw_ij(t-1) > 0
-                         */
-                        if (p->prev_deltas->elements[i][j] > 0.0) {
-                                /*
-                                 * If current gradient is negative, include
-                                 * a steepest descent term in the weight
-                                 * delta:
-                                 *
-                                 * Dw_ij(t) = -epislon * dE/dw_ij
-                                 */ 
-                                if (p->gradients->elements[i][j] < 0.0)
-                                        weight_delta += -n->pars->learning_rate
-                                                * p->gradients->elements[i][j];
-                                
-                                /*
-                                 * If current gradient is smaller than the
-                                 * max step size times the previous
-                                 * gradient, take a step of the maximum size
-                                 * times the previous weight delta:
-                                 *
-                                 * Dw_ij(t) = Dw_ij(t) + u * Dw(t-1)
-                                 */
-                                if (p->gradients->elements[i][j] <
-                                        shrink_factor * p->prev_gradients->elements[i][j]) {
-                                        weight_delta += QP_MAX_STEP_SIZE
-                                                * p->prev_deltas->elements[i][j];
-                                /*
-                                 * Otherwise, use the quadratic estimate:
-                                 *
-                                 * Dw_ij(t) = Dw_ij(t) + dE/dw_ij(t)
-                                 *     / (dE/dw_ij(t-1) - dE/dw_ij(t)
-                                 *     * Dw_ij(t-1)
-                                 */
-                                } else {
-                                        weight_delta += p->gradients->elements[i][j]
-                                                / (p->prev_gradients->elements[i][j] 
-                                                        - p->gradients->elements[i][j])
-                                                * p->prev_deltas->elements[i][j];
-                                }
-                        
-                        /*
-                         * Previous weight delta was negative:
-                         *
-                         * Dw_ij(t-1) < 0
-                         */
-                        } else if (p->prev_deltas->elements[i][j] < 0.0) {
-                                /*
-                                 * If current gradient is positive, include
-                                 * a steepest descent term in the weight
-                                 * delta:
-                                 *
-                                 * Dw_ij(t) = -epislon * dE/dw_ij
-                                 */
-                                if (p->gradients->elements[i][j] > 0.0)
-                                        weight_delta += -n->pars->learning_rate
-                                                * p->gradients->elements[i][j];
-
-                                /*
-                                 * If current gradient is larger than the
-                                 * max step size times the previous
-                                 * gradient, take a step of the maximum size
-                                 * times the previous weight delta:
-                                 *
-                                 * Dw_ij(t) = Dw_ij(t) + u * Dw(t-1)
-                                 */
-                                if (p->gradients->elements[i][j] >
-                                        shrink_factor * p->prev_gradients->elements[i][j]) {
-                                        weight_delta += QP_MAX_STEP_SIZE
-                                                * p->prev_deltas->elements[i][j];
-                                /*
-                                 * Otherwise, use the quadratic estimate:
-                                 *
-                                 * Dw_ij(t) = Dw_ij(t) + dE/dw_ij(t)
-                                 *     / (dE/dw_ij(t-1) - dE/dw_ij(t)
-                                 *     * @Dw_ij(t-1)
-                                 */
-                                } else {
-                                        weight_delta += p->gradients->elements[i][j]
-                                                / (p->prev_gradients->elements[i][j] 
-                                                        - p->gradients->elements[i][j])
-                                                * p->prev_deltas->elements[i][j];
-                                }
-
-                        /*
-                         * Previous weight delta was zero:
-                         *
-                         * DW_ij(t-1) = 0
-                         */
-                        } else {
-                                /*
-                                 * Use steepest descent.
-                                 *
-                                 * First, we apply learning:
-                                 *
-                                 * Dw_ij = -epislon * dE/dw_ij
-                                 */
-                                weight_delta += -n->pars->learning_rate
-                                        * p->gradients->elements[i][j];
-
-                                /*
-                                 * Next, we apply momentum:
-                                 *
-                                 * Dw_ij = Dw_ij + a * Dw_ij(t-1)
-                                 */
-                                weight_delta += n->pars->momentum
-                                        * p->prev_deltas->elements[i][j];
-                        }
-
-                        /*
-                         * Apply weight decay:
-                         *
-                         * Dw_ij = Dw_ij - d * w_ij
-                         */
-                        weight_delta -= n->pars->weight_decay 
-                                * p->weights->elements[i][j];
-
-                        /*
-                         * Adjust the weight:
-                         *
-                         * w_ij = w_ij + Dw_ij
-                         */
-                        p->weights->elements[i][j] += weight_delta;
-
-                        /*
-                         * Compute weight cost:
-                         *
-                         * wc = sum_i sum_j (w_ij ^ 2)
-                         */
-                        weight_cost += pow(p->weights->elements[i][j], 2.0);
-                        
-                        /*
-                         * Compute the numerator of the gradient linearity:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
-                         */
-                        gradient_linearity +=
-                                p->prev_deltas->elements[i][j]
-                                * p->gradients->elements[i][j];
-                        
-                        /*
-                         * Compute the sum of squares of the previous weight
-                         * delta vector:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) ^ 2
-                         */
-                        last_deltas_length +=
-                                 pow(p->prev_deltas->elements[i][j], 2.0);
-
-                        /*
-                         * Compute the sum of squares of the gradients:
-                         *
-                         * sum_i sum_j (dE/dw_ij ^ 2)
-                         */
-                        gradients_length +=
-                                pow(p->gradients->elements[i][j], 2.0);
-
-                        /* 
-                         * Store a copy of the weight change.
-                         */
-                        p->prev_deltas->elements[i][j] = weight_delta;
-                }
+                if (stats)
+                        bp_delta_statistics(p, i, false, &gradient_linearity,
+                                &last_deltas_length, &gradients_length);
+                bp_qprop_kernel(n, p, i);
+                if (stats)
+                        weight_cost += bp_weight_cost(p, i);
         }
+        clean_matrix_rows(p->prev_gradients);
 
         /*
          * Add the local status statistics to the global status statistics.
@@ -1071,6 +1528,65 @@ void bp_update_projection_qprop(struct network *n, struct group *g,
         n->status->gradients_length   += gradients_length;
 }
 
+/*
+ * This adjusts the weights between unit i in group g' and all units in
+ * group g. It is written without branches, so that the compiler can
+ * vectorize it. If the previous weight delta was positive (negative), a
+ * steepest descent term is included if the current gradient is negative
+ * (positive):
+ *
+ *      Dw_ij(t) = -epsilon * dE/dw_ij
+ *
+ * and a step of the maximum size times the previous weight delta is taken
+ * if the current gradient is smaller (larger) than the shrink factor times
+ * the previous gradient:
+ *
+ *      Dw_ij(t) = Dw_ij(t) + u * Dw_ij(t-1)
+ *
+ * while the quadratic estimate is used otherwise:
+ *
+ *      Dw_ij(t) = Dw_ij(t) + dE/dw_ij(t) / (dE/dw_ij(t-1) - dE/dw_ij(t))
+ *          * Dw_ij(t-1)
+ *
+ * If the previous weight delta was zero, steepest descent with momentum
+ * is used instead:
+ *
+ *      Dw_ij(t) = -epsilon * dE/dw_ij + a * Dw_ij(t-1)
+ *
+ * Finally, weight decay is applied in all cases:
+ *
+ *      Dw_ij(t) = Dw_ij(t) - d * w_ij
+ *
+ * The previous weight gradient is reset, as it becomes the current
+ * gradient after the update (see bp_swap_gradients()).
+ */
+void bp_qprop_kernel(struct network *n, struct projection *p, uint32_t i)
+{
+        double lr = n->pars->learning_rate;
+        double mn = n->pars->momentum;
+        double wd = n->pars->weight_decay;
+        double shrink_factor = QP_MAX_STEP_SIZE / (1.0 + QP_MAX_STEP_SIZE);
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], prev_grad = pg[j], prev_delta = pd[j];
+                bool pos = prev_delta > 0.0, neg = prev_delta < 0.0;
+                bool descend = pos ? grad < 0.0 : (neg ? grad > 0.0 : true);
+                double weight_delta = descend ? -lr * grad : 0.0;
+                bool max_step = pos ? grad < shrink_factor * prev_grad
+                        : grad > shrink_factor * prev_grad;
+                double step = max_step ? QP_MAX_STEP_SIZE * prev_delta
+                        : grad / (prev_grad - grad) * prev_delta;
+                weight_delta += pos || neg ? step : mn * prev_delta;
+                weight_delta -= wd * w[j];
+                w[j] += weight_delta;
+                pd[j] = weight_delta;
+                pg[j] = 0.0;
+        }
+}
+
                 /*****************************************
                  **** delta-bar-delta backpropagation ****
                  *****************************************/
@@ -1119,23 +1635,24 @@ void bp_update_dbd(struct network *n)
         n->dbd_rate_decrement = 0.9;
         */
 
-        bp_update_inc_projs_dbd(n, n->output);
+        /* adjust the incoming projections of all scheduled groups */
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++)
+                bp_update_inc_projs_dbd(n, n->schedule->elements[i]);
 
         /*
-         * Compute gradient linearity:
+         * Compute gradient linearity (if reported):
          *
          *         sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
          * gl = -( ----------------------------------- )
          *         sqrt(sum_i sum_j (Dw_ij(t-1) ^ 2))
          *         * sqrt(sum_i sum_j (dE/dw_ij ^ 2))
          */
-        n->status->gradient_linearity = -(n->status->gradient_linearity
-                / sqrt(n->status->last_deltas_length
-                        * n->status->gradients_length));
+        if (n->status->report)
+                determine_gradient_linearity(n);
 }
 
 /*
- * Recursively adjusts the weights and their learning rates of all incoming
+ * Adjusts the weights and their learning rates of all incoming
  * projections of a group g.
  */
 void bp_update_inc_projs_dbd(struct network *n, struct group *g)
@@ -1143,24 +1660,13 @@ void bp_update_inc_projs_dbd(struct network *n, struct group *g)
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *p = g->inc_projs->elements[i];
                 /*
-                 * Adjust weights if projection is not frozen.
+                 * Adjust weights if projection is not frozen, and reset
+                 * the current weight gradients.
                  */
                 if (!p->flags->frozen)
                         bp_update_projection_dbd(n, g, p);
-                
-                /*
-                 * Reset the current weight gradients.
-                 */
-                zero_out_matrix(p->gradients);
-
-                /*
-                 * During BPTT, we want to only adjust weights in the
-                 * network of the current timestep.
-                 */
-                if (p->flags->recurrent)
-                        continue;
-
-                bp_update_inc_projs_dbd(n, p->to);
+                else
+                        zero_out_matrix(p->gradients);
         }
 }
 
@@ -1176,155 +1682,26 @@ void bp_update_projection_dbd(struct network *n, struct group *g,
         double gradient_linearity = 0.0;
         double last_deltas_length = 0.0;
         double gradients_length   = 0.0;
+        bool stats = n->status->report;
 
         /*
-         * Adjust the weight and its learning rate between unit i in group
-         * g' and unit j in group g.
+         * Adjust the weights and their learning rates between all units
+         * in group g' and group g.
          */
 #ifdef _OPENMP
 #pragma omp parallel for reduction(+:weight_cost, gradient_linearity, last_deltas_length, gradients_length) \
-        if (n->flags->omp_mthreaded)
+        if (n->flags->omp_mthreaded \
+                && (uint64_t)p->to->vector->size * g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < p->to->vector->size; i++) {
-                for (uint32_t j = 0; j < g->vector->size; j++) {
-
-                        /***********************
-                         **** update weight ****
-                         ***********************/
-
-                        double weight_delta = 0.0;
-
-                        /*
-                         * First, we apply learning:
-                         *
-                         * Dw_ij = -esilon * dE/dw_ij
-                         */
-                        weight_delta += -p->dynamic_params->elements[i][j]
-                                * p->gradients->elements[i][j];
-
-                        /*
-                         * Next, we apply momentum:
-                         *
-                         * Dw_ij = Dw_ij + a * Dw_ij(t-1)
-                         */
-                        weight_delta += n->pars->momentum
-                                * p->prev_deltas->elements[i][j];
-                        
-                        /*
-                         * Finally, we apply weight decay:
-                         *
-                         * Dw_ij = Dw_ij - d * w_ij
-                         */
-                        weight_delta -= n->pars->weight_decay 
-                                * p->weights->elements[i][j];
-
-                        /*
-                         * Adjust the weight:
-                         *
-                         * w_ij = w_ij + Dw_ij
-                         */
-                        p->weights->elements[i][j] += weight_delta;
-                        
-                        /*
-                         * Compute weight cost:
-                         *
-                         * wc = sum_i sum_j (w_ij ^ 2)
-                         */
-                        weight_cost += pow(p->weights->elements[i][j], 2.0);
-                        
-                        /*
-                         * Compute the numerator of the gradient linearity:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) * dE/dw_ij)
-                         */
-                        gradient_linearity +=
-                                p->prev_deltas->elements[i][j]
-                                * p->gradients->elements[i][j];
-                        
-                        /*
-                         * Compute the sum of squares of the previous weight
-                         * delta vector:
-                         *
-                         * sum_i sum_j (Dw_ij(t-1) ^ 2
-                         */
-                        last_deltas_length +=
-                                 pow(p->prev_deltas->elements[i][j], 2.0);
-
-                        /*
-                         * Compute the sum of squares of the gradients:
-                         *
-                         * sum_i sum_j (dE/dw_ij ^ 2)
-                         */
-                        gradients_length +=
-                                pow(p->gradients->elements[i][j], 2.0);
-
-                        /* 
-                         * Store a copy of the weight change.
-                         */
-                        p->prev_deltas->elements[i][j] = weight_delta;
-
-                        /******************************
-                         **** update learning rate ****
-                         ******************************/
-
-                        double lr_delta = 0.0;
-
-                        /*
-                         * Current gradient and average of past gradients
-                         * have same sign:
-                         *
-                         * dE/dw_ij_bar(t-1) * dE/dw_ij(t) > 0
-                         *
-                         * Note: dE/dw_ij_bar(t-1) is stored in the
-                         * prev_gradients matrix of the projection.
-                         */
-                        if (p->prev_gradients->elements[i][j]
-                                * p->gradients->elements[i][j] > 0.0) {
-                                /*
-                                 * De_ij = kappa
-                                 */
-                                lr_delta = n->pars->dbd_rate_increment;
-
-                        /*
-                         * Current gradient and average of past gradients
-                         * have opposite sign:
-                         *
-                         * dE/dw_ij_bar(t-1) * dE/dw_ij(t) < 0
-                         */
-                        } else if (p->prev_gradients->elements[i][j]
-                                * p->gradients->elements[i][j] < 0.0) {
-                                /*
-                                 * De_ij = -phi * e_ij(t)
-                                 */
-                                lr_delta = -n->pars->dbd_rate_decrement
-                                        * p->dynamic_params->elements[i][j];
-                        }
-
-                        /*
-                         * Adjust the learning rate:
-                         *
-                         * e_ij = e_ij + De_ij
-                         */
-                        p->dynamic_params->elements[i][j] += lr_delta;
-
-                        /*
-                         * Determine the exponential average of the current
-                         * and past gradients:
-                         * 
-                         * dE/dw_ij_bar(t) = (1 - theta) * dE/dw_ij + theta
-                         *     * dE/dw_ij_bar(t-1)
-                         */
-                        double exp_average = (1.0 - DBD_BASE)
-                                * p->gradients->elements[i][j]
-                                + DBD_BASE * p->prev_gradients->elements[i][i];
-
-                        /*
-                         * Store a copy of the current exponential
-                         * average.
-                         */
-                        p->prev_gradients->elements[i][j] = exp_average;
-                }
+                if (stats)
+                        bp_delta_statistics(p, i, false, &gradient_linearity,
+                                &last_deltas_length, &gradients_length);
+                bp_dbd_kernel(n, p, i);
+                if (stats)
+                        weight_cost += bp_weight_cost(p, i);
         }
+        clean_matrix_rows(p->gradients);
 
         /*
          * Add the local status statistics to the global status statistics.
@@ -1334,3 +1711,45 @@ void bp_update_projection_dbd(struct network *n, struct group *g,
         n->status->last_deltas_length += last_deltas_length;
         n->status->gradients_length   += gradients_length;
 }
+
+/*
+ * This adjusts the weights and their learning rates between unit i in
+ * group g' and all units in group g. It is written without branches, so
+ * that the compiler can vectorize it. The weight delta is that of steepest
+ * descent, with a learning rate e_ij per weight:
+ *
+ *      Dw_ij = -e_ij * dE/dw_ij + a * Dw_ij(t-1) - d * w_ij
+ *
+ * after which the learning rate is adjusted (e_ij = e_ij + De_ij; see
+ * above), and the exponential average of the current and past gradients
+ * is determined:
+ *
+ *      dE/dw_ij_bar(t) = (1 - theta) * dE/dw_ij + theta * dE/dw_ij_bar(t-1)
+ *
+ * Note: dE/dw_ij_bar(t-1) is stored in the prev_gradients matrix of the
+ * projection. The current gradient is reset.
+ */
+void bp_dbd_kernel(struct network *n, struct projection *p, uint32_t i)
+{
+        double mn = n->pars->momentum;
+        double wd = n->pars->weight_decay;
+        double kappa = n->pars->dbd_rate_increment;
+        double phi = n->pars->dbd_rate_decrement;
+        real *w  = matrix_row(p->weights, i);
+        real *gr = matrix_row(p->gradients, i);
+        real *pg = matrix_row(p->prev_gradients, i);
+        real *pd = matrix_row(p->prev_deltas, i);
+        real *e  = matrix_row(p->dynamic_params, i);
+        for (uint32_t j = 0; j < p->weights->cols; j++) {
+                double grad = gr[j], avg_grad = pg[j], rate = e[j];
+                double weight_delta = -rate * grad + mn * pd[j] - wd * w[j];
+                w[j] += weight_delta;
+                pd[j] = weight_delta;
+                double prod = avg_grad * grad;
+                double rate_delta = prod > 0.0 ? kappa
+                        : (prod < 0.0 ? -phi * rate : 0.0);
+                e[j]  = rate + rate_delta;
+                pg[j] = (1.0 - DBD_BASE) * grad + DBD_BASE * avg_grad;
+                gr[j] = 0.0;
+        }
+}
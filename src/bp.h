@@ -30,33 +30,78 @@
 /* backpropagation */
 void bp_output_error(struct network *n, struct group *g, struct vector *t);
 void bp_backpropagate_error(struct network *n, struct group *g);
+bool bp_backpropagate_in_parallel(struct network *n, struct group *g,
+        struct projection *p);
+void bp_backpropagate_group(struct network *n, struct group *g);
+bool bp_sparse_gradients(struct projection *p);
+void bp_backpropagate_sparse(struct network *n, struct group *g,
+        struct projection *p);
+void bp_error_signal(struct network *n, struct group *g);
+void bp_swap_gradients(struct projection *p);
+void bp_delta_statistics(struct projection *p, uint32_t i, bool reset,
+        double *gradient_linearity, double *last_deltas_length,
+        double *gradients_length);
+double bp_weight_cost(struct projection *p, uint32_t i);
+
+/* sparse updates */
+bool bp_sparse_update(struct network *n, struct projection *p);
+void bp_catch_up_row(struct network *n, struct projection *p, uint32_t i);
+void bp_catch_up_projection(struct network *n, struct projection *p);
+void bp_catch_up_network(struct network *n);
+void bp_catch_up_items(struct network *n, struct item **items,
+        uint32_t num_items);
+bool bp_catch_up_sparse_items(struct network *n, struct projection *p,
+        struct item **items, uint32_t num_items);
+void bp_count_update(struct projection *p);
 
 /* steepest descent */
 void bp_update_sd(struct network *n);
 void bp_update_inc_projs_sd(struct network *n, struct group *g);
+void bp_reset_gradients_sd(struct network *n);
 void bp_update_projection_sd(struct network *n, struct group *g,
         struct projection *p);
+void bp_update_rows_sd(struct network *n, struct group *g,
+        struct projection *p);
 
 /* bounded steepest descent */                
 void determine_sd_scale_factor(struct network *n);
 void determine_gradient_ssq(struct network *n, struct group *g);
 
+/* asynchronous steepest descent */
+void bp_update_hogwild(struct network *n);
+void bp_update_projection_hogwild(struct network *n, struct projection *p);
+void determine_gradient_linearity(struct network *n);
+void determine_weight_cost(struct network *n);
+
 /* resilient backpropagation */
 void bp_update_rprop(struct network *n);
 void bp_update_inc_projs_rprop(struct network *n, struct group *g);
 void bp_update_projection_rprop(struct network *n, struct group *g,
         struct projection *p);
+void bp_update_rows_rprop(struct network *n, struct group *g,
+        struct projection *p,
+        void (*kernel)(struct network *n, struct projection *p, uint32_t i));
+void bp_rprop_plus_kernel(struct network *n, struct projection *p,
+        uint32_t i);
+void bp_rprop_minus_kernel(struct network *n, struct projection *p,
+        uint32_t i);
+void bp_irprop_plus_kernel(struct network *n, struct projection *p,
+        uint32_t i);
+void bp_irprop_minus_kernel(struct network *n, struct projection *p,
+        uint32_t i);
 
 /* quickprop backpropagation */
 void bp_update_qprop(struct network *n);
 void bp_update_inc_projs_qprop(struct network *n, struct group *g);
 void bp_update_projection_qprop(struct network *n, struct group *g,
         struct projection *p);
+void bp_qprop_kernel(struct network *n, struct projection *p, uint32_t i);
 
 /* delta-bar-delta backpropagation */
 void bp_update_dbd(struct network *n);
 void bp_update_inc_projs_dbd(struct network *n, struct group *g);
 void bp_update_projection_dbd(struct network *n, struct group *g,
         struct projection *p);
+void bp_dbd_kernel(struct network *n, struct projection *p, uint32_t i);
 
 #endif /* BP_H */
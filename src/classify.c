@@ -18,9 +18,11 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "classify.h"
 #include "engine.h"
+#include "evaluate.h"
 #include "main.h"
 
 static bool keep_running = true;
@@ -51,38 +53,61 @@ struct matrix *confusion_matrix(struct network *n)
 
         keep_running = true;
 
-        uint32_t d = n->output->vector->size;
+        /*
+         * Determine the actual and predicted class of each item, and
+         * count these in item order (see evaluate.c).
+         */
+        uint32_t d  = n->output->vector->size;
+        uint32_t ni = n->asp->items->num_elements;
         struct matrix *cm = create_matrix(d, d);
-        for (uint32_t i = 0; i < n->asp->items->num_elements; i++) {
-                if (!keep_running) {
-                        keep_running = true;
-                        goto out;
-                }
-                struct item *item = n->asp->items->elements[i];
-                reset_ticks(n);
-                for (uint32_t j = 0; j < item->num_events; j++) {
-                        if (j > 0)
-                                next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
-                        forward_sweep(n);
-                        if (!(item->targets[j] && j == item->num_events - 1))
-                                continue;
-                        struct vector *ov = output_vector(n);
-                        struct vector *tv = item->targets[j];
-                        uint32_t t = 0, o = 0;
-                        for (uint32_t x = 0; x < ov->size; x++) {
-                                if (tv->elements[x] > tv->elements[t]) t = x;
-                                if (ov->elements[x] > ov->elements[o]) o = x;
-                        }
-                        cm->elements[t][o]++;
-                }
-        }
+        int32_t *classes;
+        if (!(classes = malloc(2 * ni * sizeof(int32_t))))
+                goto error_out;
+        for (uint32_t i = 0; i < 2 * ni; i++)
+                classes[i] = -1;
+        struct evaluator *e;
+        if (!(e = create_evaluator(n)))
+                goto out;
+        if (!evaluate_items(e, 0, ni, classify_item_event, classes,
+                &keep_running))
+                keep_running = true;
+        free_evaluator(e);
+        for (uint32_t i = 0; i < ni; i++)
+                if (classes[2 * i] >= 0)
+                        cm->elements[classes[2 * i]][classes[2 * i + 1]]++;
 
 out:
+        free(classes);
+
         sa.sa_handler = SIG_DFL;
         sigaction(SIGINT, &sa, NULL);
 
         return cm;        
+
+error_out:
+        perror("[confusion_matrix()]");
+        goto out;
+}
+
+/*
+ * Stores the actual (target) and predicted (output) class of an item, at
+ * positions 2i and 2i + 1, respectively.
+ */
+void classify_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data)
+{
+        int32_t *classes = data;
+        if (!(item->targets[j] && j == item->num_events - 1))
+                return;
+        struct vector *ov = output_vector(n);
+        struct vector *tv = item->targets[j];
+        uint32_t t = 0, o = 0;
+        for (uint32_t x = 0; x < ov->size; x++) {
+                if (tv->elements[x] > tv->elements[t]) t = x;
+                if (ov->elements[x] > ov->elements[o]) o = x;
+        }
+        classes[2 * i]     = t;
+        classes[2 * i + 1] = o;
 }
 
 void print_cm_summary(struct network *n, bool print_cm, bool pprint,
@@ -22,8 +22,11 @@
 #include "matrix.h"
 #include "network.h"
 #include "pprint.h"
+#include "set.h"
 
 struct matrix *confusion_matrix(struct network *n);
+void classify_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data);
 void print_cm_summary(struct network *n, bool print_cm, bool pprint,
         enum color_scheme scheme);
 void classify_signal_handler(int32_t signal);
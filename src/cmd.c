@@ -33,9 +33,11 @@
 #include "pprint.h"
 #include "random.h"
 #include "record.h"
+#include "rnn_unfold.h"
 #include "set.h"
 #include "stats.h"
 #include "similarity.h"
+#include "stream.h"
 #include "test.h"
 #include "train.h"
 #include "modules/dss.h"
@@ -73,6 +75,7 @@ void process_command(char *cmd, struct session *s)
         bool req_anp  = false; /* require active network */
         bool req_init = false; /* require intialized network */
         bool req_asp  = false; /* require active set */
+        bool req_rsp  = false; /* require resident (non-streamed) set */
         for (uint32_t i = 0; cmds[i].cmd_base != NULL; i++) {
                 /* 
                  * Skip commands that require an active network if
@@ -103,20 +106,37 @@ void process_command(char *cmd, struct session *s)
                                 eprintf("No active set - see `help sets`\n");
                                 goto out;
                         }
-                        struct item *item = s->anp->asp->items->elements[0];
-                        if (s->anp->input->vector->size != item->inputs[0]->size) {
+                        uint32_t input_dims, output_dims;
+                        if (s->anp->asp->stream) {
+                                input_dims  = s->anp->asp->stream->header.input_dims;
+                                output_dims = s->anp->asp->stream->header.output_dims;
+                        } else {
+                                struct item *item = s->anp->asp->items->elements[0];
+                                input_dims  = item_input_size(item, 0);
+                                output_dims = item->targets[0]->size;
+                        }
+                        if (s->anp->input->vector->size != input_dims) {
                                 eprintf("Cannot process command: `%s`\n", cmd);
                                 eprintf("Input dimensionality mismatch: model (%d) != set (%d)\n",
-                                        s->anp->input->vector->size, item->inputs[0]->size);
+                                        s->anp->input->vector->size, input_dims);
                                 goto out;
                         }
-                        if (s->anp->output->vector->size != item->targets[0]->size) {
+                        if (s->anp->output->vector->size != output_dims) {
                                 eprintf("Cannot process command: `%s`\n", cmd);
                                 eprintf("Output dimensionality mismatch: model (%d) != set (%d)\n",
-                                        s->anp->input->vector->size, item->inputs[0]->size);
+                                        s->anp->output->vector->size, output_dims);
                                 goto out;
                         }
                 }
+                /*
+                 * Skip commands that require the items of the active set
+                 * to be in memory if that set is streamed.
+                 */
+                if (req_rsp && s->anp->asp->stream) {
+                        eprintf("Cannot process command: `%s`\n", cmd);
+                        eprintf("Active set is streamed - see `help sets`\n");
+                        goto out;
+                }
                 /*
                  * If a command has arguments, we pass its processor its
                  * base and its arguments. Otherwise, we just pass its base.
@@ -158,6 +178,13 @@ void process_command(char *cmd, struct session *s)
                         req_init = true;
                         req_asp  = true;
                 }
+                /*
+                 * All commands following `train` require an active set
+                 * that is not streamed.
+                 */
+                else if (strcmp("train", cmds[i].cmd_base) == 0) {
+                        req_rsp  = true;
+                }
         }
 
         /* invalid command */
@@ -355,6 +382,11 @@ bool cmd_create_dcs_group(char *cmd, char *fmt, struct session *s)
                 eprintf("Cannot create DCS group - no such set '%s'\n", arg2);
                 return true;
         }
+        /* set should not be streamed */
+        if (set->stream) {
+                eprintf("Cannot create DCS group - set '%s' is streamed\n", arg2);
+                return true;
+        }
         /* create DCS context group */
         struct group *g = create_group(arg1, set->items->num_elements, false, false);
         g->pars->dcs_set = set;
@@ -760,6 +792,25 @@ bool cmd_toggle_reset_contexts(char *cmd, char *fmt, struct session *s)
         return true;
 }
 
+/*
+ * Note: If the network has already been unfolded, it is unfolded anew.
+ */
+bool cmd_toggle_activation_tape(char *cmd, char *fmt, struct session *s)
+{
+        if (strlen(cmd) != strlen(fmt) || strncmp(cmd, fmt, strlen(cmd)) != 0)
+                return false;
+        s->anp->flags->bptt_tape = !s->anp->flags->bptt_tape;
+        if (s->anp->unfolded_net) {
+                rnn_free_unfolded_network(s->anp->unfolded_net);
+                s->anp->unfolded_net = rnn_unfold_network(s->anp);
+        }
+        if (s->anp->flags->bptt_tape)
+                mprintf("Toggled activation tape \t [ on ]\n");
+        else
+                mprintf("Toggled activation tape \t [ off ]\n");
+        return true;
+}
+
 #ifdef _OPENMP
 bool cmd_toggle_multithreading(char *cmd, char *fmt, struct session *s)
 {
@@ -772,6 +823,18 @@ bool cmd_toggle_multithreading(char *cmd, char *fmt, struct session *s)
                 mprintf("Toggled multithreading \t [ off ]\n");
         return true;
 }
+
+bool cmd_toggle_data_parallelism(char *cmd, char *fmt, struct session *s)
+{
+        if (strlen(cmd) != strlen(fmt) || strncmp(cmd, fmt, strlen(cmd)) != 0)
+                return false;
+        s->anp->flags->data_parallel = !s->anp->flags->data_parallel;
+        if (s->anp->flags->data_parallel)
+                mprintf("Toggled data parallelism \t [ on ]\n");
+        else
+                mprintf("Toggled data parallelism \t [ off ]\n");
+        return true;
+}
 #endif /* _OPENMP */
 
 bool cmd_toggle_pretty_printing(char *cmd, char *fmt, struct session *s)
@@ -907,6 +970,7 @@ bool cmd_set_double_parameter(char *cmd, char *fmt, struct session *s)
         /* momentum */
         } else if (strcmp(arg1, "Momentum") == 0) {
                 s->anp->pars->momentum = arg2;
+                adjust_projection_matrices(s->anp, false);
                 mprintf("Set momentum \t\t\t [ %lf ]\n",
                         s->anp->pars->momentum);
         /* momentum scale factor */
@@ -1060,10 +1124,14 @@ bool cmd_set_learning_algorithm(char *cmd, char *fmt, struct session *s)
         /* backpropgation through time */
         else if (strlen(arg) == 4 && strcmp(arg, "bptt") == 0)
                 s->anp->learning_algorithm = train_network_with_bptt;
+        /* asynchronous (Hogwild!) backpropagation */
+        else if (strlen(arg) == 7 && strcmp(arg, "hogwild") == 0)
+                s->anp->learning_algorithm = train_network_with_hogwild;
         else {
                 eprintf("Invalid learning algorithm '%s'\n", arg);
                 return true;
         }
+        adjust_projection_matrices(s->anp, false);
         mprintf("Set learning algorithm \t [ %s ]\n", arg);
         return true;
 }
@@ -1118,6 +1186,7 @@ bool cmd_set_update_algorithm(char *cmd, char *fmt, struct session *s)
                 eprintf("Invalid update algorithm '%s'\n", arg);
                 return true;
         }
+        adjust_projection_matrices(s->anp, false);
         mprintf("Set update algorithm \t\t [ %s ]\n", arg);
         return true;
 }
@@ -1296,6 +1365,22 @@ bool cmd_show_matrix(char *cmd, char *fmt, struct session *s)
                         arg2, arg3);
                 return true;
         }
+        /*
+         * Show the gradients of the last update. These are the previous
+         * gradients, or, for steepest descent, which keeps its gradients
+         * until the next batch (see bp_reset_gradients_sd()), the gradients
+         * themselves. (Previous) gradients and dynamic parameters are
+         * allocated lazily.
+         */
+        struct matrix *gradients = fg_to_tg->prev_gradients;
+        if (!gradients && s->anp->update_algorithm == bp_update_sd
+                && s->anp->learning_algorithm != train_network_with_hogwild)
+                gradients = fg_to_tg->gradients;
+        if ((type == mtype_gradients && !gradients)
+                || (type == mtype_dynamic_params && !fg_to_tg->dynamic_params)) {
+                eprintf("Cannot show matrix - not kept by the current update algorithm\n");
+                return true;
+        }
         cprintf("\n");
         switch(type) {
         case mtype_weights:
@@ -1307,8 +1392,8 @@ bool cmd_show_matrix(char *cmd, char *fmt, struct session *s)
         case mtype_gradients:
                 cprintf("Gradient matrix for projection '%s -> %s':\n\n",
                         arg2, arg3);
-                s->pprint ? pprint_matrix(fg_to_tg->prev_gradients, s->scheme)
-                          : print_matrix(fg_to_tg->prev_gradients);
+                s->pprint ? pprint_matrix(gradients, s->scheme)
+                          : print_matrix(gradients);
                 break;
         case mtype_dynamic_params:
                 cprintf("Dynamic learning parameters for projection '%s -> %s':\n\n",
@@ -1392,6 +1477,62 @@ bool cmd_load_set(char *cmd, char *fmt, struct session *s)
         return true;
 }
 
+bool cmd_convert_set(char *cmd, char *fmt, struct session *s)
+{
+        char arg1[MAX_ARG_SIZE]; /* set filename */
+        char arg2[MAX_ARG_SIZE]; /* binary set filename */
+        if (sscanf(cmd, fmt, arg1, arg2) != 2)
+                return false;
+        /* input group size should be known */
+        if (!s->anp->input) {
+                eprintf("Cannot convert set - input group size unknown\n");
+                return true;
+        }
+        /* output group size should be known */
+        if (!s->anp->output) {
+                eprintf("Cannot convert set - output group size unknown\n");
+                return true;
+        }
+
+        /* load set, and save it in binary format */
+        struct set *set = load_set(arg1, arg1,
+                s->anp->input->vector->size,
+                s->anp->output->vector->size);
+        if (!set) {
+                eprintf("Failed to load set '%s'\n", arg1);
+                return true;
+        }
+        if (save_binary_set(set, arg2))
+                mprintf("Converted set \t\t\t [ %s => %s (%d) ]\n", arg1,
+                        arg2, set->items->num_elements);
+        free_set(set);
+        return true;
+}
+
+bool cmd_stream_set(char *cmd, char *fmt, struct session *s)
+{
+        char arg1[MAX_ARG_SIZE]; /* set name */
+        char arg2[MAX_ARG_SIZE]; /* binary set filename */
+        if (sscanf(cmd, fmt, arg1, arg2) != 2)
+                return false;
+        /* set should not already exist */
+        if (find_array_element_by_name(s->anp->sets, arg1)) {
+                eprintf("Cannot stream set - set '%s' already exists\n", arg1);
+                return true;
+        }
+
+        /* open set for streaming, if it exists */
+        struct set *set = load_streamed_set(arg1, arg2);
+        if (!set) {
+                eprintf("Failed to stream set '%s'\n", arg2);
+                return true;
+        }
+        add_set(s->anp, set);
+        mprintf("Streaming set \t\t\t [ %s => %s (%d) ]\n", arg2, set->name,
+                set->stream->header.num_items);
+        return true;
+}
+
 bool cmd_remove_set(char *cmd, char *fmt, struct session *s)
 {
         char arg[MAX_ARG_SIZE]; /* set name */
@@ -1589,6 +1730,11 @@ bool cmd_set_two_stage_forward(char *cmd, char *fmt, struct session *s)
                 eprintf("Cannot set two-stage forward - no such set '%s'\n", arg2);
                 return true;
         }
+        /* set should not be streamed */
+        if (set->stream) {
+                eprintf("Cannot set two-stage forward - set '%s' is streamed\n", arg2);
+                return true;
+        }
         s->anp->ts_fw_group = g;
         s->anp->ts_fw_set   = set;
         mprintf("Set two-stage forward \t [ %s --> (%s :: %s) --> %s ]\n", 
@@ -1630,6 +1776,11 @@ bool cmd_set_two_stage_backward(char *cmd, char *fmt, struct session *s)
                 eprintf("Cannot set two-stage backward - no such set '%s'\n", arg2);
                 return true;
         }
+        /* set should not be streamed */
+        if (set->stream) {
+                eprintf("Cannot set two-stage backward - set '%s' is streamed\n", arg2);
+                return true;
+        }
         s->anp->ts_bw_group = g;
         s->anp->ts_bw_set   = set;
         mprintf("Set two-stage backward \t [ %s <-- (%s :: %s) <-- %s ]\n", 
@@ -57,9 +57,11 @@ bool cmd_freeze_projection(char *cmd, char *fmt, struct session *s);
 bool cmd_unfreeze_projection(char *cmd, char *fmt, struct session *s);
 
 bool cmd_toggle_reset_contexts(char *cmd, char *fmt, struct session *s);
+bool cmd_toggle_activation_tape(char *cmd, char *fmt, struct session *s);
 
 #ifdef _OPENMP
 bool cmd_toggle_multithreading(char *cmd, char *fmt, struct session *s);
+bool cmd_toggle_data_parallelism(char *cmd, char *fmt, struct session *s);
 #endif /* _OPENMP */
 
 bool cmd_toggle_pretty_printing(char *cmd, char *fmt, struct session *s);
@@ -87,6 +89,8 @@ bool cmd_show_matrix(char *cmd, char *fmt, struct session *s);
 
 bool cmd_load_legacy_set(char *cmd, char *fmt, struct session *s);
 bool cmd_load_set(char *cmd, char *fmt, struct session *s);
+bool cmd_convert_set(char *cmd, char *fmt, struct session *s);
+bool cmd_stream_set(char *cmd, char *fmt, struct session *s);
 bool cmd_remove_set(char *cmd, char *fmt, struct session *s);
 bool cmd_sets(char *cmd, char *fmt, struct session *s);
 bool cmd_change_set(char *cmd, char *fmt, struct session *s);
@@ -195,10 +199,12 @@ const static struct command cmds[] = {
 
         /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
         {"toggleResetContexts",     NULL,            &cmd_toggle_reset_contexts},
+        {"toggleActivationTape",    NULL,            &cmd_toggle_activation_tape},
 
         /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 #ifdef _OPENMP
         {"toggleMultithreading",    NULL,            &cmd_toggle_multithreading},
+        {"toggleDataParallelism",   NULL,            &cmd_toggle_data_parallelism},
 #endif /* _OPENMP */
 
         /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -261,6 +267,8 @@ const static struct command cmds[] = {
         /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
         {"loadLegacySet",           "%s %s",         &cmd_load_legacy_set},
         {"loadSet",                 "%s %s",         &cmd_load_set},
+        {"convertSet",              "%s %s",         &cmd_convert_set},
+        {"streamSet",               "%s %s",         &cmd_stream_set},
         {"removeSet",               "%s",            &cmd_remove_set},
         {"sets",                    NULL,            &cmd_sets},
         {"changeSet",               "%s",            &cmd_change_set},
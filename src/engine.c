@@ -28,6 +28,19 @@
 This glues together the processing logic for different network types.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */                
 
+/*
+ * Clamps the input vector of an event of an item, which is either dense or
+ * sparse.
+ */
+void clamp_input_event(struct network *n, struct item *item,
+        uint32_t event)
+{
+        if (item->sparse_inputs && item->sparse_inputs[event])
+                clamp_sparse_input_vector(n, item->sparse_inputs[event]);
+        else
+                clamp_input_vector(n, item->inputs[event]);
+}
+
 void clamp_input_vector(struct network *n, struct vector *input)
 {
         struct rnn_unfolded_network *un = n->unfolded_net;
@@ -36,9 +49,37 @@ void clamp_input_vector(struct network *n, struct vector *input)
                 /* fall through */
         case ntype_srn:
                 copy_vector(input, n->input->vector);
+                n->input->sparse = NULL;
                 break;
         case ntype_rnn:
-                copy_vector(input, un->stack[un->sp]->input->vector);
+                copy_vector(input,
+                        rnn_stack_network(un, un->sp)->input->vector);
+                rnn_set_sparse_input(un, un->sp, NULL);
+                break;
+        }
+}
+
+/*
+ * Clamps a sparse input vector. Its units are copied into the vector of the
+ * input group, which also keeps a reference to the sparse vector itself,
+ * such that its outgoing projections are propagated sparsely (see act.c).
+ * This reference is valid until the next input vector is clamped.
+ */
+void clamp_sparse_input_vector(struct network *n,
+        struct sparse_vector *input)
+{
+        struct rnn_unfolded_network *un = n->unfolded_net;
+        switch(n->flags->type) {
+        case ntype_ffn:
+                /* fall through */
+        case ntype_srn:
+                copy_sparse_vector(input, n->input->vector);
+                n->input->sparse = input;
+                break;
+        case ntype_rnn:
+                copy_sparse_vector(input,
+                        rnn_stack_network(un, un->sp)->input->vector);
+                rnn_set_sparse_input(un, un->sp, input);
                 break;
         }
 }
@@ -52,11 +93,11 @@ void reset_ticks(struct network *n)
         case ntype_ffn:
                 break;
         case ntype_srn:
-                reset_context_groups(n, n->input);
+                reset_context_groups(n);
                 break;
         case ntype_rnn:
                 reset_stack_pointer(n);
-                reset_recurrent_groups(un->stack[0]);
+                reset_recurrent_groups(rnn_stack_network(un, 0));
                 break;
         }
 }
@@ -69,7 +110,7 @@ void next_tick(struct network *n)
         case ntype_ffn:
                 break;
         case ntype_srn:
-                shift_context_groups(n, n->input);
+                shift_context_groups(n);
                 break;
         case ntype_rnn:
                 shift_pointer_or_stack(n);
@@ -87,7 +128,8 @@ void forward_sweep(struct network *n)
                 feed_forward(n, n->input);
                 break;
         case ntype_rnn:
-                feed_forward(un->stack[un->sp], un->stack[un->sp]->input);
+                feed_forward(rnn_stack_network(un, un->sp),
+                        rnn_stack_network(un, un->sp)->input);
                 break;
         }
 }
@@ -103,8 +145,8 @@ double output_error(struct network *n, struct vector *target)
                 error = n->output->err_fun->fun(n, n->output, target);
                 break;
         case ntype_rnn:
-                error = un->stack[un->sp]->output->err_fun->fun(
-                        n, un->stack[un->sp]->output, target);
+                error = rnn_stack_network(un, un->sp)->output->err_fun->fun(
+                        n, rnn_stack_network(un, un->sp)->output, target);
                 break;
         }
         return error;
@@ -121,7 +163,7 @@ struct vector *output_vector(struct network *n)
                 v = n->output->vector;
                 break;
         case ntype_rnn:
-                v = un->stack[un->sp]->output->vector;
+                v = rnn_stack_network(un, un->sp)->output->vector;
                 break;     
         }
         return v;
@@ -139,7 +181,7 @@ struct group *find_network_group_by_name(struct network *n, char *name)
                 break;
         case ntype_rnn:
                 g = find_array_element_by_name(
-                        un->stack[un->sp]->groups, name);
+                        rnn_stack_network(un, un->sp)->groups, name);
                 break;
         }
         return g;
@@ -169,28 +211,21 @@ void backward_sweep(struct network *n)
                 bp_backpropagate_error(n, n->output);
                 break;
         case ntype_rnn:
-                for (int32_t i = un->sp; i >= 0; i--)
-                        bp_backpropagate_error(
-                                un->stack[i], 
-                                un->stack[i]->output);
+                for (int32_t i = un->sp; i >= 0; i--) {
+                        struct network *sn = rnn_stack_network(un, i);
+                        bp_backpropagate_error(sn, sn->output);
+                }
                 break;     
         }
 }
 
+/*
+ * Note: The projections of an unfolded network share their gradients with
+ * those of the network itself (see rnn_unfold.c).
+ */
 void update_weights(struct network *n)
 {
-        struct rnn_unfolded_network *un = n->unfolded_net;
-        switch(n->flags->type) {
-        case ntype_ffn:
-                /* fall through */
-        case ntype_srn:
-                n->update_algorithm(n);
-                break;
-        case ntype_rnn:
-                rnn_sum_and_reset_gradients(un);
-                n->update_algorithm(un->stack[0]);
-                break;
-        }
+        n->update_algorithm(n);
 }
 
 void inject_error(struct network *n, struct vector *target)
@@ -203,7 +238,8 @@ void inject_error(struct network *n, struct vector *target)
                 bp_output_error(n, n->output, target);
                 break;
         case ntype_rnn:
-                bp_output_error(n, un->stack[un->sp]->output, target);
+                bp_output_error(n, rnn_stack_network(un, un->sp)->output,
+                        target);
                 break;
         } 
 }
@@ -220,14 +256,19 @@ void two_stage_forward_sweep(struct network *n, struct item *item,
                 np = n;
                 break;
         case ntype_rnn:
-                np = un->stack[un->sp];
+                np = rnn_stack_network(un, un->sp);
                 break;
         }
         struct group *ts_fw_group = find_network_group_by_name(
                 np, n->ts_fw_group->name);
         struct item  *ts_fw_item  = find_array_element_by_name(
                 n->ts_fw_set->items, item->name);
-        copy_vector(ts_fw_item->inputs[event], ts_fw_group->vector);
+        if (ts_fw_item->sparse_inputs && ts_fw_item->sparse_inputs[event])
+                copy_sparse_vector(ts_fw_item->sparse_inputs[event],
+                        ts_fw_group->vector);
+        else
+                copy_vector(ts_fw_item->inputs[event], ts_fw_group->vector);
+        ts_fw_group->sparse = NULL;
         feed_forward(np, ts_fw_group);
 }
 
@@ -243,7 +284,7 @@ void two_stage_backward_sweep(struct network *n, struct item *item,
                 np = n;
                 break;
         case ntype_rnn:
-                np = un->stack[un->sp];
+                np = rnn_stack_network(un, un->sp);
                 break;
         }
         struct group *ts_bw_group = find_network_group_by_name(
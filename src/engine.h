@@ -21,7 +21,11 @@
 #include "set.h"
 #include "vector.h"
 
+void clamp_input_event(struct network *n, struct item *item,
+        uint32_t event);
 void clamp_input_vector(struct network *n, struct vector *input);
+void clamp_sparse_input_vector(struct network *n,
+        struct sparse_vector *input);
 void reset_ticks(struct network *n);
 void next_tick(struct network *n);
 void forward_sweep(struct network *n);
@@ -88,7 +88,8 @@ double err_fun_sum_of_squares(struct network *n, struct group *g,
         double se = 0.0;
 
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+:se) if (n->flags->omp_mthreaded)
+#pragma omp parallel for reduction(+:se) \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -105,7 +106,8 @@ void err_fun_sum_of_squares_deriv(struct network *n, struct group *g,
         struct vector *t)
 {
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded)
+#pragma omp parallel for \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -148,7 +150,8 @@ double err_fun_cross_entropy(struct network *n, struct group *g,
         double ce = 0.0;
 
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+:ce) if (n->flags->omp_mthreaded)
+#pragma omp parallel for reduction(+:ce) \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -238,7 +241,8 @@ void err_fun_cross_entropy_deriv(struct network *n, struct group *g,
         struct vector *t)
 {
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded)
+#pragma omp parallel for \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -334,7 +338,8 @@ double err_fun_divergence(struct network *n, struct group *g,
         double de = 0.0;
 
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+:de) if (n->flags->omp_mthreaded)
+#pragma omp parallel for reduction(+:de) \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -376,7 +381,8 @@ void err_fun_divergence_deriv(struct network *n, struct group *g,
         struct vector *t)
 {
 #ifdef _OPENMP
-#pragma omp parallel for if (n->flags->omp_mthreaded)
+#pragma omp parallel for \
+        if (n->flags->omp_mthreaded && g->vector->size >= n->pars->omp_unit_cutoff)
 #endif /* _OPENMP */
         for (uint32_t i = 0; i < g->vector->size; i++) {
                 double y = g->vector->elements[i];
@@ -413,3 +419,40 @@ void err_fun_divergence_deriv(struct network *n, struct group *g,
                 }
         }
 }
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Divergence error signals for a softmax group.
+
+If an output group with softmax activation is trained on divergence, the
+error signal of unit i is (see act_fun_softmax() in act.c):
+
+        delta_i = y_i * (-d_i / y_i - sum_j y_j * (-d_j / y_j))
+                = y_i * sum_j d_j - d_i
+
+which for targets that sum to one is simply:
+
+        delta_i = y_i - d_i
+
+This is the familiar softmax/cross-entropy delta (note that "cross entropy"
+in Mesh refers to the error for independent binary units). Computing it
+directly avoids both the division by y_i, and its limit handling, as well
+as the Jacobian-vector product of the softmax derivative. Hence, this
+function writes error signals, rather than error derivatives, into the
+error vector of the group.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void err_fun_divergence_softmax_deriv(struct network *n, struct group *g,
+        struct vector *t)
+{
+        double sd = 0.0;
+        for (uint32_t i = 0; i < g->vector->size; i++) {
+                double y = g->vector->elements[i];
+                double d = adjust_target(y, t->elements[i],
+                        n->pars->target_radius, n->pars->zero_error_radius);
+                g->error->elements[i] = d;
+                sd += d;
+        }
+        for (uint32_t i = 0; i < g->vector->size; i++)
+                g->error->elements[i] = g->vector->elements[i] * sd
+                        - g->error->elements[i];
+}
@@ -42,5 +42,7 @@ double err_fun_divergence(struct network *n, struct group *g,
         struct vector *t);
 void err_fun_divergence_deriv(struct network *n, struct group *g,
         struct vector *t);
+void err_fun_divergence_softmax_deriv(struct network *n, struct group *g,
+        struct vector *t);
 
 #endif /* ERROR_H */
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#include <stdlib.h>
+
+#include "engine.h"
+#include "evaluate.h"
+#include "main.h"
+#include "replica.h"
+
+                /*****************************
+                 **** parallel evaluation ****
+                 *****************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Testing a network, and constructing similarity and confusion matrices or
+unit recordings, requires that each item of the active set is processed
+independently of all others. If data parallelism is enabled (see
+train.c), these items are divided among several workers, each of which
+processes items using its own replica of the network (see replica.c).
+
+Each worker starts out with a contiguous range of items in its own queue,
+and processes these from the front. As items may differ in their number
+of events, some workers may run out of items before others do. These
+workers then steal items from the back of the queue of another worker,
+until all queues are exhausted.
+
+After each event of an item, a caller-specific function is applied to
+the state of the worker that processed it. This function should store its
+results by item index, so that the caller can combine them in item order
+once all items are processed. This way, results do not depend on the
+number of workers, or on the order in which items were processed.
+
+This requires that items are independent of each other. Networks with DSS
+context groups, and recurrent networks whose context groups are not reset
+between items, are therefore always processed by a single worker.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct evaluator *create_evaluator(struct network *n)
+{
+        struct evaluator *e;
+        if (!(e = malloc(sizeof(struct evaluator))))
+                goto error_out;
+        e->num_workers = 1;
+#ifdef _OPENMP
+        if (n->flags->data_parallel && !n->flags->dcs
+                && (n->flags->type == ntype_ffn || n->flags->reset_contexts))
+                e->num_workers = omp_get_max_threads();
+#endif /* _OPENMP */
+        if (e->num_workers > n->asp->items->num_elements)
+                e->num_workers = n->asp->items->num_elements;
+        if (e->num_workers == 0)
+                e->num_workers = 1;
+        if (!(e->workers = malloc(e->num_workers * sizeof(struct network *))))
+                goto error_out;
+        if (!(e->queues = malloc(e->num_workers * sizeof(struct eval_queue))))
+                goto error_out;
+        for (uint32_t t = 0; t < e->num_workers; t++) {
+                e->workers[t] = t == 0 ? n : create_replica(n);
+#ifdef _OPENMP
+                omp_init_lock(&e->queues[t].lock);
+#endif /* _OPENMP */
+        }
+
+        return e;
+
+error_out:
+        perror("[create_evaluator()]");
+        return NULL;
+}
+
+void free_evaluator(struct evaluator *e)
+{
+        for (uint32_t t = 0; t < e->num_workers; t++) {
+                if (t > 0)
+                        free_replica(e->workers[t]);
+#ifdef _OPENMP
+                omp_destroy_lock(&e->queues[t].lock);
+#endif /* _OPENMP */
+        }
+        free(e->workers);
+        free(e->queues);
+        free(e);
+}
+
+/*
+ * Processes items first to last (exclusive) of the active set, applying
+ * fun after each event. Returns false if processing was interrupted.
+ */
+bool evaluate_items(struct evaluator *e, uint32_t first, uint32_t last,
+        eval_fun fun, void *data, bool *keep_running)
+{
+        uint32_t nw = e->num_workers;
+        uint32_t ni = last - first;
+        for (uint32_t t = 0; t < nw; t++) {
+                e->queues[t].head = first + (uint64_t)ni * t / nw;
+                e->queues[t].tail = first + (uint64_t)ni * (t + 1) / nw;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nw) if (nw > 1)
+#endif /* _OPENMP */
+        {
+                uint32_t t = 0;
+#ifdef _OPENMP
+                t = omp_get_thread_num();
+#endif /* _OPENMP */
+                struct network *n = e->workers[t];
+                uint32_t i;
+                while (*keep_running && eval_next_item(e, t, &i))
+                        eval_process_item(n, n->asp->items->elements[i], i,
+                                fun, data);
+        }
+
+        return *keep_running;
+}
+
+/*
+ * Takes the next item from the queue of worker t, or steals one from the
+ * queue of another worker if its own queue is exhausted. Returns false if
+ * all queues are exhausted.
+ */
+bool eval_next_item(struct evaluator *e, uint32_t t, uint32_t *i)
+{
+        for (uint32_t x = 0; x < e->num_workers; x++) {
+                uint32_t v = (t + x) % e->num_workers;
+                struct eval_queue *q = &e->queues[v];
+                bool found = false;
+#ifdef _OPENMP
+                omp_set_lock(&q->lock);
+#endif /* _OPENMP */
+                if (q->head < q->tail) {
+                        *i = v == t ? q->head++ : --q->tail;
+                        found = true;
+                }
+#ifdef _OPENMP
+                omp_unset_lock(&q->lock);
+#endif /* _OPENMP */
+                if (found)
+                        return true;
+        }
+        return false;
+}
+
+void eval_process_item(struct network *n, struct item *item, uint32_t i,
+        eval_fun fun, void *data)
+{
+        reset_ticks(n);
+        for (uint32_t j = 0; j < item->num_events; j++) {
+                if (j > 0)
+                        next_tick(n);
+                clamp_input_event(n, item, j);
+                forward_sweep(n);
+                fun(n, item, i, j, data);
+        }
+}
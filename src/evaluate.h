@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+#include "set.h"
+
+/*
+ * Function that is called after each event of an item is processed, with
+ * the network state of the worker that processed it, the item, its index i
+ * in the active set, the event number j, and caller-specific data.
+ */
+typedef void (*eval_fun)(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data);
+
+/*
+ * Queue of item indices [head, tail) of a worker. The owner takes items
+ * from the head, other workers steal them from the tail.
+ */
+struct eval_queue
+{
+        uint32_t head;                  /* next item of owner */
+        uint32_t tail;                  /* one past last item */
+#ifdef _OPENMP
+        omp_lock_t lock;                /* queue lock */
+#endif /* _OPENMP */
+};
+
+struct evaluator
+{
+        uint32_t num_workers;           /* number of workers */
+        struct network **workers;       /* network state per worker */
+        struct eval_queue *queues;      /* item queue per worker */
+};
+
+struct evaluator *create_evaluator(struct network *n);
+void free_evaluator(struct evaluator *e);
+bool evaluate_items(struct evaluator *e, uint32_t first, uint32_t last,
+        eval_fun fun, void *data, bool *keep_running);
+bool eval_next_item(struct evaluator *e, uint32_t t, uint32_t *i);
+void eval_process_item(struct network *n, struct item *item, uint32_t i,
+        eval_fun fun, void *data);
+
+#endif /* EVALUATE_H */
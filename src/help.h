@@ -121,7 +121,12 @@
 "`set ZeroErrorRadius <value>`    No error if output is withing radius    \n" \
 "* `bptt`                         Backpropagation Through Time (BPTT)     \n" \
 "`set BackTicks <value>`          Sets number of backward time ticks      \n" \
+"`toggleActivationTape`           Toggle activation-tape BPTT             \n" \
 "(see `bp`)                                                               \n" \
+"* `hogwild`                      Asynchronous (Hogwild!) steepest descent\n" \
+"`set LearningRate <value>`       Set learning rate (LR) coefficient      \n" \
+"`set WeightDecay <value>`        Set weight decay (WD) coefficient       \n" \
+"(see `bp`; requires OpenMP for multiple threads)                         \n" \
 "                                                                         \n" \
 "## Other relevant topics                                                 \n" \
 "                                                                         \n" \
@@ -215,6 +220,9 @@
 "# Example sets                                                           \n" \
 "                                                                         \n" \
 "`loadSet <name> <file>`          Load example set from specified file    \n" \
+"`convertSet <file> <binfile>`    Convert set to memory-mapped binary set \n" \
+"`streamSet <name> <binfile>`     Stream binary set from disk during      \n" \
+"                                 training (for sets larger than memory)  \n" \
 "`removeSet <name>`               Remove set from active network          \n" \
 "`sets`                           List all sets in active network         \n" \
 "`changeSet <name>`               Change active set                       \n" \
@@ -299,6 +307,8 @@
 "`set ErrorThreshold <value>`     Stop if error drops below threshold     \n" \
 "`set ReportAfter <value>`        Report progress after #epochs           \n" \
 "                                                                         \n" \
+"`toggleDataParallelism`          Divide items among threads (OpenMP)     \n" \
+"                                                                         \n" \
 "## Other relevant topics                                                 \n" \
 "                                                                         \n" \
 "* [learning]                     Learning algorithms, parameters         \n" \
@@ -0,0 +1,534 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+#include "kernel.h"
+
+/*
+ * Vector instructions for the element type (see real.h).
+ */
+#if defined(__AVX512F__)
+#define KERNEL_SIMD
+#ifdef SINGLE_PRECISION
+#define VEC_T           __m512
+#define VEC_WIDTH       16
+#define VEC_SET1        _mm512_set1_ps
+#define VEC_LOADU       _mm512_loadu_ps
+#define VEC_STOREU      _mm512_storeu_ps
+#define VEC_FMADD       _mm512_fmadd_ps
+#define VEC_MUL         _mm512_mul_ps
+#define VEC_MAX         _mm512_max_ps
+#else
+#define VEC_T           __m512d
+#define VEC_WIDTH       8
+#define VEC_SET1        _mm512_set1_pd
+#define VEC_LOADU       _mm512_loadu_pd
+#define VEC_STOREU      _mm512_storeu_pd
+#define VEC_FMADD       _mm512_fmadd_pd
+#define VEC_MUL         _mm512_mul_pd
+#define VEC_MAX         _mm512_max_pd
+#endif /* SINGLE_PRECISION */
+#elif defined(__AVX2__) && defined(__FMA__)
+#define KERNEL_SIMD
+#ifdef SINGLE_PRECISION
+#define VEC_T           __m256
+#define VEC_WIDTH       8
+#define VEC_SET1        _mm256_set1_ps
+#define VEC_LOADU       _mm256_loadu_ps
+#define VEC_STOREU      _mm256_storeu_ps
+#define VEC_FMADD       _mm256_fmadd_ps
+#define VEC_MUL         _mm256_mul_ps
+#define VEC_MAX         _mm256_max_ps
+#else
+#define VEC_T           __m256d
+#define VEC_WIDTH       4
+#define VEC_SET1        _mm256_set1_pd
+#define VEC_LOADU       _mm256_loadu_pd
+#define VEC_STOREU      _mm256_storeu_pd
+#define VEC_FMADD       _mm256_fmadd_pd
+#define VEC_MUL         _mm256_mul_pd
+#define VEC_MAX         _mm256_max_pd
+#endif /* SINGLE_PRECISION */
+#endif
+
+                /*****************
+                 **** kernels ****
+                 *****************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+This implements the linear algebra kernels that the forward and backward
+sweeps are built from. Weight matrices are stored with one row per unit of
+the projecting group, and one column per unit of the receiving group (see
+matrix.h). Net input to the receiving group is therefore a transposed
+matrix-vector product:
+
+        y = W^T x
+
+which is computed as a sum of scaled rows:
+
+        y = sum_i x_i * W[i,:]
+
+such that W is read in storage order, rather than column by column. In the
+backward sweep, error derivatives flow back along the same matrix:
+
+        e = W d
+
+which is a series of dot products of the rows of W with d, and the weight
+gradients are accumulated as an outer product (a rank-1 update):
+
+        G = G + y d^T
+
+All three kernels process rows four at a time, which reduces the number of
+passes over the column vector (y or d) by a factor four. If the compiler
+targets AVX-512 or AVX2 (with FMA), the inner loop uses explicit vector
+instructions; otherwise, a scalar loop is used that the compiler is free to
+vectorize itself.
+
+When a batch of input vectors is processed at once, each of these products
+becomes a matrix-matrix product (with one row per vector in the batch). The
+batch kernels are built from the vector kernels, but apply each block of
+weights (or gradients) to every row of the batch while it resides in
+cache.
+
+Reductions over a single vector (maxima, dot products) are computed with
+one vector accumulator per lane, which are combined at the end. Their result
+may therefore differ in the last bits from that of a sequential loop.
+
+If x is sparse (see vector.c), the net input is a sum of only those rows of
+W that belong to its non-zero elements:
+
+        y = sum_k x_k * W[i_k,:]
+
+which, for localist input vectors, amounts to a handful of row lookups,
+rather than a pass over the entire matrix.
+
+The forward kernel operates on a column range [c0,c1) of the matrix, and the
+backward kernels on a row range [r0,r1), so that callers can divide work
+into tiles of KERNEL_TILE_SIZE columns or rows (e.g., across threads) that
+write to disjoint memory. If c0 is a multiple of the matrix alignment, all
+loads from W are aligned; rows are always aligned.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/*
+ * y[c0:c1] += (W^T x)[c0:c1]
+ */
+void kernel_gemv_trans(struct matrix *m, real *x, real *y,
+        uint32_t c0, uint32_t c1)
+{
+        kernel_gemv_trans_block(m, x, y, 0, m->rows, c0, c1);
+}
+
+/*
+ * y[c0:c1] += (W[r0:r1,:]^T x[r0:r1])[c0:c1]
+ */
+void kernel_gemv_trans_block(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1)
+{
+        uint32_t i = r0;
+        for (; i + 4 <= r1; i += 4) {
+                real x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+                real *w0 = matrix_row(m, i);
+                real *w1 = matrix_row(m, i + 1);
+                real *w2 = matrix_row(m, i + 2);
+                real *w3 = matrix_row(m, i + 3);
+                uint32_t j = c0;
+#ifdef KERNEL_SIMD
+                VEC_T vx0 = VEC_SET1(x0), vx1 = VEC_SET1(x1);
+                VEC_T vx2 = VEC_SET1(x2), vx3 = VEC_SET1(x3);
+                for (; j + VEC_WIDTH <= c1; j += VEC_WIDTH) {
+                        VEC_T vy = VEC_LOADU(&y[j]);
+                        vy = VEC_FMADD(vx0, VEC_LOADU(&w0[j]), vy);
+                        vy = VEC_FMADD(vx1, VEC_LOADU(&w1[j]), vy);
+                        vy = VEC_FMADD(vx2, VEC_LOADU(&w2[j]), vy);
+                        vy = VEC_FMADD(vx3, VEC_LOADU(&w3[j]), vy);
+                        VEC_STOREU(&y[j], vy);
+                }
+#endif /* KERNEL_SIMD */
+                for (; j < c1; j++)
+                        y[j] += x0 * w0[j] + x1 * w1[j]
+                                + x2 * w2[j] + x3 * w3[j];
+        }
+        /* remaining rows */
+        for (; i < r1; i++) {
+                real xi = x[i];
+                real *wi = matrix_row(m, i);
+                for (uint32_t j = c0; j < c1; j++)
+                        y[j] += xi * wi[j];
+        }
+}
+
+/*
+ * y[c0:c1] += (W^T x)[c0:c1], for sparse x
+ */
+void kernel_gemv_trans_sparse(struct matrix *m, struct sparse_vector *x,
+        real *y, uint32_t c0, uint32_t c1)
+{
+        uint32_t *idx = x->indices;
+        real *xe = x->elements;
+        uint32_t k = 0;
+        for (; k + 4 <= x->num_elements; k += 4) {
+                real x0 = xe[k], x1 = xe[k + 1], x2 = xe[k + 2], x3 = xe[k + 3];
+                real *w0 = matrix_row(m, idx[k]);
+                real *w1 = matrix_row(m, idx[k + 1]);
+                real *w2 = matrix_row(m, idx[k + 2]);
+                real *w3 = matrix_row(m, idx[k + 3]);
+                uint32_t j = c0;
+#ifdef KERNEL_SIMD
+                VEC_T vx0 = VEC_SET1(x0), vx1 = VEC_SET1(x1);
+                VEC_T vx2 = VEC_SET1(x2), vx3 = VEC_SET1(x3);
+                for (; j + VEC_WIDTH <= c1; j += VEC_WIDTH) {
+                        VEC_T vy = VEC_LOADU(&y[j]);
+                        vy = VEC_FMADD(vx0, VEC_LOADU(&w0[j]), vy);
+                        vy = VEC_FMADD(vx1, VEC_LOADU(&w1[j]), vy);
+                        vy = VEC_FMADD(vx2, VEC_LOADU(&w2[j]), vy);
+                        vy = VEC_FMADD(vx3, VEC_LOADU(&w3[j]), vy);
+                        VEC_STOREU(&y[j], vy);
+                }
+#endif /* KERNEL_SIMD */
+                for (; j < c1; j++)
+                        y[j] += x0 * w0[j] + x1 * w1[j]
+                                + x2 * w2[j] + x3 * w3[j];
+        }
+        /* remaining elements */
+        for (; k < x->num_elements; k++) {
+                real xk = xe[k];
+                real *wk = matrix_row(m, idx[k]);
+                for (uint32_t j = c0; j < c1; j++)
+                        y[j] += xk * wk[j];
+        }
+}
+
+/*
+ * y[r0:r1] += (W x)[r0:r1]
+ */
+void kernel_gemv(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1)
+{
+        uint32_t i = r0;
+        for (; i + 4 <= r1; i += 4) {
+                real *w0 = matrix_row(m, i);
+                real *w1 = matrix_row(m, i + 1);
+                real *w2 = matrix_row(m, i + 2);
+                real *w3 = matrix_row(m, i + 3);
+                real s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+                uint32_t j = 0;
+#ifdef KERNEL_SIMD
+                VEC_T vs0 = VEC_SET1(0.0), vs1 = VEC_SET1(0.0);
+                VEC_T vs2 = VEC_SET1(0.0), vs3 = VEC_SET1(0.0);
+                for (; j + VEC_WIDTH <= m->cols; j += VEC_WIDTH) {
+                        VEC_T vx = VEC_LOADU(&x[j]);
+                        vs0 = VEC_FMADD(VEC_LOADU(&w0[j]), vx, vs0);
+                        vs1 = VEC_FMADD(VEC_LOADU(&w1[j]), vx, vs1);
+                        vs2 = VEC_FMADD(VEC_LOADU(&w2[j]), vx, vs2);
+                        vs3 = VEC_FMADD(VEC_LOADU(&w3[j]), vx, vs3);
+                }
+                real lanes[4][VEC_WIDTH];
+                VEC_STOREU(lanes[0], vs0);
+                VEC_STOREU(lanes[1], vs1);
+                VEC_STOREU(lanes[2], vs2);
+                VEC_STOREU(lanes[3], vs3);
+                for (uint32_t l = 0; l < VEC_WIDTH; l++) {
+                        s0 += lanes[0][l];
+                        s1 += lanes[1][l];
+                        s2 += lanes[2][l];
+                        s3 += lanes[3][l];
+                }
+#endif /* KERNEL_SIMD */
+                for (; j < m->cols; j++) {
+                        s0 += w0[j] * x[j];
+                        s1 += w1[j] * x[j];
+                        s2 += w2[j] * x[j];
+                        s3 += w3[j] * x[j];
+                }
+                y[i]     += s0;
+                y[i + 1] += s1;
+                y[i + 2] += s2;
+                y[i + 3] += s3;
+        }
+        /* remaining rows */
+        for (; i < r1; i++)
+                y[i] += kernel_dot(matrix_row(m, i), x, m->cols);
+}
+
+/*
+ * G[r0:r1,:] += (x y^T)[r0:r1,:]
+ */
+void kernel_ger(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1)
+{
+        uint32_t i = r0;
+        for (; i + 4 <= r1; i += 4) {
+                real x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+                real *g0 = matrix_row(m, i);
+                real *g1 = matrix_row(m, i + 1);
+                real *g2 = matrix_row(m, i + 2);
+                real *g3 = matrix_row(m, i + 3);
+                uint32_t j = 0;
+#ifdef KERNEL_SIMD
+                VEC_T vx0 = VEC_SET1(x0), vx1 = VEC_SET1(x1);
+                VEC_T vx2 = VEC_SET1(x2), vx3 = VEC_SET1(x3);
+                for (; j + VEC_WIDTH <= m->cols; j += VEC_WIDTH) {
+                        VEC_T vy = VEC_LOADU(&y[j]);
+                        VEC_STOREU(&g0[j],
+                                VEC_FMADD(vx0, vy, VEC_LOADU(&g0[j])));
+                        VEC_STOREU(&g1[j],
+                                VEC_FMADD(vx1, vy, VEC_LOADU(&g1[j])));
+                        VEC_STOREU(&g2[j],
+                                VEC_FMADD(vx2, vy, VEC_LOADU(&g2[j])));
+                        VEC_STOREU(&g3[j],
+                                VEC_FMADD(vx3, vy, VEC_LOADU(&g3[j])));
+                }
+#endif /* KERNEL_SIMD */
+                for (; j < m->cols; j++) {
+                        g0[j] += x0 * y[j];
+                        g1[j] += x1 * y[j];
+                        g2[j] += x2 * y[j];
+                        g3[j] += x3 * y[j];
+                }
+        }
+        /* remaining rows */
+        for (; i < r1; i++) {
+                real xi = x[i];
+                real *gi = matrix_row(m, i);
+                for (uint32_t j = 0; j < m->cols; j++)
+                        gi[j] += xi * y[j];
+        }
+}
+
+/*
+ * C[0:nr,c0:c1] += (A[0:nr,:] W)[:,c0:c1]
+ *
+ * W is processed in blocks of KERNEL_BLOCK_ROWS rows, and each block is
+ * applied to all rows of A before moving on to the next, such that it is
+ * read from memory once, rather than once per row of A.
+ */
+void kernel_gemm(struct matrix *a, struct matrix *w, struct matrix *c,
+        uint32_t nr, uint32_t c0, uint32_t c1)
+{
+        for (uint32_t k0 = 0; k0 < w->rows; k0 += KERNEL_BLOCK_ROWS) {
+                uint32_t k1 = k0 + KERNEL_BLOCK_ROWS;
+                if (k1 > w->rows)
+                        k1 = w->rows;
+                for (uint32_t b = 0; b < nr; b++)
+                        kernel_gemv_trans_block(w, matrix_row(a, b),
+                                matrix_row(c, b), k0, k1, c0, c1);
+        }
+}
+
+/*
+ * C[0:nr,r0:r1] += (D[0:nr,:] W^T)[:,r0:r1]
+ */
+void kernel_gemm_nt(struct matrix *d, struct matrix *w, struct matrix *c,
+        uint32_t nr, uint32_t r0, uint32_t r1)
+{
+        for (uint32_t k0 = r0; k0 < r1; k0 += KERNEL_BLOCK_ROWS) {
+                uint32_t k1 = k0 + KERNEL_BLOCK_ROWS;
+                if (k1 > r1)
+                        k1 = r1;
+                for (uint32_t b = 0; b < nr; b++)
+                        kernel_gemv(w, matrix_row(d, b),
+                                matrix_row(c, b), k0, k1);
+        }
+}
+
+/*
+ * G[r0:r1,:] += (Y[0:nr,:]^T D[0:nr,:])[r0:r1,:]
+ */
+void kernel_gemm_tn(struct matrix *y, struct matrix *d, struct matrix *g,
+        uint32_t nr, uint32_t r0, uint32_t r1)
+{
+        for (uint32_t k0 = r0; k0 < r1; k0 += KERNEL_BLOCK_ROWS) {
+                uint32_t k1 = k0 + KERNEL_BLOCK_ROWS;
+                if (k1 > r1)
+                        k1 = r1;
+                for (uint32_t b = 0; b < nr; b++)
+                        kernel_ger(g, matrix_row(y, b),
+                                matrix_row(d, b), k0, k1);
+        }
+}
+
+/*
+ * max_i x[i]
+ */
+real kernel_max(real *x, uint32_t n)
+{
+        real mx = x[0];
+        uint32_t i = 0;
+#ifdef KERNEL_SIMD
+        if (n >= VEC_WIDTH) {
+                VEC_T vm = VEC_LOADU(&x[0]);
+                for (i = VEC_WIDTH; i + VEC_WIDTH <= n; i += VEC_WIDTH)
+                        vm = VEC_MAX(vm, VEC_LOADU(&x[i]));
+                real lanes[VEC_WIDTH];
+                VEC_STOREU(lanes, vm);
+                for (uint32_t j = 0; j < VEC_WIDTH; j++)
+                        if (lanes[j] > mx)
+                                mx = lanes[j];
+        }
+#endif /* KERNEL_SIMD */
+        for (; i < n; i++)
+                if (x[i] > mx)
+                        mx = x[i];
+        return mx;
+}
+
+/*
+ * sum_i x[i] * y[i]
+ */
+real kernel_dot(real *x, real *y, uint32_t n)
+{
+        real sum = 0.0;
+        uint32_t i = 0;
+#ifdef KERNEL_SIMD
+        VEC_T vs = VEC_SET1(0.0);
+        for (; i + VEC_WIDTH <= n; i += VEC_WIDTH)
+                vs = VEC_FMADD(VEC_LOADU(&x[i]), VEC_LOADU(&y[i]), vs);
+        real lanes[VEC_WIDTH];
+        VEC_STOREU(lanes, vs);
+        for (uint32_t j = 0; j < VEC_WIDTH; j++)
+                sum += lanes[j];
+#endif /* KERNEL_SIMD */
+        for (; i < n; i++)
+                sum += x[i] * y[i];
+        return sum;
+}
+
+/*
+ * x = a * x
+ */
+void kernel_scale(real *x, real a, uint32_t n)
+{
+        uint32_t i = 0;
+#ifdef KERNEL_SIMD
+        VEC_T va = VEC_SET1(a);
+        for (; i + VEC_WIDTH <= n; i += VEC_WIDTH)
+                VEC_STOREU(&x[i], VEC_MUL(va, VEC_LOADU(&x[i])));
+#endif /* KERNEL_SIMD */
+        for (; i < n; i++)
+                x[i] *= a;
+}
+
+                /**********************
+                 **** thread teams ****
+                 **********************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+If multithreading is enabled, the forward and backward sweeps each run
+within a single parallel region, rather than opening a new region for each
+group (see act.c and bp.c). Inside such a region, the tiles of a group are
+divided among the threads of the team, after which the threads synchronize
+before the next group is processed.
+
+Dividing a loop among threads only pays off if the loop is large enough to
+outweigh the cost of synchronizing the threads. Hence, a loop is only
+divided among threads if its amount of work exceeds a cutoff. Cutoffs are
+calibrated when a network is initialized, by timing thread synchronization,
+the multiply-adds of the net input kernel, and a simple element-wise loop.
+For a team of T threads, and a synchronization cost of t_sync, a loop of W
+units of work with a cost of t each is divided among threads if:
+
+        W * t * (1 - 1/T) > t_sync
+
+that is, if the time saved exceeds the time spent on synchronization. If
+only a single thread is available, loops are never divided.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void kernel_calibrate_cutoffs(uint64_t *mac_cutoff, uint64_t *unit_cutoff)
+{
+        *mac_cutoff  = UINT64_MAX;
+        *unit_cutoff = UINT64_MAX;
+#ifdef _OPENMP
+        int32_t nt = omp_get_max_threads();
+        if (nt < 2)
+                return;
+        uint32_t rounds = KERNEL_CALIBRATION_ROUNDS;
+
+        /* cost of entering a parallel region and a barrier */
+        double t0 = omp_get_wtime();
+        for (uint32_t r = 0; r < rounds; r++) {
+#pragma omp parallel num_threads(nt)
+                {
+#pragma omp barrier
+                }
+        }
+        double t_sync = (omp_get_wtime() - t0) / rounds;
+
+        /* cost of a multiply-add in the net input kernel */
+        struct matrix *m = create_matrix(KERNEL_BLOCK_ROWS, KERNEL_TILE_SIZE);
+        real x[KERNEL_BLOCK_ROWS];
+        real y[KERNEL_TILE_SIZE];
+        for (uint32_t i = 0; i < KERNEL_BLOCK_ROWS; i++)
+                x[i] = 1.0;
+        for (uint32_t i = 0; i < KERNEL_TILE_SIZE; i++)
+                y[i] = 0.0;
+        t0 = omp_get_wtime();
+        for (uint32_t r = 0; r < rounds; r++)
+                kernel_gemv_trans(m, x, y, 0, KERNEL_TILE_SIZE);
+        double t_mac = (omp_get_wtime() - t0)
+                / ((double)rounds * KERNEL_BLOCK_ROWS * KERNEL_TILE_SIZE);
+        free_matrix(m);
+
+        /* cost of a unit in an element-wise loop */
+        volatile double sink = 0.0;
+        t0 = omp_get_wtime();
+        for (uint32_t r = 0; r < rounds; r++) {
+                double s = 0.0;
+                for (uint32_t i = 0; i < KERNEL_TILE_SIZE; i++)
+                        s += (y[i] - x[i % KERNEL_BLOCK_ROWS])
+                                * (y[i] - x[i % KERNEL_BLOCK_ROWS]);
+                sink += s;
+        }
+        double t_unit = (omp_get_wtime() - t0)
+                / ((double)rounds * KERNEL_TILE_SIZE);
+
+        double gain = 1.0 - 1.0 / nt;
+        if (t_mac > 0.0)
+                *mac_cutoff  = t_sync / (t_mac * gain);
+        if (t_unit > 0.0)
+                *unit_cutoff = t_sync / (t_unit * gain);
+#endif /* _OPENMP */
+}
+
+/*
+ * Determines the range [i0, i1) of n tiles that the calling thread
+ * processes. If parallel is true, tiles are divided evenly among the
+ * threads of the current team. Otherwise, the first thread processes all
+ * tiles.
+ */
+void kernel_team_range(uint32_t n, bool parallel, uint32_t *i0,
+        uint32_t *i1)
+{
+        *i0 = 0;
+        *i1 = n;
+#ifdef _OPENMP
+        uint32_t nt = omp_get_num_threads();
+        uint32_t t  = omp_get_thread_num();
+        if (!parallel) {
+                if (t > 0)
+                        *i1 = 0;
+                return;
+        }
+        *i0 = (uint64_t)n * t / nt;
+        *i1 = (uint64_t)n * (t + 1) / nt;
+#endif /* _OPENMP */
+}
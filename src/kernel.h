@@ -0,0 +1,70 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "matrix.h"
+#include "real.h"
+#include "vector.h"
+
+/*
+ * Number of columns (or rows) that are processed as one tile. This is a
+ * multiple of the matrix alignment, so that each tile starts on an aligned
+ * boundary.
+ */
+#define KERNEL_TILE_SIZE 256
+
+/*
+ * Number of matrix rows that batch kernels keep in cache while processing
+ * all rows of a batch.
+ */
+#define KERNEL_BLOCK_ROWS 32
+
+/*
+ * Number of repetitions of each micro-benchmark when calibrating cutoffs
+ * for multithreading.
+ */
+#define KERNEL_CALIBRATION_ROUNDS 100
+
+void kernel_gemv_trans(struct matrix *m, real *x, real *y,
+        uint32_t c0, uint32_t c1);
+void kernel_gemv_trans_block(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1);
+void kernel_gemv_trans_sparse(struct matrix *m, struct sparse_vector *x,
+        real *y, uint32_t c0, uint32_t c1);
+void kernel_gemv(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1);
+void kernel_ger(struct matrix *m, real *x, real *y,
+        uint32_t r0, uint32_t r1);
+void kernel_gemm(struct matrix *a, struct matrix *w, struct matrix *c,
+        uint32_t nr, uint32_t c0, uint32_t c1);
+void kernel_gemm_nt(struct matrix *d, struct matrix *w, struct matrix *c,
+        uint32_t nr, uint32_t r0, uint32_t r1);
+void kernel_gemm_tn(struct matrix *y, struct matrix *d, struct matrix *g,
+        uint32_t nr, uint32_t r0, uint32_t r1);
+real kernel_max(real *x, uint32_t n);
+real kernel_dot(real *x, real *y, uint32_t n);
+void kernel_scale(real *x, real a, uint32_t n);
+
+void kernel_calibrate_cutoffs(uint64_t *mac_cutoff, uint64_t *unit_cutoff);
+void kernel_team_range(uint32_t n, bool parallel, uint32_t *i0,
+        uint32_t *i1);
+
+#endif /* KERNEL_H */
@@ -27,6 +27,7 @@
 #include "help.h"
 #include "main.h"
 #include "math.h"
+#include "real.h"
 #include "session.h"
 
 int main(int argc, char **argv)
@@ -35,6 +36,9 @@ int main(int argc, char **argv)
 #ifdef FAST_EXP
         print_fast_exp_status();
 #endif /* FAST_EXP */
+#ifdef SINGLE_PRECISION
+        print_single_precision_status();
+#endif /* SINGLE_PRECISION */
 #ifdef _OPENMP
         print_openmp_status();
 #endif /* _OPENMP */
@@ -79,6 +83,14 @@ void print_fast_exp_status()
 }
 #endif /* FAST_EXP */
 
+#ifdef SINGLE_PRECISION
+void print_single_precision_status()
+{
+        cprintf("+ [ SinglePrecision ]: Using %zu-byte floating point numbers\n",
+                sizeof(real));
+}
+#endif /* SINGLE_PRECISION */
+
 #ifdef _OPENMP
 void print_openmp_status()
 {
@@ -26,6 +26,10 @@
 void print_fast_exp_status();
 #endif /* FAST_EXP */
 
+#ifdef SINGLE_PRECISION
+void print_single_precision_status();
+#endif /* SINGLE_PRECISION */
+
 #ifdef _OPENMP
 void print_openmp_status();
 #endif /* _OPENMP */
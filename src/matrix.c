@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,14 +32,28 @@ struct matrix *create_matrix(uint32_t rows, uint32_t cols)
         m->rows = rows;
         m->cols = cols;
 
-        if (!(m->elements = malloc(m->rows * sizeof(double *))))
+        /*
+         * Pad rows to a multiple of the alignment, so that each row starts
+         * on an aligned boundary.
+         */
+        uint32_t epa = MATRIX_ALIGNMENT / sizeof(real);
+        m->stride = ((cols + epa - 1) / epa) * epa;
+
+        size_t block_size = matrix_block_size(m) * sizeof(real);
+        if (block_size == 0)
+                block_size = MATRIX_ALIGNMENT;
+        int32_t err;
+        if ((err = posix_memalign((void **)&m->data, MATRIX_ALIGNMENT,
+                block_size)) != 0) {
+                errno = err;
                 goto error_out;
-        memset(m->elements, 0, m->rows * sizeof(double *));
-        for (uint32_t i = 0; i < m->rows; i++) {
-                if (!(m->elements[i] = malloc(m->cols * sizeof(double))))
-                        goto error_out;
-                memset(m->elements[i], 0, m->cols * sizeof(double));
         }
+        memset(m->data, 0, block_size);
+
+        if (!(m->elements = malloc(m->rows * sizeof(real *))))
+                goto error_out;
+        for (uint32_t i = 0; i < m->rows; i++)
+                m->elements[i] = matrix_row(m, i);
 
         return m;
 
@@ -49,9 +64,10 @@ error_out:
 
 void free_matrix(struct matrix *m)
 {
-        for (uint32_t i = 0; i < m->rows; i++)
-                free(m->elements[i]);
+        free(m->dirty);
+        free(m->dirty_rows);
         free(m->elements);
+        free(m->data);
         free(m);
 }
 
@@ -60,45 +76,111 @@ void copy_matrix(struct matrix *sm, struct matrix *dm)
         if(sm->rows != dm->rows || sm->cols != dm->cols)
                 return;
 
-        for (uint32_t i = 0; i < sm->rows; i++)
-                for (uint32_t j = 0; j < sm->cols; j++)
-                        dm->elements[i][j] = sm->elements[i][j];
+        memcpy(dm->data, sm->data, matrix_block_size(sm) * sizeof(real));
+        mark_matrix_rows(dm);
+}
+
+/*
+ * Swaps the blocks (and tracked rows) of two matrices of equal dimensions,
+ * such that all references to either matrix remain valid.
+ */
+void swap_matrices(struct matrix *m1, struct matrix *m2)
+{
+        struct matrix m = *m1;
+        *m1 = *m2;
+        *m2 = m;
+}
+
+/*
+ * Starts tracking the dirty rows of matrix m. As its current elements are
+ * unknown, all rows count as dirty until m is zeroed out.
+ */
+void track_matrix_rows(struct matrix *m)
+{
+        if (m->dirty)
+                return;
+        if (!(m->dirty = malloc(m->rows * sizeof(bool))))
+                goto error_out;
+        memset(m->dirty, 0, m->rows * sizeof(bool));
+        if (!(m->dirty_rows = malloc(m->rows * sizeof(uint32_t))))
+                goto error_out;
+        m->num_dirty = 0;
+        m->all_dirty = true;
+
+        return;
+
+error_out:
+        perror("[track_matrix_rows()]");
+        return;
 }
 
+/*
+ * Flags all rows of matrix m as clean. This is called once the caller has
+ * zeroed out all (dirty) rows itself.
+ */
+void clean_matrix_rows(struct matrix *m)
+{
+        if (!m->dirty)
+                return;
+        if (m->all_dirty)
+                memset(m->dirty, 0, m->rows * sizeof(bool));
+        else
+                for (uint32_t i = 0; i < m->num_dirty; i++)
+                        m->dirty[m->dirty_rows[i]] = false;
+        m->num_dirty = 0;
+        m->all_dirty = false;
+}
+
+/*
+ * Zeroes out matrix m. If the rows of m are tracked, only its dirty rows
+ * are zeroed out.
+ */
 void zero_out_matrix(struct matrix *m)
 {
-        for (uint32_t i = 0; i < m->rows; i++)
-                for (uint32_t j = 0; j < m->cols; j++)
-                        m->elements[i][j] = 0.0;
+        if (matrix_rows_sparse(m)) {
+                for (uint32_t i = 0; i < m->num_dirty; i++)
+                        memset(matrix_row(m, m->dirty_rows[i]), 0,
+                                m->stride * sizeof(real));
+        } else {
+                memset(m->data, 0, matrix_block_size(m) * sizeof(real));
+        }
+        clean_matrix_rows(m);
 }
 
 void fill_matrix_with_value(struct matrix *m, double val)
 {
-        for (uint32_t i = 0; i < m->rows; i++)
+        /* leave padding untouched */
+        for (uint32_t i = 0; i < m->rows; i++) {
+                real *row = matrix_row(m, i);
                 for (uint32_t j = 0; j < m->cols; j++)
-                        m->elements[i][j] = val;
+                        row[j] = val;
+        }
 }
 
 double matrix_minimum(struct matrix *m)
 {
-        double min = m->elements[0][0];
+        double min = m->data[0];
 
-        for (uint32_t i = 0; i < m->rows; i++)
+        for (uint32_t i = 0; i < m->rows; i++) {
+                real *row = matrix_row(m, i);
                 for (uint32_t j = 0; j < m->cols; j++)
-                        if (m->elements[i][j] < min)
-                                min = m->elements[i][j];
+                        if (row[j] < min)
+                                min = row[j];
+        }
 
         return min;
 }
 
 double matrix_maximum(struct matrix *m)
 {
-        double max = m->elements[0][0];
+        double max = m->data[0];
 
-        for (uint32_t i = 0; i < m->rows; i++)
+        for (uint32_t i = 0; i < m->rows; i++) {
+                real *row = matrix_row(m, i);
                 for (uint32_t j = 0; j < m->cols; j++)
-                        if (m->elements[i][j] > max)
-                                max = m->elements[i][j];
+                        if (row[j] > max)
+                                max = row[j];
+        }
 
         return max;
 }
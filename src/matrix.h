@@ -17,18 +17,54 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "real.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Matrices are stored row-major in a single block of memory that is aligned
+to MATRIX_ALIGNMENT bytes. Each row is padded to a multiple of the
+alignment, such that every row starts on an aligned boundary. The number of
+elements between the starts of two consecutive rows is the row stride.
+Padding elements are always zero, so that kernels may stream over entire
+rows (or the entire block) without special casing the tail of a row.
+
+For convenience, elements[i] points to the start of row i within the block,
+so that elements[i][j] addresses element (i,j).
+
+A matrix can also track which of its rows may hold non-zero elements (see
+track_matrix_rows()). This is used for gradient matrices of projections
+from groups that are clamped with sparse vectors, for which gradients only
+accumulate in the rows of the active units. Rows are flagged dirty by the
+code that writes to them, and all rows count as dirty after a dense write.
+Zeroing a tracked matrix only touches its dirty rows, after which all rows
+are clean again.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#define MATRIX_ALIGNMENT 64
+
 struct matrix
 {
         uint32_t rows;                  /* number of rows */
         uint32_t cols;                  /* number of columns */
-        double **elements;              /* elements */
+        uint32_t stride;                /* row stride (in elements) */
+        real *data;                     /* aligned block of elements */
+        real **elements;                /* row pointers into block */
+        bool *dirty;                    /* flags dirty rows (if tracked) */
+        uint32_t *dirty_rows;           /* dirty rows, in order of flagging */
+        uint32_t num_dirty;             /* number of dirty rows */
+        bool all_dirty;                 /* flags that all rows are dirty */
 };
 
 struct matrix *create_matrix(uint32_t rows, uint32_t cols);
 void free_matrix(struct matrix *m);
 void copy_matrix(struct matrix *sm, struct matrix *dm);
+void swap_matrices(struct matrix *m1, struct matrix *m2);
+
+void track_matrix_rows(struct matrix *m);
+void clean_matrix_rows(struct matrix *m);
 
 void zero_out_matrix(struct matrix *m);
 void fill_matrix_with_value(struct matrix *m, double val);
@@ -38,4 +74,38 @@ double matrix_maximum(struct matrix *m);
 
 void print_matrix(struct matrix *m);
 
+/* pointer to the first element of row r */
+static inline real *matrix_row(struct matrix *m, uint32_t r)
+{
+        return m->data + (size_t)r * m->stride;
+}
+
+/* number of elements in the block (including padding) */
+static inline size_t matrix_block_size(struct matrix *m)
+{
+        return (size_t)m->rows * m->stride;
+}
+
+/* flags row r of m as dirty (if rows are tracked) */
+static inline void mark_matrix_row(struct matrix *m, uint32_t r)
+{
+        if (!m->dirty || m->all_dirty || m->dirty[r])
+                return;
+        m->dirty[r] = true;
+        m->dirty_rows[m->num_dirty++] = r;
+}
+
+/* flags all rows of m as dirty (if rows are tracked) */
+static inline void mark_matrix_rows(struct matrix *m)
+{
+        if (m->dirty)
+                m->all_dirty = true;
+}
+
+/* whether only the rows in the dirty list of m may be non-zero */
+static inline bool matrix_rows_sparse(struct matrix *m)
+{
+        return m->dirty && !m->all_dirty;
+}
+
 #endif /* MATRIX_H */
@@ -64,7 +64,7 @@ void dss_test(struct network *n)
                 for (uint32_t j = 0; j < item->num_events; j++) {
                         if (j > 0)
                                 next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
+                        clamp_input_event(n, item, j);
                         forward_sweep(n);
                 }
 
@@ -287,7 +287,7 @@ struct matrix *dss_score_matrix(struct network *n, struct set *set,
         for (uint32_t i = 0; i < item->num_events; i++) {
                 if (i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
 
                 /*
@@ -696,7 +696,7 @@ struct matrix *dss_word_info_matrix(struct network *n,
                 }
                 if (i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
                 struct vector *tv = item->targets[item->num_events - 1];
                 dss_adjust_output_vector(ov, output_vector(n), tv,
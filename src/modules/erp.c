@@ -130,7 +130,7 @@ struct vector *erp_values_for_item(struct network *n, struct group *g,
         for (uint32_t i = 0; i < item->num_events; i++) {
                 if (i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
                 /*
                  * amplitude = 1.0 - sim(g_t, g_{t-1})
@@ -202,7 +202,7 @@ void tep_test_network_with_item(struct network *n, struct group *eg, double h,
                 copy_vector(ns, cs);
                 if (i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
                 struct group *cg = eg->ctx_groups->elements[0];
                 copy_vector(cg->vector, ns);
@@ -213,8 +213,7 @@ void tep_test_network_with_item(struct network *n, struct group *eg, double h,
                 cprintf("\n");
                 cprintf("E: %d\n", i + 1);
                 cprintf("I: ");
-                pprint ? pprint_vector(item->inputs[i], scheme)
-                       : print_vector(item->inputs[i]);
+                print_item_input(item, i, pprint, scheme);
                 if (item->targets[i]) {
                         cprintf("T: ");
                         pprint ? pprint_vector(item->targets[i], scheme)
@@ -287,7 +286,7 @@ void tep_record_units(struct network *n, struct group *eg, double h,
                         copy_vector(ns, cs);
                         if (j > 0)
                                 next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
+                        clamp_input_event(n, item, j);
                         forward_sweep(n);
                         struct group *cg = eg->ctx_groups->elements[0];
                         copy_vector(cg->vector, ns);
@@ -385,7 +384,7 @@ struct vector *tep_micro_ticks_for_item(struct network *n, struct group *eg,
                 copy_vector(ns, cs);
                 if (i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
                 struct group *cg = eg->ctx_groups->elements[0];
                 copy_vector(cg->vector, ns);
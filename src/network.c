@@ -27,11 +27,13 @@
 #include "bp.h"
 #include "defaults.h"
 #include "error.h"
+#include "kernel.h"
 #include "main.h"
 #include "math.h"
 #include "network.h"
 #include "random.h"
 #include "rnn_unfold.h"
+#include "stream.h"
 #include "train.h"
 #include "verify.h"
 
@@ -62,6 +64,7 @@ struct network *create_network(char *name, enum network_type type)
         if (!(n->status = malloc(block_size)))
                 goto error_out;
         memset(n->status, 0, block_size);
+        n->status->report = true;
 
         set_network_defaults(n);
 
@@ -116,6 +119,22 @@ void init_network(struct network *n)
         if (!verify_network(n))
                 return;
 
+        /*
+         * Compile the execution schedule of the network.
+         */
+        if (n->schedule)
+                free_array(n->schedule);
+        n->schedule = compile_schedule(n);
+
+#ifdef _OPENMP
+        /*
+         * Calibrate the minimum amount of work for which loops are divided
+         * among threads (see kernel.c).
+         */
+        kernel_calibrate_cutoffs(&n->pars->omp_mac_cutoff,
+                &n->pars->omp_unit_cutoff);
+#endif /* _OPENMP */
+
         /*
          * Randomize weights, and initialize dynamic learning parameters.
          */
@@ -124,10 +143,13 @@ void init_network(struct network *n)
 
         /* 
          * If batch size is zero, set it to the number of items in the
-         * active set.
+         * active set. If that set is streamed, set it to the number of
+         * items in a block of the stream instead, as all items of a
+         * batch are kept in memory.
          */
         if (n->pars->batch_size == 0 && n->asp)
-                n->pars->batch_size = n->asp->items->num_elements;
+                n->pars->batch_size = n->asp->stream ? STREAM_BLOCK_SIZE
+                        : n->asp->items->num_elements;
 
         /*
          * If a recurrent neural network will be trained with
@@ -149,7 +171,7 @@ void reset_network(struct network *n)
         reset_projection_matrices(n->input, n);
         randomize_weight_matrices(n->input, n);
         initialize_dynamic_params(n->input, n);
-        reset_context_groups(n, n->input);
+        reset_context_groups(n);
         reset_recurrent_groups(n);
 }
 
@@ -161,6 +183,8 @@ void free_network(struct network *n)
                 rnn_free_unfolded_network(n->unfolded_net);
         free_groups(n->groups);
         free_array(n->groups);
+        if (n->schedule)
+                free_array(n->schedule);
         free_sets(n->sets);
         free_array(n->sets);
         free(n->flags);
@@ -168,6 +192,77 @@ void free_network(struct network *n)
         free(n);
 }
 
+                /**************************
+                 **** execution schedule ****
+                 **************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+The execution schedule of a network is a flat array that contains each group
+that is reachable from the input group exactly once, in topological order:
+a group appears only after all groups that project to it. Recurrent
+projections are not followed, so that the schedule of each network in an
+unfolded stack covers only the current timestep. The input group itself is
+not part of the schedule.
+
+Executing the schedule from front to back propagates activation through the
+network (see feed_forward()), and executing it from back to front propagates
+error (see bp_backpropagate_error()). Each group is hence visited only once
+per sweep, even if it receives projections along several paths.
+
+The schedule is compiled by a depth-first traversal that appends each group
+once all groups it projects to have been appended (post-order), after which
+the resulting array is reversed.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct array *compile_schedule(struct network *n)
+{
+        struct array *schedule = create_array(atype_groups);
+        compile_schedule_group(n->input, n->input, schedule);
+
+        /* reverse post-order */
+        uint32_t ne = schedule->num_elements;
+        for (uint32_t i = 0; i < ne / 2; i++) {
+                void *e = schedule->elements[i];
+                schedule->elements[i] = schedule->elements[ne - 1 - i];
+                schedule->elements[ne - 1 - i] = e;
+        }
+
+        return schedule;
+}
+
+void compile_schedule_group(struct group *g, struct group *sg,
+        struct array *schedule)
+{
+        for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
+                struct projection *op = g->out_projs->elements[i];
+                if (op->flags->recurrent)
+                        continue;
+                /* skip groups that have already been scheduled */
+                bool scheduled = false;
+                for (uint32_t j = 0; j < schedule->num_elements; j++)
+                        if (schedule->elements[j] == op->to)
+                                scheduled = true;
+                if (!scheduled)
+                        compile_schedule_group(op->to, sg, schedule);
+        }
+        /* the start group is not part of the schedule */
+        if (g != sg)
+                add_to_array(schedule, g);
+}
+
+/*
+ * Returns the position of group g in the schedule of network n, or the
+ * length of the schedule if g is not part of it.
+ */
+uint32_t schedule_position(struct network *n, struct group *g)
+{
+        uint32_t i = 0;
+        for (; i < n->schedule->num_elements; i++)
+                if (n->schedule->elements[i] == g)
+                        break;
+        return i;
+}
+
 void inspect_network(struct network *n)
 {
                 /*****************
@@ -209,7 +304,9 @@ void inspect_network(struct network *n)
         for (uint32_t i = 0; i < n->sets->num_elements; i++) {
                 struct set *set = n->sets->elements[i];
                 if (i > 0) cprintf(", ");
-                cprintf("%s (%d)", set->name, set->items->num_elements);
+                cprintf("%s (%d)", set->name, set->stream
+                        ? set->stream->header.num_items
+                        : set->items->num_elements);
         }
         cprintf("\n");
 
@@ -232,9 +329,14 @@ void inspect_network(struct network *n)
                 cprintf("bp");
         if (n->learning_algorithm == train_network_with_bptt)
                 cprintf("bptt");
+        if (n->learning_algorithm == train_network_with_hogwild)
+                cprintf("hogwild");
         cprintf("\n");
-        if (n->learning_algorithm == train_network_with_bptt)
+        if (n->learning_algorithm == train_network_with_bptt) {
                 cprintf("| Back ticks: \t\t\t %d\n", n->pars->back_ticks);
+                cprintf("| Activation tape: \t\t ");
+                n->flags->bptt_tape ? cprintf("true\n") : cprintf("false\n");
+        }
         cprintf("| Update algorithm: \t\t ");
         if (n->update_algorithm == bp_update_sd
                 && n->flags->sd_type == SD_DEFAULT)
@@ -359,6 +461,8 @@ void inspect_network(struct network *n)
         cprintf("|\n");
         cprintf("| Multithreading enabled: \t ");
         n->flags->omp_mthreaded ? cprintf("true\n") : cprintf("false\n");
+        cprintf("| Data-parallel training: \t ");
+        n->flags->data_parallel ? cprintf("true\n") : cprintf("false\n");
         cprintf("| Processor(s) available: \t %d\n",  omp_get_num_procs());
         cprintf("| Maximum #threads: \t\t %d\n",      omp_get_max_threads());
         cprintf("| Schedule: \t\t\t ");
@@ -384,6 +488,12 @@ void inspect_network(struct network *n)
                 break;
         }
         cprintf("| Chunk size \t\t\t %d\n", m);
+        cprintf("| Parallel cutoffs: \t\t ");
+        n->pars->omp_mac_cutoff == UINT64_MAX
+                ? cprintf("none\n")
+                : cprintf("%lu multiply-adds, %lu units\n",
+                        (unsigned long)n->pars->omp_mac_cutoff,
+                        (unsigned long)n->pars->omp_unit_cutoff);
         cprintf("\n");
 #endif /* _OPENMP */
 
@@ -631,33 +741,45 @@ void reset_groups(struct network *n)
         }
 }
 
-void shift_context_groups(struct network *n, struct group *g)
+void shift_context_groups(struct network *n)
 {
-        for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
-                struct projection *op = g->out_projs->elements[i];
-                struct group *rg = op->to;
-                for (uint32_t j = 0; j < rg->ctx_groups->num_elements; j++)
-                        shift_context_group_chain(
-                                rg->ctx_groups->elements[j],
-                                rg->vector);
-                shift_context_groups(n, rg);
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                if (g->ctx_groups->num_elements > 0)
+                        shift_context_group_chain(g);
         }
 }
 
-/*
- * Shifts a context group chain. If group g has a context group c, then the
- * activity vector of g is copied into that of c. However, if c has itself a
- * context group c', then the activity pattern of c is first copied into c',
- * and so forth.
- */
-void shift_context_group_chain(struct group *g,
-                struct vector *v)
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Shifts the context group chain of group g. If g has a context group c, then
+c takes over the activity vector of g. However, if c has itself a context
+group c', then c' first takes over the activity vector of c, and so forth.
+
+Rather than copying activity vectors, the vectors of g and the groups in its
+chain form a ring that is rotated by swapping vector pointers: c' gets the
+vector of c, c that of g, and g the vector that used to be in c'. The stale
+vector that g ends up with is overwritten during the next forward sweep.
+
+If a group has more than one context group, only the first is part of the
+ring. The others are copies of the first, and hence of the vector it took
+over.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void shift_context_group_chain(struct group *g)
 {
-        for (uint32_t i = 0; i < g->ctx_groups->num_elements; i++)
-                shift_context_group_chain(
-                        g->ctx_groups->elements[i],
-                        g->vector);
-        copy_vector(v, g->vector);
+        struct group *fg = g->ctx_groups->elements[0];
+        for (uint32_t i = 0; i < g->ctx_groups->num_elements; i++) {
+                struct group *cg = g->ctx_groups->elements[i];
+                if (cg->ctx_groups->num_elements > 0)
+                        shift_context_group_chain(cg);
+                if (cg == fg) {
+                        struct vector *v = cg->vector;
+                        cg->vector = g->vector;
+                        g->vector = v;
+                } else {
+                        copy_vector(fg->vector, cg->vector);
+                }
+        }
 }
 
 /*
@@ -687,21 +809,19 @@ void reset_stack_pointer(struct network *n)
         n->unfolded_net->sp = 0;
 }
 
-void reset_context_groups(struct network *n, struct group *g)
+void reset_context_groups(struct network *n)
 {
         /*
          * If context groups should not be reset, shift the context groups.
          */
         if (n->flags->initialized && !n->flags->reset_contexts) {
-                shift_context_groups(n, n->input);
+                shift_context_groups(n);
                 return;
         }
-        for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
-                struct projection *op = g->out_projs->elements[i];
-                struct group *rg = op->to;
-                for (uint32_t j = 0; j < rg->ctx_groups->num_elements; j++)
-                        reset_context_group_chain(n, rg->ctx_groups->elements[j]);
-                reset_context_groups(n, rg);
+        for (uint32_t i = 0; i < n->schedule->num_elements; i++) {
+                struct group *g = n->schedule->elements[i];
+                for (uint32_t j = 0; j < g->ctx_groups->num_elements; j++)
+                        reset_context_group_chain(n, g->ctx_groups->elements[j]);
         }
 }
 
@@ -747,26 +867,23 @@ void reset_ffn_error_signals(struct network *n)
 void reset_rnn_error_signals(struct network *n)
 {
         struct rnn_unfolded_network *un = n->unfolded_net;
-        for (uint32_t i = 0; i < un->stack_size; i++) {
+        if (un->tape) {
+                rnn_reset_tape_errors(un);
+                return;
+        }
+        for (uint32_t i = 0; i < un->num_networks; i++) {
                 struct network *sn = un->stack[i];
                 for (uint32_t j = 0; j < sn->groups->num_elements; j++) {
                         /* reset group error */
                         struct group *g = sn->groups->elements[j];
                         zero_out_vector(g->error);
-                        /* reset error vector of "terminal" group */
-                        /*
-                        if (i > 0)
-                                continue;
-                        for (uint32_t x = 0; x < g->inc_projs->num_elements; x++) {
-                                struct projection *p = g->inc_projs->elements[x];
-                                if (p->flags->recurrent) {
-                                        print_vector(p->to->error);
-                                        zero_out_vector(p->to->error);
-                                }
-                        }
-                        */
                 }
         }
+        /* reset error vectors of "terminal" groups */
+        for (uint32_t i = 0; i < un->trm_groups->num_elements; i++) {
+                struct group *tg = un->trm_groups->elements[i];
+                zero_out_vector(tg->error);
+        }
 }
 
 struct projection *create_projection(
@@ -801,10 +918,15 @@ error_out:
 void free_projection(struct projection *p)
 {
         free_matrix(p->weights);
-        free_matrix(p->gradients);
-        free_matrix(p->prev_gradients);
-        free_matrix(p->prev_deltas);
-        free_matrix(p->dynamic_params);
+        if (p->gradients)
+                free_matrix(p->gradients);
+        if (p->prev_gradients)
+                free_matrix(p->prev_gradients);
+        if (p->prev_deltas)
+                free_matrix(p->prev_deltas);
+        if (p->dynamic_params)
+                free_matrix(p->dynamic_params);
+        free(p->row_updates);
         free(p->flags);
         free(p);
 }
@@ -816,21 +938,13 @@ void add_projection(struct array *projs, struct projection *p)
 
 void add_bidirectional_projection(struct group *fg, struct group *tg)
 {
-        /* weight matrix */
+        /*
+         * Weight matrix. The matrices that hold the state of the update
+         * algorithm are only allocated once they are needed (see
+         * adjust_projection_matrices()).
+         */
         struct matrix *weights = create_matrix(
                 fg->vector->size, tg->vector->size);
-        /* gradients matrix */
-        struct matrix *gradients = create_matrix(
-                fg->vector->size, tg->vector->size);
-        /* previous gradients matrix */
-        struct matrix *prev_gradients = create_matrix(
-                fg->vector->size, tg->vector->size);
-        /* previous weight deltas matrix */
-        struct matrix *prev_deltas = create_matrix(
-                fg->vector->size, tg->vector->size);
-        /* dynamic learning parameters matrix */
-        struct matrix *dynamic_params = create_matrix(
-                fg->vector->size, tg->vector->size);
         /* flags */
         struct projection_flags *flags;
         if (!(flags = malloc(sizeof(struct projection_flags))))
@@ -845,10 +959,10 @@ void add_bidirectional_projection(struct group *fg, struct group *tg)
                 flags->recurrent = true;
 
         /* add projections */
-        struct projection *op = create_projection(tg, weights, gradients,
-                prev_gradients, prev_deltas, dynamic_params, flags);
-        struct projection *ip = create_projection(fg, weights, gradients,
-                prev_gradients, prev_deltas, dynamic_params, flags);
+        struct projection *op = create_projection(tg, weights, NULL,
+                NULL, NULL, NULL, flags);
+        struct projection *ip = create_projection(fg, weights, NULL,
+                NULL, NULL, NULL, flags);
         add_projection(fg->out_projs, op);
         add_projection(tg->inc_projs, ip);
 
@@ -1140,7 +1254,12 @@ void print_sets(struct network *n)
         }
         for (uint32_t i = 0; i < n->sets->num_elements; i++) {
                 struct set *set = n->sets->elements[i];
-                cprintf("* %d: %s (%d)", i + 1, set->name, set->items->num_elements);
+                if (set->stream)
+                        cprintf("* %d: %s (%d, streamed)", i + 1, set->name,
+                                set->stream->header.num_items);
+                else
+                        cprintf("* %d: %s (%d)", i + 1, set->name,
+                                set->items->num_elements);
                 if (set == n->asp)
                         cprintf(" :: active set\n");
                 else
@@ -1156,9 +1275,12 @@ void reset_projection_matrices(struct group *g, struct network *n)
                 if (ip->flags->frozen)
                         continue;
                 zero_out_matrix(ip->weights);
-                zero_out_matrix(ip->gradients);
-                zero_out_matrix(ip->prev_deltas);
-                zero_out_matrix(ip->prev_gradients);
+                if (ip->gradients)
+                        zero_out_matrix(ip->gradients);
+                if (ip->prev_deltas)
+                        zero_out_matrix(ip->prev_deltas);
+                if (ip->prev_gradients)
+                        zero_out_matrix(ip->prev_gradients);
         }
         /* outgoing projections */
         for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
@@ -1197,7 +1319,8 @@ void initialize_dynamic_params(struct group *g, struct network *n)
         /* incoming projections */
         for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
                 struct projection *ip = g->inc_projs->elements[i];
-                fill_matrix_with_value(ip->dynamic_params, v);
+                if (ip->dynamic_params)
+                        fill_matrix_with_value(ip->dynamic_params, v);
         }
         /* outgoing projections */
         for (uint32_t i = 0; i < g->out_projs->num_elements; i++) {
@@ -1208,6 +1331,153 @@ void initialize_dynamic_params(struct group *g, struct network *n)
         }
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Allocate and release the matrices that hold the state of the update
+algorithm. Apart from its weights, a projection needs:
+
+        hogwild:        gradients
+        steepest:       gradients, previous weight deltas (if momentum > 0)
+        rprop:          gradients, previous gradients, previous weight
+                        deltas, dynamic learning parameters
+        qprop:          gradients, previous gradients, previous weight deltas
+        dbd:            gradients, previous gradients, previous weight
+                        deltas, dynamic learning parameters
+
+The gradient linearity statistic is computed from the previous weight
+deltas, and is therefore not reported if these are not kept.
+
+Matrices that are not needed are released. If allocate is set, missing
+matrices are allocated as well (this happens when training starts), so
+that networks that are only tested keep nothing but their weights.
+
+The (previous) gradient matrices of projections from the input group track
+their dirty rows, as their gradients are sparse if input vectors are (see
+matrix.h). For steepest descent without momentum and for Rprop, these
+projections also count the updates applied to each of their rows, so that
+rows without gradients can be skipped and decayed lazily (see bp.c).
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void adjust_projection_matrices(struct network *n, bool allocate)
+{
+        bool hogwild = n->learning_algorithm == train_network_with_hogwild;
+        bool steepest = hogwild || n->update_algorithm == bp_update_sd;
+        bool need_prev_gradients = !steepest;
+        bool need_prev_deltas = keeps_prev_deltas(n);
+        bool need_dynamic_params = !steepest
+                && (n->update_algorithm == bp_update_rprop
+                        || n->update_algorithm == bp_update_dbd);
+        bool need_row_updates = !hogwild
+                && ((steepest && n->pars->momentum == 0.0)
+                        || n->update_algorithm == bp_update_rprop);
+        double v = n->update_algorithm == bp_update_rprop
+                ? n->pars->rp_init_update : n->pars->learning_rate;
+
+        bool adjusted = false;
+        for (uint32_t i = 0; i < n->groups->num_elements; i++) {
+                struct group *g = n->groups->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *ip = g->inc_projs->elements[j];
+                        struct matrix *w = ip->weights;
+                        adjusted |= adjust_projection_matrix(
+                                &ip->gradients, w, allocate, true, 0.0);
+                        adjusted |= adjust_projection_matrix(
+                                &ip->prev_gradients, w, allocate,
+                                need_prev_gradients, 0.0);
+                        adjusted |= adjust_projection_matrix(
+                                &ip->prev_deltas, w, allocate,
+                                need_prev_deltas, 0.0);
+                        adjusted |= adjust_projection_matrix(
+                                &ip->dynamic_params, w, allocate,
+                                need_dynamic_params, v);
+                        bool input = ip->to == n->input;
+                        if (input && ip->gradients)
+                                track_matrix_rows(ip->gradients);
+                        if (input && ip->prev_gradients)
+                                track_matrix_rows(ip->prev_gradients);
+                        adjust_row_updates(ip, allocate,
+                                input && need_row_updates);
+                        /* outgoing counterpart shares the matrices */
+                        struct projection *op = find_projection(
+                                ip->to->out_projs, g);
+                        op->gradients      = ip->gradients;
+                        op->prev_gradients = ip->prev_gradients;
+                        op->prev_deltas    = ip->prev_deltas;
+                        op->dynamic_params = ip->dynamic_params;
+                }
+        }
+
+        /*
+         * The duplicate projections of an unfolded network refer to the
+         * matrices of the projections they were duplicated from, so the
+         * network needs to be unfolded again.
+         */
+        if (adjusted && n->unfolded_net) {
+                rnn_free_unfolded_network(n->unfolded_net);
+                n->unfolded_net = rnn_unfold_network(n);
+        }
+}
+
+/*
+ * Flags whether the update algorithm of network n keeps the previous weight
+ * deltas. Steepest descent only uses these for momentum, and Hogwild!
+ * training does not use them at all.
+ */
+bool keeps_prev_deltas(struct network *n)
+{
+        if (n->learning_algorithm == train_network_with_hogwild)
+                return false;
+        return n->update_algorithm != bp_update_sd
+                || n->pars->momentum != 0.0;
+}
+
+/*
+ * Releases matrix m if it is not required, or allocates it (with the
+ * dimensions of weight matrix w, and filled with value v) if it is
+ * required, missing, and allocation is requested. Returns whether m was
+ * changed.
+ */
+bool adjust_projection_matrix(struct matrix **m, struct matrix *w,
+        bool allocate, bool required, double v)
+{
+        if (*m && !required) {
+                free_matrix(*m);
+                *m = NULL;
+                return true;
+        }
+        if (!*m && required && allocate) {
+                *m = create_matrix(w->rows, w->cols);
+                if (v != 0.0)
+                        fill_matrix_with_value(*m, v);
+                return true;
+        }
+        return false;
+}
+
+/*
+ * Releases the update counts of the rows of projection p if these are not
+ * required, or allocates them if they are required, missing, and
+ * allocation is requested.
+ */
+void adjust_row_updates(struct projection *p, bool allocate, bool required)
+{
+        if (p->row_updates && !required) {
+                free(p->row_updates);
+                p->row_updates = NULL;
+        }
+        if (!p->row_updates && required && allocate) {
+                if (!(p->row_updates = calloc(p->weights->rows,
+                        sizeof(uint32_t))))
+                        goto error_out;
+                p->num_updates = 0;
+        }
+
+        return;
+
+error_out:
+        perror("[adjust_row_updates()]");
+        return;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Save and load weights. The format for weights files is:
 
@@ -1253,8 +1523,9 @@ void save_weight_matrix(struct group *g, FILE *fd)
                 fprintf(fd, "Dimensions %d %d\n",
                         ip->to->vector->size, g->vector->size);  
                 for (uint32_t r = 0; r < ip->weights->rows; r++) {
+                        real *row = matrix_row(ip->weights, r);
                         for (uint32_t c = 0; c < ip->weights->cols; c++) {
-                                fprintf(fd, "%f", ip->weights->elements[r][c]);
+                                fprintf(fd, "%f", row[c]);
                                 if (c < ip->weights->cols - 1)
                                         fprintf(fd, " ");
                         }
@@ -1369,13 +1640,14 @@ bool load_weight_matrix(FILE *fd, struct matrix *weights)
         }
         /* read the matrix values */
         for (uint32_t r = 0; r < weights->rows; r++) {
+                real *row = matrix_row(weights, r);
                 char *tokens = strtok(buf, " ");
                 for (uint32_t c = 0; c < weights->cols; c++) {
                         /* error: expected another column */
                         if (!tokens)
                                 goto error_receiving_group;
                         /* error: non-numeric input */
-                        if (sscanf(tokens, "%lf", &weights->elements[r][c]) != 1)
+                        if (sscanf(tokens, SCN_REAL, &row[c]) != 1)
                                 goto error_format;
                         tokens = strtok(NULL, " ");
                         /* error: expected no more columns */
@@ -52,6 +52,7 @@ struct network
         struct array *groups;           /* array of groups in the network */
         struct group *input;            /* input group */
         struct group *output;           /* output group */
+        struct array *schedule;         /* topologically sorted groups */
         void (*random_algorithm)
                 (struct matrix *m,
                  struct network *n);    /* randomization algorithm */
@@ -84,8 +85,10 @@ struct network_flags
         uint32_t rp_type;               /* type of Rprop */
         uint32_t training_order;        /* order of training items */
         bool dcs;                       /* flags whether DCS is enabled */
+        bool bptt_tape;                 /* flags activation-tape BPTT */
 #ifdef _OPENMP
         bool omp_mthreaded;             /* flags if multi-threading is enabled */
+        bool data_parallel;             /* flags data-parallel training */
 #endif /* _OPENMP */   
 };
 
@@ -119,6 +122,10 @@ struct network_params
         double rp_eta_minus;            /* update value decrease rate */
         double dbd_rate_increment;      /* LR increment factor for DBD */
         double dbd_rate_decrement;      /* LR decrement factor for DBD */
+#ifdef _OPENMP
+        uint64_t omp_mac_cutoff;        /* min. multiply-adds per team loop */
+        uint64_t omp_unit_cutoff;       /* min. units per team loop */
+#endif /* _OPENMP */
 };
 
 struct rnn_unfolded_network
@@ -126,8 +133,25 @@ struct rnn_unfolded_network
         struct array *rcr_groups;       /* recurrent groups */
         struct array *trm_groups;       /* "terminal" groups */
         uint32_t stack_size;            /* stack size */
-        struct network **stack;         /* network stack */
+        uint32_t num_networks;          /* number of networks on the stack */
+        struct network **stack;         /* network stack (ring buffer) */
+        uint32_t head;                  /* stack head (stack/0) */
         uint32_t sp;                    /* stack pointer */
+        struct group **rcr_stack;       /* recurrent groups on the stack */
+        struct projection **rcr_projs;  /* and their recurrent projections */
+        struct rnn_tape *tape;          /* activation tape (if any) */
+};
+
+struct rnn_tape
+{
+        struct array *groups;           /* groups on the tape */
+        uint32_t *rcr_index;            /* tape index of recurrent groups */
+        size_t size;                    /* number of elements on the tape */
+        real *vector_data;              /* activation vectors */
+        real *error_data;               /* error vectors */
+        real **vectors;                 /* vectors (ticks x groups) */
+        real **errors;                  /* errors (ticks x groups) */
+        struct sparse_vector **sparse;  /* sparse input of each tick */
 };
 
                 /***************
@@ -138,6 +162,7 @@ struct group
 {
         char *name;                     /* name of the group */
         struct vector *vector;          /* the "neurons" of this group */
+        struct sparse_vector *sparse;   /* sparse clamped vector (if any) */
         struct vector *error;           /* error vector for this group */
         struct act_fun *act_fun;        /* activation functions */
         struct err_fun *err_fun;        /* error functions */
@@ -174,6 +199,8 @@ struct projection
         struct matrix *prev_gradients;  /* previous gradients */
         struct matrix *prev_deltas;     /* previous weight deltas */
         struct matrix *dynamic_params;  /* update values (Rprop) or LRs (DBD) */
+        uint32_t *row_updates;          /* updates applied to each row */
+        uint32_t num_updates;           /* number of updates */
         struct projection_flags *flags; /* flags */
 };
 
@@ -189,12 +216,11 @@ struct projection_flags
 
 struct act_fun 
 {
-        double (*fun)
-                (struct group *g,
-                 uint32_t i);           /* activation function  */
-        double (*deriv)
+        void (*fun)
+                (struct group *g);      /* activation function  */
+        void (*deriv)
                 (struct group *g,
-                 uint32_t i);           /* activation function derivative */
+                 struct vector *e);     /* activation function derivative */
 };
 
                 /************************
@@ -226,6 +252,7 @@ struct status
         double gradient_linearity;      /* gradient linearity */
         double last_deltas_length;      /* length of last weight changes vector */
         double gradients_length;        /* length of weight gradients vector */
+        bool report;                    /* flags computation of statistics */
 };
 
 struct network *create_network(char *name, enum network_type type);
@@ -235,6 +262,11 @@ void reset_network(struct network *n);
 void free_network(struct network *n);
 void inspect_network(struct network *n);
 
+struct array *compile_schedule(struct network *n);
+void compile_schedule_group(struct group *g, struct group *sg,
+        struct array *schedule);
+uint32_t schedule_position(struct network *n, struct group *g);
+
 struct group *create_group(char *name, uint32_t size, bool bias,
         bool recurrent);
 struct group *create_bias_group(char *name);
@@ -246,12 +278,12 @@ void remove_group(struct network *n, struct group *g);
 void print_groups(struct network *n);
 void reset_groups(struct network *n);
 
-void shift_context_groups(struct network *n, struct group *g);
-void shift_context_group_chain(struct group *g, struct vector *v);
+void shift_context_groups(struct network *n);
+void shift_context_group_chain(struct group *g);
 void shift_pointer_or_stack(struct network *n);
 
 void reset_stack_pointer(struct network *n);
-void reset_context_groups(struct network *n, struct group *g);
+void reset_context_groups(struct network *n);
 void reset_context_group_chain(struct network *n, struct group *g);
 void reset_recurrent_groups(struct network *n);
 void reset_ffn_error_signals(struct network *n);
@@ -291,6 +323,11 @@ void print_sets(struct network *n);
 void reset_projection_matrices(struct group *g, struct network *n);
 void randomize_weight_matrices(struct group *g, struct network *n);
 void initialize_dynamic_params(struct group *g, struct network *n);
+void adjust_projection_matrices(struct network *n, bool allocate);
+bool keeps_prev_deltas(struct network *n);
+bool adjust_projection_matrix(struct matrix **m, struct matrix *w,
+        bool allocate, bool required, double v);
+void adjust_row_updates(struct projection *p, bool allocate, bool required);
 
 bool save_weight_matrices(struct network *n, char *filename);
 void save_weight_matrix(struct group *g, FILE *fd);
@@ -30,6 +30,21 @@ void pprint_vector(struct vector *v, enum color_scheme scheme)
         cprintf("\n");
 }
 
+void pprint_sparse_vector(struct sparse_vector *v, enum color_scheme scheme)
+{
+        double min = sparse_vector_minimum(v);
+        double max = sparse_vector_maximum(v);
+        if (min > 0.0)
+                min = 0.0;
+        for (uint32_t i = 0, k = 0; i < v->size; i++) {
+                double x = 0.0;
+                if (k < v->num_elements && v->indices[k] == i)
+                        x = v->elements[k++];
+                value_as_color(scale_value(x, min, max), scheme);
+        }
+        cprintf("\n");
+}
+
 void pprint_matrix(struct matrix *m, enum color_scheme scheme)
 {
         double min = matrix_minimum(m);
@@ -55,6 +55,7 @@ const static uint32_t PALETTE_GRAY_ORANGE[10] =
         {220, 221, 222, 223, 224, 255, 253, 251, 249, 247};
 
 void pprint_vector(struct vector *v, enum color_scheme scheme);
+void pprint_sparse_vector(struct sparse_vector *v, enum color_scheme scheme);
 void pprint_matrix(struct matrix *m, enum color_scheme scheme);
 
 double scale_value(double v, double min, double max);
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REAL_H
+#define REAL_H
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Numeric type of the elements of vectors and matrices. By default, elements
+are double precision floating point numbers. If SINGLE_PRECISION is defined,
+they are single precision floating point numbers instead, which halves the
+memory footprint of networks and sets, and doubles the number of elements
+that fit in a vector register.
+
+Note: Parameters, error measures, and statistics are always represented in
+double precision.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef SINGLE_PRECISION
+typedef float real;
+#define SCN_REAL "%f"
+#else
+typedef double real;
+#define SCN_REAL "%lf"
+#endif /* SINGLE_PRECISION */
+
+#endif /* REAL_H */
@@ -17,8 +17,11 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "engine.h"
+#include "evaluate.h"
 #include "main.h"
 #include "record.h"
 
@@ -43,28 +46,59 @@ void record_units(struct network *n, struct group *g, char *filename)
         for (uint32_t u = 0; u < g->vector->size; u++)
                 fprintf(fd, ",\"Unit%d\"", u + 1);
         fprintf(fd, "\n");
-        for (uint32_t i = 0; i < n->asp->items->num_elements; i++) {
-                if (!keep_running) {
-                        keep_running = true;
-                        goto out;
+
+        /*
+         * Record items in chunks: the items of a chunk are recorded in
+         * parallel (see evaluate.c), and then written to file in item
+         * order.
+         */
+        struct recording rec;
+        rec.group_index = 0;
+        while (n->groups->elements[rec.group_index] != g)
+                rec.group_index++;
+        if (!(rec.vectors = malloc(RECORD_CHUNK_SIZE * sizeof(real *))))
+                goto error_out;
+        struct evaluator *e;
+        if (!(e = create_evaluator(n)))
+                goto out;
+        uint32_t ni = n->asp->items->num_elements;
+        uint32_t us = g->vector->size;
+        for (rec.first = 0; rec.first < ni; rec.first += RECORD_CHUNK_SIZE) {
+                uint32_t last = rec.first + RECORD_CHUNK_SIZE;
+                if (last > ni)
+                        last = ni;
+                for (uint32_t i = rec.first; i < last; i++) {
+                        struct item *item = n->asp->items->elements[i];
+                        if (!(rec.vectors[i - rec.first] = malloc(
+                                item->num_events * us * sizeof(real))))
+                                goto error_out;
                 }
-                struct item *item = n->asp->items->elements[i];
-                reset_ticks(n);
-                for (uint32_t j = 0; j < item->num_events; j++) {
-                        if (j > 0)
-                                next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
-                        forward_sweep(n);
-                        fprintf(fd, "%d,\"%s\",\"%s\",%d,%s",
-                                i + 1, item->name, item->meta, j + 1, g->name);
-                        for (uint32_t u = 0; u < g->vector->size; u++)
-                                fprintf(fd, ",%f", g->vector->elements[u]);
-                        fprintf(fd, "\n");                        
+                bool done = evaluate_items(e, rec.first, last,
+                        record_item_event, &rec, &keep_running);
+                for (uint32_t i = rec.first; i < last && done; i++) {
+                        struct item *item = n->asp->items->elements[i];
+                        real *v = rec.vectors[i - rec.first];
+                        for (uint32_t j = 0; j < item->num_events; j++) {
+                                fprintf(fd, "%d,\"%s\",\"%s\",%d,%s",
+                                        i + 1, item->name, item->meta, j + 1,
+                                        g->name);
+                                for (uint32_t u = 0; u < us; u++)
+                                        fprintf(fd, ",%f", v[j * us + u]);
+                                fprintf(fd, "\n");
+                        }
+                        pprintf("%d: %s\n", i + 1, item->name);
+                }
+                for (uint32_t i = rec.first; i < last; i++)
+                        free(rec.vectors[i - rec.first]);
+                if (!done) {
+                        keep_running = true;
+                        break;
                 }
-                pprintf("%d: %s\n", i + 1, item->name);
         }
+        free_evaluator(e);
 
 out:
+        free(rec.vectors);
         fclose(fd);
 
         sa.sa_handler = SIG_DFL;
@@ -77,6 +111,18 @@ error_out:
         return;
 }
 
+/*
+ * Stores the unit vector of the recorded group for event j of item i.
+ */
+void record_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data)
+{
+        struct recording *rec = data;
+        struct group *g = n->groups->elements[rec->group_index];
+        memcpy(&rec->vectors[i - rec->first][j * g->vector->size],
+                g->vector->elements, g->vector->size * sizeof(real));
+}
+
 void record_signal_handler(int32_t signal)
 {
         cprintf("(interrupted): Abort [y/n]? ");
@@ -20,8 +20,28 @@
 #include <stdint.h>
 
 #include "network.h"
+#include "real.h"
+#include "set.h"
+
+/*
+ * Number of items whose recordings are kept in memory before they are
+ * written to file.
+ */
+#define RECORD_CHUNK_SIZE 1024
+
+/*
+ * Recorded unit vectors, indexed by item and event.
+ */
+struct recording
+{
+        uint32_t group_index;           /* index of recorded group */
+        uint32_t first;                 /* first item of chunk */
+        real **vectors;                 /* unit vectors per item */
+};
 
 void record_units(struct network *n, struct group *g, char *filename);
+void record_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data);
 void record_signal_handler(int32_t signal);
 
 #endif /* RECORD_H */
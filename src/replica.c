@@ -0,0 +1,200 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "replica.h"
+#include "rnn_unfold.h"
+
+                /******************
+                 **** replicas ****
+                 ******************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+A replica of a network is a copy of its processing state that shares all
+of its trainable parameters. Each group of the network is duplicated with
+its own unit and error vectors, and each projection with its own gradient
+matrix. Weights, previous weight deltas, dynamic learning parameters, flags,
+parameters, and sets are shared with the original network. Hence, a replica
+can process items independently of the network (e.g., in a different
+thread), as long as the weights are not changed while it does so. If the
+network is unfolded for backpropagation through time, the replica has its
+own unfolded network as well.
+
+Groups and projections are duplicated in the order in which they occur in
+the original network, such that corresponding groups are found at the same
+positions in both group arrays, and corresponding projections at the same
+positions in the projection arrays of corresponding groups.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct network *create_replica(struct network *n)
+{
+        struct network *r;
+        if (!(r = malloc(sizeof(struct network))))
+                goto error_out;
+        memcpy(r, n, sizeof(struct network));
+
+        /* duplicate groups */
+        r->groups = create_array(atype_groups);
+        for (uint32_t i = 0; i < n->groups->num_elements; i++) {
+                struct group *g = n->groups->elements[i];
+                struct group *rg;
+                if (!(rg = malloc(sizeof(struct group))))
+                        goto error_out;
+                memcpy(rg, g, sizeof(struct group));
+                rg->sparse     = NULL;
+                rg->vector     = create_vector(g->vector->size);
+                rg->error      = create_vector(g->error->size);
+                rg->inc_projs  = create_array(atype_projs);
+                rg->out_projs  = create_array(atype_projs);
+                rg->ctx_groups = create_array(atype_groups);
+                copy_vector(g->vector, rg->vector);
+                add_to_array(r->groups, rg);
+        }
+        r->input  = replica_group(n, r, n->input);
+        r->output = replica_group(n, r, n->output);
+
+        /*
+         * Duplicate incoming projections, each with its own gradient
+         * matrix, and outgoing projections that share the gradient matrix
+         * of their incoming counterpart.
+         */
+        for (uint32_t i = 0; i < n->groups->num_elements; i++) {
+                struct group *g  = n->groups->elements[i];
+                struct group *rg = r->groups->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *ip = g->inc_projs->elements[j];
+                        struct matrix *gradients = NULL;
+                        if (ip->gradients)
+                                gradients = create_matrix(
+                                        ip->weights->rows, ip->weights->cols);
+                        if (ip->gradients && ip->gradients->dirty)
+                                track_matrix_rows(gradients);
+                        add_projection(rg->inc_projs, create_projection(
+                                replica_group(n, r, ip->to), ip->weights,
+                                gradients, NULL, ip->prev_deltas,
+                                ip->dynamic_params, ip->flags));
+                }
+                for (uint32_t j = 0; j < g->ctx_groups->num_elements; j++)
+                        add_to_array(rg->ctx_groups, replica_group(
+                                n, r, g->ctx_groups->elements[j]));
+        }
+        for (uint32_t i = 0; i < n->groups->num_elements; i++) {
+                struct group *g  = n->groups->elements[i];
+                struct group *rg = r->groups->elements[i];
+                for (uint32_t j = 0; j < g->out_projs->num_elements; j++) {
+                        struct projection *op = g->out_projs->elements[j];
+                        struct group *tg = replica_group(n, r, op->to);
+                        struct projection *ip = find_projection(
+                                tg->inc_projs, rg);
+                        add_projection(rg->out_projs, create_projection(
+                                tg, op->weights, ip->gradients, NULL,
+                                op->prev_deltas, op->dynamic_params,
+                                op->flags));
+                }
+        }
+
+        r->schedule = compile_schedule(r);
+        if (n->unfolded_net)
+                r->unfolded_net = rnn_unfold_network(r);
+
+        return r;
+
+error_out:
+        perror("[create_replica()]");
+        return NULL;
+}
+
+void free_replica(struct network *r)
+{
+        if (r->unfolded_net)
+                rnn_free_unfolded_network(r->unfolded_net);
+        for (uint32_t i = 0; i < r->groups->num_elements; i++) {
+                struct group *rg = r->groups->elements[i];
+                free_vector(rg->vector);
+                free_vector(rg->error);
+                for (uint32_t j = 0; j < rg->inc_projs->num_elements; j++) {
+                        struct projection *ip = rg->inc_projs->elements[j];
+                        if (ip->gradients)
+                                free_matrix(ip->gradients);
+                        free(ip);
+                }
+                free_array(rg->inc_projs);
+                for (uint32_t j = 0; j < rg->out_projs->num_elements; j++)
+                        free(rg->out_projs->elements[j]);
+                free_array(rg->out_projs);
+                free_array(rg->ctx_groups);
+                free(rg);
+        }
+        free_array(r->groups);
+        free_array(r->schedule);
+        free(r);
+}
+
+/*
+ * Returns the group in replica r that corresponds to group g of network n.
+ */
+struct group *replica_group(struct network *n, struct network *r,
+        struct group *g)
+{
+        for (uint32_t i = 0; i < n->groups->num_elements; i++)
+                if (n->groups->elements[i] == g)
+                        return r->groups->elements[i];
+        return NULL;
+}
+
+/*
+ * Adds the gradients of replica r to those of network n, and resets the
+ * gradients of r. If r is unfolded, its unfolded network accumulates its
+ * gradients directly into those of r (see rnn_unfold.c). If the dirty rows
+ * of a gradient matrix of r are tracked, only these rows are added.
+ */
+void replica_add_and_reset_gradients(struct network *n, struct network *r)
+{
+        for (uint32_t i = 0; i < n->groups->num_elements; i++) {
+                struct group *g  = n->groups->elements[i];
+                struct group *rg = r->groups->elements[i];
+                for (uint32_t j = 0; j < g->inc_projs->num_elements; j++) {
+                        struct projection *p  = g->inc_projs->elements[j];
+                        struct projection *rp = rg->inc_projs->elements[j];
+                        struct matrix *m = rp->gradients;
+                        if (matrix_rows_sparse(m)) {
+                                for (uint32_t x = 0; x < m->num_dirty; x++) {
+                                        uint32_t row = m->dirty_rows[x];
+                                        real *gr  = matrix_row(p->gradients,
+                                                row);
+                                        real *rgr = matrix_row(m, row);
+                                        for (uint32_t y = 0; y < m->cols; y++) {
+                                                gr[y] += rgr[y];
+                                                rgr[y] = 0.0;
+                                        }
+                                        mark_matrix_row(p->gradients, row);
+                                }
+                                clean_matrix_rows(m);
+                                continue;
+                        }
+                        size_t bs = matrix_block_size(p->gradients);
+                        for (size_t x = 0; x < bs; x++) {
+                                p->gradients->data[x] += m->data[x];
+                                m->data[x] = 0.0;
+                        }
+                        clean_matrix_rows(m);
+                        mark_matrix_rows(p->gradients);
+                }
+        }
+}
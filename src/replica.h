@@ -0,0 +1,30 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <stdint.h>
+
+#include "network.h"
+
+struct network *create_replica(struct network *n);
+void free_replica(struct network *r);
+struct group *replica_group(struct network *n, struct network *r,
+        struct group *g);
+void replica_add_and_reset_gradients(struct network *n, struct network *r);
+
+#endif /* REPLICA_H */
@@ -67,8 +67,10 @@ recurrent projections:
                                                               | input1  |
                                                               +---------+
 
-Note: Weight matrices, previous weight delta matrices, and dynamic learning
-parameter matrices are shared among recurrent projections.
+Note: All matrices of the projections in the unfolded network are shared
+with the projections of the original network. Gradients are therefore
+summed over timesteps as error is backpropagated, and the weights are
+adjusted by applying the update algorithm to the original network.
 
 References
 
@@ -97,40 +99,75 @@ struct rnn_unfolded_network *rnn_unfold_network(struct network *n)
                 struct group *rg = un->rcr_groups->elements[i];
                 struct group *tg = rnn_duplicate_group(rg);
                 add_to_array(un->trm_groups, tg);
+                /* its recurrent projection is attached below */
+                struct projection *rp = find_projection(rg->out_projs, rg);
+                add_projection(tg->out_projs,
+                        rnn_duplicate_projection(NULL, rp));
         }
 
         /* 
          * Allocate a stack for duplicate networks. The size of this stack
          * should be equal to the desired number of back ticks plus one
-         * (current timestep plus history).
+         * (current timestep plus history). If activation-tape BPTT is
+         * enabled, the stack holds a single network, and the history is
+         * recorded on a tape instead (see below).
          */
         un->stack_size = n->pars->back_ticks + 1;
-        size_t block_size = un->stack_size * sizeof(struct network *);
+        un->num_networks = n->flags->bptt_tape ? 1 : un->stack_size;
+        size_t block_size = un->num_networks * sizeof(struct network *);
         if (!(un->stack = malloc(block_size)))
                 goto error_out;
         memset(un->stack, 0, block_size);
 
         /*
-         * Fill the stack with duplicate networks. The first network on the
-         * stack is attached a "terminal" recurrent group. All other
-         * networks are connected to the network that precedes them on the
-         * stack.
+         * Allocate tables for the recurrent groups of each network on the
+         * stack, and for their incoming recurrent projections, such that
+         * these can be resolved by index.
+         */
+        uint32_t nr = un->rcr_groups->num_elements;
+        block_size = (size_t)un->num_networks * nr * sizeof(struct group *);
+        if (!(un->rcr_stack = malloc(block_size)))
+                goto error_out;
+        memset(un->rcr_stack, 0, block_size);
+        block_size = (size_t)un->num_networks * nr
+                * sizeof(struct projection *);
+        if (!(un->rcr_projs = malloc(block_size)))
+                goto error_out;
+        memset(un->rcr_projs, 0, block_size);
+
+        /* 
+         * Fill the stack with duplicate networks, and find their recurrent
+         * groups.
          */
-        for (uint32_t i = 0; i < un->stack_size; i++) {
+        for (uint32_t i = 0; i < un->num_networks; i++) {
                 un->stack[i] = rnn_duplicate_network(n);
                 un->stack[i]->unfolded_net = un; /* <- unfolded network */
-                if (i == 0) {
-                        /* attach "terminal" groups */
-                        rnn_attach_terminal_groups(un,
-                                un->stack[i]);
-                } else {
-                        /* connect duplicate networks */
-                        rnn_connect_duplicate_networks(un,
-                                un->stack[i - 1],
-                                un->stack[i]);
+                for (uint32_t j = 0; j < nr; j++) {
+                        struct group *rg = un->rcr_groups->elements[j];
+                        un->rcr_stack[i * nr + j] = find_array_element_by_name(
+                                un->stack[i]->groups, rg->name);
                 }
         }
 
+        /*
+         * Connect each network on the stack to the network that precedes
+         * it, such that the stack forms a ring, and attach the "terminal"
+         * recurrent groups to the first network on the stack.
+         */
+        for (uint32_t i = 0; i < un->num_networks; i++)
+                rnn_connect_duplicate_networks(un,
+                        (i + un->num_networks - 1) % un->num_networks, i);
+        rnn_attach_terminal_groups(un);
+
+        /*
+         * Record the activation and error vectors of each timestep on a
+         * tape, if activation-tape BPTT is enabled.
+         */
+        if (n->flags->bptt_tape) {
+                un->tape = rnn_create_tape(un);
+                rnn_load_tape(un, 0);
+        }
+
         return un;
 
 error_out:
@@ -150,21 +187,42 @@ void rnn_find_recurrent_groups(struct group *g, struct array *rcr_groups)
         }
 }
 
+/*
+ * Note: The recurrent projections between the networks on the stack, and
+ * those of the "terminal" groups are freed along with the groups they
+ * belong to.
+ */
 void rnn_free_unfolded_network(struct rnn_unfolded_network *un)
 {
-        rnn_detach_terminal_groups(un, un->stack[0]);
-        for (uint32_t i = 1; i < un->stack_size; i++)
-                rnn_disconnect_duplicate_networks(un,
-                        un->stack[i - 1],
-                        un->stack[i]);
+        if (un->tape)
+                rnn_free_tape(un);
+        for (uint32_t i = 0; i < un->trm_groups->num_elements; i++)
+                rnn_free_duplicate_group(un->trm_groups->elements[i]);
         free_array(un->rcr_groups);
         free_array(un->trm_groups);
-        for (uint32_t i = 0; i < un->stack_size; i++)
+        for (uint32_t i = 0; i < un->num_networks; i++)
                 rnn_free_duplicate_network(un->stack[i]);
         free(un->stack);
+        free(un->rcr_stack);
+        free(un->rcr_projs);
         free(un);
 }
 
+/*
+ * Returns the network at position i of the stack, where stack/0 is the
+ * network at the head of the ring. If activation-tape BPTT is enabled, the
+ * vectors of timestep i are loaded into the single network on the stack.
+ */
+struct network *rnn_stack_network(struct rnn_unfolded_network *un,
+        uint32_t i)
+{
+        if (un->tape) {
+                rnn_load_tape(un, i);
+                return un->stack[0];
+        }
+        return un->stack[(un->head + i) % un->stack_size];
+}
+
 struct network *rnn_duplicate_network(struct network *n)
 {
         struct network *dn;
@@ -177,6 +235,9 @@ struct network *rnn_duplicate_network(struct network *n)
         dn->groups = create_array(atype_groups);
         rnn_duplicate_groups(n, dn, n->input);
 
+        /* compile the execution schedule of the duplicate network */
+        dn->schedule = compile_schedule(dn);
+
         return dn;
 
 error_out:
@@ -188,6 +249,7 @@ void rnn_free_duplicate_network(struct network *dn)
 {
         rnn_free_duplicate_groups(dn->groups);
         free_array(dn->groups);
+        free_array(dn->schedule);
         free(dn);
 }
 
@@ -247,18 +309,13 @@ struct group *rnn_duplicate_groups(struct network *n, struct network *dn,
                 }
                 /*
                  * Duplicate the projection between the current group and
-                 * its bias group. We only need a unique gradient and
-                 * previous gradient matrix.
+                 * its bias group.
                  */                
-                struct matrix *gradients =
-                        create_matrix(1, g->vector->size);
-                struct matrix *prev_gradients =
-                        create_matrix(1, g->vector->size);
                 add_to_array(dg->inc_projs, rnn_duplicate_projection(
-                        dbg, ip, gradients, prev_gradients));
+                        dbg, ip));
                 struct projection *op = find_projection(bg->out_projs, g);
                 add_to_array(dbg->out_projs, rnn_duplicate_projection(
-                        dg, op, gradients, prev_gradients));             
+                        dg, op));
         }
 
         /* recursively duplicate the current group's outgoing projections */
@@ -272,18 +329,13 @@ struct group *rnn_duplicate_groups(struct network *n, struct network *dn,
                 struct group *rg = rnn_duplicate_groups(n, dn, tg);
                 /*
                  * Duplicate the projection between the current group and
-                 * the group to which it projects. We only need a unique
-                 * gradient and previous gradient matrix.
+                 * the group to which it projects.
                  */
-                struct matrix *gradients =
-                        create_matrix(g->vector->size, tg->vector->size);
-                struct matrix *prev_gradients =
-                        create_matrix(g->vector->size, tg->vector->size);
                 add_to_array(dg->out_projs, rnn_duplicate_projection(
-                        rg, op, gradients, prev_gradients));
+                        rg, op));
                 struct projection *ip = find_projection(tg->inc_projs, g);
                 add_to_array(rg->inc_projs, rnn_duplicate_projection(
-                        dg, ip, gradients, prev_gradients));
+                        dg, ip));
         }
 
         return dg;
@@ -294,7 +346,7 @@ void rnn_free_duplicate_group(struct group *dg)
         free_vector(dg->vector);
         free_vector(dg->error);
         for (uint32_t i = 0; i < dg->inc_projs->num_elements; i++)
-                rnn_free_duplicate_projection(dg->inc_projs->elements[i]);
+                free(dg->inc_projs->elements[i]);
         free_array(dg->inc_projs);
         for (uint32_t i = 0; i < dg->out_projs->num_elements; i++)
                 free(dg->out_projs->elements[i]);
@@ -308,11 +360,18 @@ void rnn_free_duplicate_groups(struct array *dgs)
                 rnn_free_duplicate_group(dgs->elements[i]);
 }
 
-struct projection *rnn_duplicate_projection(
-        struct group *to,
-        struct projection *p,
-        struct matrix *gradients,
-        struct matrix *prev_gradients)
+/*
+ * Duplicates a projection p, such that it projects to group to. All
+ * matrices of the duplicate are shared with p, so that the gradients of
+ * all timesteps are accumulated directly into those of p.
+ *
+ * Note: Error is backpropagated through the networks on the stack one
+ * after another, and the threads that backpropagate through a network
+ * compute gradients for disjoint rows of each matrix (see
+ * bp_backpropagate_group()), so that this accumulation is thread-safe.
+ */
+struct projection *rnn_duplicate_projection(struct group *to,
+        struct projection *p)
 {
         struct projection *dp;
         if (!(dp = malloc(sizeof(struct projection))))
@@ -321,8 +380,8 @@ struct projection *rnn_duplicate_projection(
 
         dp->to             = to;
         dp->weights        = p->weights;        /* <-- shared */
-        dp->gradients      = gradients;
-        dp->prev_gradients = prev_gradients;
+        dp->gradients      = p->gradients;      /* <-- shared */
+        dp->prev_gradients = p->prev_gradients; /* <-- shared */
         dp->prev_deltas    = p->prev_deltas;    /* <-- shared */
         dp->dynamic_params = p->dynamic_params; /* <-- shared */
         dp->flags          = p->flags;          /* <-- shared */
@@ -334,173 +393,42 @@ error_out:
         return NULL;
 }
 
-void rnn_free_duplicate_projection(struct projection *dp)
-{
-        free_matrix(dp->gradients);
-        free_matrix(dp->prev_gradients);
-        free(dp);
-}
-
-void rnn_attach_terminal_groups(struct rnn_unfolded_network *un,
-        struct network *n)
-{
-        for (uint32_t i = 0; i < un->rcr_groups->num_elements; i++) {
-                struct group *rg = un->rcr_groups->elements[i];
-                struct group *tg = find_array_element_by_name(
-                        n->groups, rg->name);
-                struct group *fg = un->trm_groups->elements[i];
-
-                /*
-                 * Create a projection between the recurrent group, and the
-                 * terminal recurrent group. We only need a unique gradient
-                 * and previous gradient matrix.
-                 */
-                uint32_t vz = tg->vector->size;
-                struct matrix *gradients      = create_matrix(vz, vz);
-                struct matrix *prev_gradients = create_matrix(vz, vz);
-                /* flags */
-                struct projection_flags *flags;
-                if (!(flags = malloc(sizeof(struct projection_flags))))
-                        goto error_out;
-                memset(flags, 0, sizeof(struct projection_flags));
-                flags->recurrent = true; /* <-- flag recurrent */
-                /* create projections */
-                struct projection *rp = find_projection(rg->out_projs, rg);
-                struct projection *op = create_projection(tg, rp->weights,
-                        gradients, prev_gradients, rp->prev_deltas,
-                        rp->dynamic_params, flags);
-                struct projection *ip = create_projection(fg, rp->weights,
-                        gradients, prev_gradients, rp->prev_deltas,
-                        rp->dynamic_params, flags);
-                add_projection(fg->out_projs, op);
-                add_projection(tg->inc_projs, ip);
-        }
-
-        return;
-
-error_out:
-        perror("[rnn_attach_recurrent_groups()]");
-        return;
-}
-
-void rnn_detach_terminal_groups(struct rnn_unfolded_network *un,
-        struct network *n)
+/*
+ * Attaches the "terminal" recurrent groups to the recurrent groups of the
+ * network in stack/0, by redirecting the incoming recurrent projections of
+ * stack/0 to the terminal groups, and vice versa.
+ */
+void rnn_attach_terminal_groups(struct rnn_unfolded_network *un)
 {
-        for (uint32_t i = 0; i < un->rcr_groups->num_elements; i++) {
-                struct group *rg = un->rcr_groups->elements[i];
-                struct group *tg = find_array_element_by_name(
-                        n->groups, rg->name);
-                struct group *fg = un->trm_groups->elements[i];
-                /* remove incoming projection from recurrent group */
-                struct projection *ip = find_projection(tg->inc_projs, fg);
-                remove_projection(tg->inc_projs, ip);
-                rnn_free_duplicate_projection(ip);
-                /* remove outgoing projection from terminal group */
-                struct projection *op = find_projection(fg->out_projs, tg);
-                remove_projection(fg->out_projs, op);
-                free(op);
-                /* remove terminal group */
-                // rnn_free_duplicate_groups(fg);
-                rnn_free_duplicate_group(fg);
+        uint32_t nr = un->rcr_groups->num_elements;
+        for (uint32_t i = 0; i < nr; i++) {
+                struct group *tg = un->trm_groups->elements[i];
+                struct group *rg = un->rcr_stack[un->head * nr + i];
+                struct projection *ip = un->rcr_projs[un->head * nr + i];
+                struct projection *op = tg->out_projs->elements[0];
+                ip->to = tg;
+                op->to = rg;
         }
 }
 
+/*
+ * Connects the recurrent groups of the network in (physical) stack
+ * position i to those of the network in position j.
+ */
 void rnn_connect_duplicate_networks(struct rnn_unfolded_network *un,
-        struct network *n, struct network *nn)
+        uint32_t i, uint32_t j)
 {
-        for (uint32_t i = 0; i < un->rcr_groups->num_elements; i++) {
-                /* find recurrent groups to connect */
-                struct group *rg = un->rcr_groups->elements[i];
-                struct group *fg = find_array_element_by_name(
-                        n->groups, rg->name);
-                struct group *tg = find_array_element_by_name(
-                        nn->groups, rg->name);
-                /*
-                 * Create a projection between the recurrent groups. We only
-                 * need a unique gradient and previous gradient matrix.
-                 */
-                struct matrix *gradients = 
-                        create_matrix(fg->vector->size, tg->vector->size);
-                struct matrix *prev_gradients = 
-                        create_matrix(fg->vector->size, tg->vector->size);
-                /* flags */
-                struct projection_flags *flags;
-                if (!(flags = malloc(sizeof(struct projection_flags))))
-                        goto error_out;
-                memset(flags, 0, sizeof(struct projection_flags));
-                flags->recurrent = true; /* <-- flag recurrent */
-                /* create projections */
-                struct projection *rp = find_projection(rg->out_projs, rg);
-                struct projection *op = create_projection(tg, rp->weights,
-                        gradients, prev_gradients, rp->prev_deltas,
-                        rp->dynamic_params, flags);
-                struct projection *ip = create_projection(fg, rp->weights,
-                        gradients, prev_gradients, rp->prev_deltas,
-                        rp->dynamic_params, flags);
+        uint32_t nr = un->rcr_groups->num_elements;
+        for (uint32_t x = 0; x < nr; x++) {
+                struct group *bg = un->rcr_groups->elements[x];
+                struct group *fg = un->rcr_stack[i * nr + x];
+                struct group *tg = un->rcr_stack[j * nr + x];
+                struct projection *rp = find_projection(bg->out_projs, bg);
+                struct projection *op = rnn_duplicate_projection(tg, rp);
+                struct projection *ip = rnn_duplicate_projection(fg, rp);
                 add_projection(fg->out_projs, op);
                 add_projection(tg->inc_projs, ip);
-        }
-
-        return;
-
-error_out:
-        perror("[rnn_connect_duplicate_networks()]");
-        return;
-}
-
-void rnn_disconnect_duplicate_networks(struct rnn_unfolded_network *un,
-        struct network *n, struct network *nn)
-{
-        for (uint32_t i = 0; i < un->rcr_groups->num_elements; i++) {
-                struct group *rg = un->rcr_groups->elements[i];
-                struct group *fg = find_array_element_by_name(
-                        n->groups, rg->name);
-                struct group *tg = find_array_element_by_name(
-                        nn->groups, rg->name);
-                /* remove outgoing projection from 'from' group */
-                struct projection *op = find_projection(fg->out_projs, tg);
-                remove_projection(fg->out_projs, op);
-                rnn_free_duplicate_projection(op);
-                /* remove incoming projection from 'receiving' group */
-                struct projection *ip = find_projection(tg->inc_projs, fg);
-                remove_projection(tg->inc_projs, ip);
-                free(ip);
-        }
-}
-
-void rnn_sum_and_reset_gradients(struct rnn_unfolded_network *un)
-{
-        for (uint32_t i = 1; i < un->stack_size; i++)
-                rnn_add_and_reset_gradients(
-                        un->stack[0]->output,
-                        un->stack[i]->output);
-}
-
-void rnn_add_and_reset_gradients(struct group *g, struct group *dg)
-{
-        /*
-         * Provided a group g and g', add gradients for all incoming,
-         * projections of g' to those in g. Recursively repeat this for all
-         * non-recurrent groups projecting to g.
-         */
-        for (uint32_t i = 0; i < g->inc_projs->num_elements; i++) {
-                struct projection *p = g->inc_projs->elements[i];                
-                struct projection *dp = NULL;
-                for (uint32_t j = 0; j < dg->inc_projs->num_elements; j++) {
-                        dp = dg->inc_projs->elements[j];
-                        if (dp->to->name == p->to->name)
-                                break;
-                }
-                /* skip recurrent projections */
-                if (p->flags->recurrent)
-                        continue;
-                for (uint32_t r = 0; r < p->gradients->rows; r++)
-                        for (uint32_t c = 0; c < p->gradients->cols; c++)
-                                p->gradients->elements[r][c]
-                                        += dp->gradients->elements[r][c];
-                copy_matrix(dp->prev_gradients, dp->gradients);
-                zero_out_matrix(dp->gradients);
-                rnn_add_and_reset_gradients(p->to, dp->to);
+                un->rcr_projs[j * nr + x] = ip;
         }
 }
 
@@ -523,70 +451,267 @@ Shift the network stack. Assume the following unfolded network:
 
 stack/n  ...  stack/1           stack/0          terminal
 
-The aim is to completely isolate stack/0, and move it into stack/n.
+The aim is to isolate stack/0, and reuse it as stack/n. The stack is a ring
+buffer, in which each network is permanently connected to the one that
+precedes it. Rather than moving networks, shifting the stack advances its
+head, so that stack/1 becomes stack/0, and the network that used to be in
+stack/0 becomes stack/n. Only the incoming recurrent projections of these
+two networks need to be redirected: those of the new stack/0 to the
+terminal groups, and those of the new stack/n to the recurrent groups of
+stack/(n-1).
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 void rnn_shift_stack(struct rnn_unfolded_network *un)
 {
-        /* 
-         * First, isolate the network in stack/0 by disconnecting it, and
-         * rewiring all of its recurrent terminals to their corresponding
-         * groups in stack/1.
-         * 
-         * Variables: g1 ~ terminal; g2 ~ stack/0, and g3 ~ stack/1.
+        if (un->tape) {
+                rnn_shift_tape(un);
+                return;
+        }
+
+        uint32_t nr = un->rcr_groups->num_elements;
+        uint32_t s0 = un->head;                         /* stack/0 */
+        uint32_t s1 = (s0 + 1) % un->stack_size;        /* stack/1 */
+        uint32_t sn = (s0 + un->stack_size - 1)         /* stack/n */
+                % un->stack_size;
+
+        /*
+         * The terminal groups take over the activation patterns of the
+         * recurrent groups in stack/0. As these groups are overwritten
+         * during the next forward sweep, their vectors are swapped rather
+         * than copied.
          */
-        for (uint32_t i = 0; i < un->rcr_groups->num_elements; i++) {
-                struct group *rg = un->rcr_groups->elements[i];
-                struct group *g1 = un->trm_groups->elements[i]; /* terminal */
-                struct group *g2 = find_array_element_by_name(  /* stack/0  */
-                        un->stack[0]->groups, rg->name);
-                struct group *g3 = find_array_element_by_name(  /* stack/1  */
-                        un->stack[1]->groups, rg->name);
-
-                /* 
-                 * Disconnect the recurrent group in stack/0 from the
-                 * terminal recurrent group, and the recurrent group in
-                 * stack/1. Whereas we we will free the projection gradient
-                 * between stack/0 and the terminal group, we perserve the
-                 * one between stack/0 and stack/1. Finally, we copy the
-                 * activation pattern of the group in stack/0 into the
-                 * terminal group.
-                 */
-                struct projection *g2_to_g1 = /* stack0 -> terminal */
-                        find_projection(g2->inc_projs, g1);
-                remove_projection(g2->inc_projs, g2_to_g1);
-                rnn_free_duplicate_projection(g2_to_g1);
-                struct projection *g2_to_g3 = /* stack0 -> stack/1 */
-                        find_projection(g2->out_projs, g3);
-                remove_projection(g2->out_projs, g2_to_g3);
-                free(g2_to_g3);
-                copy_vector(g2->vector, g1->vector);
-
-                /* 
-                 * Connect the terminal recurrent group to the recurrent
-                 * group in stack/1, reusing the gradients that were used
-                 * for the projection between stack/0 and stack/1.
-                 */
-                struct projection *g3_to_g1 = find_projection(g3->inc_projs, g2);
-                g3_to_g1->to = g1; /* stack/1 -> terminal */                
-                struct projection *g1_to_g3 = find_projection(g1->out_projs, g2);
-                g1_to_g3->to = g3; /* terminal -> stack/1 */
-                g1_to_g3->gradients      = g3_to_g1->gradients;
-                g1_to_g3->prev_gradients = g3_to_g1->prev_gradients;
+        for (uint32_t i = 0; i < nr; i++) {
+                struct group *tg = un->trm_groups->elements[i];
+                struct group *rg = un->rcr_stack[s0 * nr + i];
+                struct vector *v = tg->vector;
+                tg->vector = rg->vector;
+                rg->vector = v;
         }
 
         /*
-         * Secondly, perform the actual stack shifting. Store a reference to
-         * the network in stack/0, and shift stack/1 into stack/0, stack/2
-         * into stack/1 until stack/n has been shifted into stack/(n-1).
-         * Next, we move the network that used to be in stack/0 into
-         * stack/n, and connect it to the network in stack/(n-1).
+         * Advance the head of the stack, and attach the terminal groups to
+         * the new stack/0.
          */
-        struct network *n = un->stack[0];               /* net <- stack/0 */
-        for (uint32_t i = 0; i < un->stack_size - 1; i++)
-                un->stack[i] = un->stack[i + 1];        /* shift stack */
-        un->stack[un->stack_size - 1] = n;              /* stack/n <- net */
-        rnn_connect_duplicate_networks(un,
-                un->stack[un->stack_size - 2],          /* stack/(n-1) */
-                un->stack[un->stack_size - 1]);         /* stack/n */
+        un->head = s1;
+        rnn_attach_terminal_groups(un);
+        if (un->stack_size == 1)
+                return;
+
+        /*
+         * Reconnect the recurrent groups of the old stack/0 (the new
+         * stack/n) to those of the old stack/n (the new stack/(n-1)).
+         */
+        for (uint32_t i = 0; i < nr; i++) {
+                struct projection *ip = un->rcr_projs[s0 * nr + i];
+                ip->to = un->rcr_stack[sn * nr + i];
+        }
+}
+
+                /*************************
+                 **** activation tape ****
+                 *************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Activation-tape BPTT. Rather than duplicating the network for each timestep,
+the stack holds a single network, and only the activation and error vectors
+of its groups are recorded for each timestep. These are stored in two
+contiguous blocks, each of which is laid out as follows:
+
+        +------------------+------------------+-----+-------------------+
+        | tick 0: g1 g2 .. | tick 1: g1 g2 .. | ... | terminal: r1 r2 ..|
+        +------------------+------------------+-----+-------------------+
+
+where g1, g2, ... are the groups of the network (except for bias groups,
+which are constant), and r1, r2, ... the "terminal" groups. The groups of
+the network, and the terminal groups, do not own their vectors, but are
+views on the tape: loading timestep i points their vectors to the rows of
+the tape that belong to that timestep, and the terminal groups to the
+recurrent groups of timestep i - 1 (or to their own rows at stack/0).
+Error backpropagated through a recurrent projection therefore directly
+ends up in the error vector of the previous timestep, and the backward
+sweep walks the tape in reverse.
+
+Like the network stack, the ticks of the tape form a ring buffer, which is
+shifted by swapping the rows of the terminal groups with those of the
+recurrent groups in stack/0, and advancing the head.
+
+Memory and setup time are thereby proportional to the number of units in
+the network times the number of back ticks, rather than to its topology
+times the number of back ticks.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct rnn_tape *rnn_create_tape(struct rnn_unfolded_network *un)
+{
+        struct rnn_tape *tp;
+        if (!(tp = malloc(sizeof(struct rnn_tape))))
+                goto error_out;
+        memset(tp, 0, sizeof(struct rnn_tape));
+
+        /* record all groups, except for bias groups */
+        struct network *sn = un->stack[0];
+        tp->groups = create_array(atype_groups);
+        for (uint32_t i = 0; i < sn->groups->num_elements; i++) {
+                struct group *g = sn->groups->elements[i];
+                if (!g->flags->bias)
+                        add_to_array(tp->groups, g);
+        }
+        uint32_t ng = tp->groups->num_elements;
+        uint32_t nr = un->rcr_groups->num_elements;
+
+        /* find the position of each recurrent group on the tape */
+        if (!(tp->rcr_index = malloc(nr * sizeof(uint32_t))))
+                goto error_out;
+        for (uint32_t i = 0; i < nr; i++)
+                for (uint32_t j = 0; j < ng; j++)
+                        if (tp->groups->elements[j] == un->rcr_stack[i])
+                                tp->rcr_index[i] = j;
+
+        /* allocate the tape */
+        for (uint32_t i = 0; i < ng; i++) {
+                struct group *g = tp->groups->elements[i];
+                tp->size += g->vector->size;
+        }
+        tp->size *= un->stack_size;
+        for (uint32_t i = 0; i < nr; i++) {
+                struct group *tg = un->trm_groups->elements[i];
+                tp->size += tg->vector->size;
+        }
+        size_t block_size = tp->size * sizeof(real);
+        if (!(tp->vector_data = malloc(block_size)))
+                goto error_out;
+        memset(tp->vector_data, 0, block_size);
+        if (!(tp->error_data = malloc(block_size)))
+                goto error_out;
+        memset(tp->error_data, 0, block_size);
+
+        /* divide the tape into rows */
+        uint32_t num_rows = un->stack_size * ng + nr;
+        block_size = num_rows * sizeof(real *);
+        if (!(tp->vectors = malloc(block_size)))
+                goto error_out;
+        if (!(tp->errors = malloc(block_size)))
+                goto error_out;
+        block_size = un->stack_size * sizeof(struct sparse_vector *);
+        if (!(tp->sparse = malloc(block_size)))
+                goto error_out;
+        memset(tp->sparse, 0, block_size);
+        size_t x = 0;
+        for (uint32_t i = 0; i < num_rows; i++) {
+                struct group *g = i < un->stack_size * ng
+                        ? tp->groups->elements[i % ng]
+                        : un->trm_groups->elements[i - un->stack_size * ng];
+                tp->vectors[i] = &tp->vector_data[x];
+                tp->errors[i]  = &tp->error_data[x];
+                x += g->vector->size;
+        }
+
+        /* turn the groups into views on the tape */
+        for (uint32_t i = 0; i < ng + nr; i++) {
+                struct group *g = i < ng ? tp->groups->elements[i]
+                        : un->trm_groups->elements[i - ng];
+                free(g->vector->elements);
+                free(g->error->elements);
+                g->vector->elements = NULL;
+                g->error->elements  = NULL;
+        }
+
+        return tp;
+
+error_out:
+        perror("[rnn_create_tape()]");
+        return NULL;
+}
+
+/*
+ * Note: The vectors of the groups that are views on the tape are detached
+ * from it, such that these groups can be freed as usual.
+ */
+void rnn_free_tape(struct rnn_unfolded_network *un)
+{
+        struct rnn_tape *tp = un->tape;
+        for (uint32_t i = 0; i < tp->groups->num_elements; i++) {
+                struct group *g = tp->groups->elements[i];
+                g->vector->elements = NULL;
+                g->error->elements  = NULL;
+        }
+        for (uint32_t i = 0; i < un->trm_groups->num_elements; i++) {
+                struct group *tg = un->trm_groups->elements[i];
+                tg->vector->elements = NULL;
+                tg->error->elements  = NULL;
+        }
+        free_array(tp->groups);
+        free(tp->rcr_index);
+        free(tp->vector_data);
+        free(tp->error_data);
+        free(tp->vectors);
+        free(tp->errors);
+        free(tp->sparse);
+        free(tp);
+        un->tape = NULL;
+}
+
+/*
+ * Points the groups of the network on the stack to the vectors of timestep
+ * i on the tape (where timestep 0 is stack/0), and the terminal groups to
+ * those of the recurrent groups in timestep i - 1.
+ */
+void rnn_load_tape(struct rnn_unfolded_network *un, uint32_t i)
+{
+        struct rnn_tape *tp = un->tape;
+        uint32_t ng = tp->groups->num_elements;
+        uint32_t t = (un->head + i) % un->stack_size;
+        for (uint32_t j = 0; j < ng; j++) {
+                struct group *g = tp->groups->elements[j];
+                g->vector->elements = tp->vectors[t * ng + j];
+                g->error->elements  = tp->errors[t * ng + j];
+        }
+        un->stack[0]->input->sparse = tp->sparse[t];
+        uint32_t pt = (t + un->stack_size - 1) % un->stack_size;
+        for (uint32_t j = 0; j < un->trm_groups->num_elements; j++) {
+                struct group *tg = un->trm_groups->elements[j];
+                uint32_t x = i == 0 ? un->stack_size * ng + j
+                        : pt * ng + tp->rcr_index[j];
+                tg->vector->elements = tp->vectors[x];
+                tg->error->elements  = tp->errors[x];
+        }
+}
+
+/*
+ * Records that sparse vector sv (or no sparse vector, if NULL) is clamped
+ * onto the input group of stack/i. On the tape, this is recorded for each
+ * timestep, as all timesteps share a single input group.
+ */
+void rnn_set_sparse_input(struct rnn_unfolded_network *un, uint32_t i,
+        struct sparse_vector *sv)
+{
+        rnn_stack_network(un, i)->input->sparse = sv;
+        if (un->tape)
+                un->tape->sparse[(un->head + i) % un->stack_size] = sv;
+}
+
+/*
+ * Shifts the tape, such that the rows of stack/0 can be reused for
+ * stack/n. As in rnn_shift_stack(), the terminal groups take over the
+ * activation patterns of the recurrent groups in stack/0 by swapping rows.
+ */
+void rnn_shift_tape(struct rnn_unfolded_network *un)
+{
+        struct rnn_tape *tp = un->tape;
+        uint32_t ng = tp->groups->num_elements;
+        for (uint32_t i = 0; i < un->trm_groups->num_elements; i++) {
+                uint32_t x = un->stack_size * ng + i;
+                uint32_t y = un->head * ng + tp->rcr_index[i];
+                real *v = tp->vectors[x];
+                tp->vectors[x] = tp->vectors[y];
+                tp->vectors[y] = v;
+        }
+        un->head = (un->head + 1) % un->stack_size;
+}
+
+/*
+ * Zeroes all error vectors on the tape.
+ */
+void rnn_reset_tape_errors(struct rnn_unfolded_network *un)
+{
+        memset(un->tape->error_data, 0, un->tape->size * sizeof(real));
 }
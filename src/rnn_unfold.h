@@ -26,6 +26,8 @@
 struct rnn_unfolded_network *rnn_unfold_network(struct network *n);
 void rnn_find_recurrent_groups(struct group *g, struct array *rcr_groups);
 void rnn_free_unfolded_network(struct rnn_unfolded_network *un);
+struct network *rnn_stack_network(struct rnn_unfolded_network *un,
+        uint32_t i);
 
 struct group *rnn_duplicate_group(struct group *g);
 struct group *rnn_duplicate_groups(struct network *n, struct network *dn,
@@ -33,29 +35,24 @@ struct group *rnn_duplicate_groups(struct network *n, struct network *dn,
 void rnn_free_duplicate_group(struct group *g);
 void rnn_free_duplicate_groups(struct array *dgs);
 
-struct projection *rnn_duplicate_projection(
-        struct group *to,
-        struct projection *p,
-        struct matrix *gradients,
-        struct matrix *prev_gradients);
-void rnn_free_duplicate_projection(struct projection *dp);
+struct projection *rnn_duplicate_projection(struct group *to,
+        struct projection *p);
 
 struct network *rnn_duplicate_network(struct network *n);
 void rnn_free_duplicate_network(struct network *n);
 
-void rnn_attach_terminal_groups(struct rnn_unfolded_network *un,
-        struct network *n);
-void rnn_detach_terminal_groups(struct rnn_unfolded_network *un,
-        struct network *n);
-
+void rnn_attach_terminal_groups(struct rnn_unfolded_network *un);
 void rnn_connect_duplicate_networks(struct rnn_unfolded_network *un,
-        struct network *n, struct network *nn);
-void rnn_disconnect_duplicate_networks(struct rnn_unfolded_network *un,
-        struct network *n, struct network *nn);
-
-void rnn_sum_and_reset_gradients(struct rnn_unfolded_network *un);
-void rnn_add_and_reset_gradients(struct group *g, struct group *dg);
+        uint32_t i, uint32_t j);
 
 void rnn_shift_stack(struct rnn_unfolded_network *un);
 
+struct rnn_tape *rnn_create_tape(struct rnn_unfolded_network *un);
+void rnn_free_tape(struct rnn_unfolded_network *un);
+void rnn_load_tape(struct rnn_unfolded_network *un, uint32_t i);
+void rnn_set_sparse_input(struct rnn_unfolded_network *un, uint32_t i,
+        struct sparse_vector *sv);
+void rnn_shift_tape(struct rnn_unfolded_network *un);
+void rnn_reset_tape_errors(struct rnn_unfolded_network *un);
+
 #endif /* RNN_UNFOLD_H */
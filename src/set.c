@@ -14,12 +14,18 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "main.h"
 #include "set.h"
+#include "stream.h"
 
 struct set *create_set(char *name)
 {
@@ -45,8 +51,13 @@ error_out:
 void free_set(struct set *s)
 {
         free(s->name);
-        for (uint32_t i = 0; i < s->items->num_elements; i++)
-                free_item(s->items->elements[i]);
+        if (s->map)
+                free_binary_set(s);
+        else if (s->stream)
+                free_streamed_set(s);
+        else
+                for (uint32_t i = 0; i < s->items->num_elements; i++)
+                        free_item(s->items->elements[i]);
         free_array(s->items);
         free(s->order);
         free(s);
@@ -80,9 +91,12 @@ void free_item(struct item *item)
         for (uint32_t i = 0; i < item->num_events; i++) {
                 if (item->inputs[i])  free_vector(item->inputs[i]);
                 if (item->targets[i]) free_vector(item->targets[i]);
+                if (item->sparse_inputs && item->sparse_inputs[i])
+                        free_sparse_vector(item->sparse_inputs[i]);
         }
         free(item->inputs);
         free(item->targets);
+        free(item->sparse_inputs);
         free(item);
 }
 
@@ -107,8 +121,7 @@ void print_item(struct item *item, bool pprint, enum color_scheme scheme)
                 cprintf("\n");
                 cprintf("E: %d\n", i + 1);
                 cprintf("I: ");
-                pprint ? pprint_vector(item->inputs[i], scheme)
-                       : print_vector(item->inputs[i]);
+                print_item_input(item, i, pprint, scheme);
                 if (item->targets[i]) {
                         cprintf("T: ");
                         pprint ? pprint_vector(item->targets[i], scheme)
@@ -118,6 +131,29 @@ void print_item(struct item *item, bool pprint, enum color_scheme scheme)
         cprintf("\n");
 }
 
+/*
+ * Prints the input vector of an event of an item, which is either dense or
+ * sparse.
+ */
+void print_item_input(struct item *item, uint32_t event, bool pprint,
+        enum color_scheme scheme)
+{
+        if (item->sparse_inputs && item->sparse_inputs[event])
+                pprint ? pprint_sparse_vector(item->sparse_inputs[event],
+                                scheme)
+                       : print_sparse_vector(item->sparse_inputs[event]);
+        else
+                pprint ? pprint_vector(item->inputs[event], scheme)
+                       : print_vector(item->inputs[event]);
+}
+
+uint32_t item_input_size(struct item *item, uint32_t event)
+{
+        if (item->sparse_inputs && item->sparse_inputs[event])
+                return item->sparse_inputs[event]->size;
+        return item->inputs[event]->size;
+}
+
                 /***********************
                  **** legacy format ****
                  ***********************/
@@ -213,7 +249,7 @@ struct set *load_legacy_set(char *name, char *filename, uint32_t input_size,
                                 if (!(tokens = strtok(NULL, " ")))
                                         goto error_input_vector;
                                 /* error: non-numeric unit */                                
-                                if (sscanf(tokens, "%lf",
+                                if (sscanf(tokens, SCN_REAL,
                                         &inputs[i]->elements[j]) != 1)
                                         goto error_input_vector;
                         }
@@ -233,7 +269,7 @@ struct set *load_legacy_set(char *name, char *filename, uint32_t input_size,
                                 if (!(tokens = strtok(NULL, " ")))
                                         goto error_target_vector;
                                 /* error: non-numeric unit */
-                                if (sscanf(tokens, "%lf",
+                                if (sscanf(tokens, SCN_REAL,
                                         &targets[i]->elements[j]) != 1)
                                         goto error_target_vector;
                                 /* error: vector too long */
@@ -310,6 +346,12 @@ Load a set of input and target items. The expected format is:
         Input # # # Target # #
         EndItem
 
+        BeginItem
+        Name "name"
+        Meta "meta"
+        Input { i i:# } Target # #
+        EndItem
+
         [...]
 
 where 'name' is an identifier for the item, 'meta' is item-specific meta
@@ -317,65 +359,186 @@ information, and '#' are integer or floating point units of the input/target
 vectors. Note that target vectors do not need to be present for every input
 pattern. The optional "Dimensions I O" specification can be used to override
 the dimensions derived from the model (input and output group size).
+
+Input vectors can also be specified sparsely, by listing the indices 'i'
+(starting at 0) of their non-zero units between braces. Each index can be
+followed by a colon and the value of its unit, which is 1 otherwise. Sparse
+input vectors are stored as such (see vector.c), and are propagated without
+visiting their zero units (see act.c), which makes them well suited for
+localist (one-hot or few-hot) inputs.
+
+Note: Binary sets (see below) are recognized, and loaded as such.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 struct set *load_set(char *name, char *filename, uint32_t input_size,
         uint32_t output_size)
 {
-        struct set *s = create_set(name);
-        uint32_t input_dims, output_dims;
-
-        FILE *fd;
-        if (!(fd = fopen(filename, "r")))
+        /* binary sets are memory-mapped */
+        if (is_binary_set(filename))
+                return load_binary_set(name, filename);
+
+        struct set *s = NULL;
+        struct item **items = NULL;
+        enum parse_status *status = NULL;
+        char **bounds = NULL;
+        uint32_t num_items = 0, max_items = 0;
+
+        /* map the set file */
+        int fd;
+        if ((fd = open(filename, O_RDONLY)) == -1)
                 goto error_file;
-        char buf[MAX_BUF_SIZE];
-        bool fline = true;
-        while (fgets(buf, sizeof(buf), fd)) {
-                buf[strlen(buf) - 1] = '\0';
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+                close(fd);
+                goto error_out;
+        }
+        size_t size = st.st_size;
+        if (size == 0) {
+                close(fd);
+                goto error_format;
+        }
+        char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+                goto error_out;
+        char *end = data + size;
+
+        /*
+         * Split the file into items, by finding the first and last line of
+         * each item. Verbose comments are printed along the way, such that
+         * they appear in the order of the file.
+         */
+        uint32_t input_dims = 0, output_dims = 0;
+        bool fline = true, in_item = false;
+        for (char *line = data; line < end;) {
+                char *eol = memchr(line, '\n', end - line);
+                char *next = eol ? eol + 1 : end;
+                eol = eol ? eol : end;
+                if (eol > line && eol[-1] == '\r')
+                        eol--;
+                char *bol = line;
+                line = next;
+
                 /* comment or blank line */
-                switch (buf[0]) {
+                switch (bol < eol ? bol[0] : '\0') {
                 case '%':       /* verbose comment */
-                        cprintf("\x1b[1m\x1b[36m%s\x1b[0m\n", buf);
+                        cprintf("\x1b[1m\x1b[36m%.*s\x1b[0m\n",
+                                (int)(eol - bol), bol);
                         continue;
                 case '#':       /* silent comment */
                 case '\0':      /* blank line */
                         continue;
                 }
 
+                /* end of item */
+                if (in_item) {
+                        if (eol - bol == 7 && memcmp(bol, "EndItem", 7) == 0) {
+                                bounds[2 * num_items - 1] = bol;
+                                in_item = false;
+                        }
+                        continue;
+                }
+
                 /*
                  * If the first non-comment or non-blank line is a
                  * dimensions specification, use specified dimensions,
                  * otherwise use those derived from the model.
                  */
                 if (fline) {
+                        char buf[MAX_ARG_SIZE];
+                        size_t len = eol - bol < MAX_ARG_SIZE
+                                ? eol - bol : MAX_ARG_SIZE - 1;
+                        memcpy(buf, bol, len);
+                        buf[len] = '\0';
                         if (sscanf(buf, "Dimensions %d %d",
                                 &input_dims, &output_dims) != 2) {
-                                if (input_size == 0 || output_size == 0)
+                                if (input_size == 0 || output_size == 0) {
+                                        munmap(data, size);
                                         goto error_unknown_dimensions;
+                                }
                                 input_dims  = input_size;
                                 output_dims = output_size;
                         }
                         fline = false;
                 }
 
-                /* load item */
-                if (strcmp(buf, "BeginItem") == 0) {
-                        struct item *item = load_item(fd, input_dims, output_dims);
-                        if (item == NULL)
-                                return NULL; /* error handled in load_item() */
-                        add_to_array(s->items, item);
+                /* start of item */
+                if (eol - bol == 9 && memcmp(bol, "BeginItem", 9) == 0) {
+                        if (num_items == max_items) {
+                                max_items = max_items ? 2 * max_items : 64;
+                                char **b = realloc(bounds,
+                                        2 * max_items * sizeof(char *));
+                                if (!b) {
+                                        munmap(data, size);
+                                        goto error_out;
+                                }
+                                bounds = b;
+                        }
+                        bounds[2 * num_items]     = next;
+                        bounds[2 * num_items + 1] = end;
+                        num_items++;
+                        in_item = true;
                 }
         }
-        fclose(fd);
 
         /* error: emtpy set */
-        if (s->items->num_elements == 0) {
-                free_set(s);
+        if (num_items == 0) {
+                munmap(data, size);
+                free(bounds);
                 goto error_format;
         }
 
-        /* item order equals read order */
-        size_t block_size = s->items->num_elements * sizeof(uint32_t);
+        /*
+         * Parse the items in parallel. Each item is parsed independently,
+         * and its status recorded, such that the items, and the first error
+         * that occurred (if any), do not depend on the number of threads.
+         */
+        size_t block_size = num_items * sizeof(struct item *);
+        if (!(items = malloc(block_size)))
+                goto error_out;
+        memset(items, 0, block_size);
+        block_size = num_items * sizeof(enum parse_status);
+        if (!(status = malloc(block_size)))
+                goto error_out;
+        memset(status, 0, block_size);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) if (num_items > 1)
+#endif /* _OPENMP */
+        for (uint32_t i = 0; i < num_items; i++)
+                items[i] = parse_item(bounds[2 * i], bounds[2 * i + 1],
+                        input_dims, output_dims, &status[i]);
+        munmap(data, size);
+        free(bounds);
+        bounds = NULL;
+
+        enum parse_status error = pstat_ok;
+        for (uint32_t i = 0; i < num_items && error == pstat_ok; i++)
+                error = status[i];
+        if (error != pstat_ok) {
+                for (uint32_t i = 0; i < num_items; i++)
+                        if (items[i])
+                                free_item(items[i]);
+                free(items);
+                free(status);
+                switch (error) {
+                case pstat_input_vector:
+                        goto error_input_vector;
+                case pstat_target_vector:
+                        goto error_target_vector;
+                case pstat_empty_item:
+                        goto error_format;
+                default:
+                        goto error_out;
+                }
+        }
+
+        /* create the set; item order equals read order */
+        s = create_set(name);
+        for (uint32_t i = 0; i < num_items; i++)
+                add_to_array(s->items, items[i]);
+        free(items);
+        free(status);
+        block_size = s->items->num_elements * sizeof(uint32_t);
         if (!(s->order = malloc(block_size)))
                 goto error_out;
         memset(s->order, 0, block_size);
@@ -387,101 +550,118 @@ error_file:
         eprintf("Cannot load set - no such file '%s'\n", filename);
         return NULL;
 error_unknown_dimensions:
+        free(bounds);
         eprintf("Cannot load set - unknown dimensions\n");
         return NULL;
 error_format:
         eprintf("Cannot load set - file has incorrect format\n");
         return NULL;
+error_input_vector:
+        eprintf("Cannot load set - input vector of incorrect size\n");
+        return NULL;
+error_target_vector:
+        eprintf("Cannot load set - target vector of incorrect size\n");
+        return NULL;
 error_out:
         perror("[load_set()]");
         return NULL;
 }
 
-struct item *load_item(FILE *fd, uint32_t input_dims, uint32_t output_dims)
+/*
+ * Parses the lines of an item between s and end (exclusive of the BeginItem
+ * and EndItem lines), and returns the item. Its status is stored in status,
+ * and NULL is returned if the item could not be parsed.
+ */
+struct item *parse_item(char *s, char *end, uint32_t input_dims,
+        uint32_t output_dims, enum parse_status *status)
 {
         char *name = NULL, *meta = NULL;
         struct array *inputs  = create_array(atype_vectors);
         struct array *targets = create_array(atype_vectors);
+        struct array *sparse  = create_array(atype_vectors);
+        bool has_sparse = false;
+
+        *status = pstat_ok;
+        for (char *line = s; line < end && *status == pstat_ok;) {
+                char *eol = memchr(line, '\n', end - line);
+                char *next = eol ? eol + 1 : end;
+                eol = eol ? eol : end;
+                if (eol > line && eol[-1] == '\r')
+                        eol--;
+                char *p = line;
+                line = next;
 
-        char buf[MAX_BUF_SIZE]; /* line buffer */
-        char arg[MAX_BUF_SIZE]; /* argument buffer */
-        while (fgets(buf, sizeof(buf), fd)) {
-                buf[strlen(buf) - 1] = '\0';
                 /* comment or blank line */
-                switch (buf[0]) {
-                case '%':       /* verbose comment */
-                        cprintf("\x1b[1m\x1b[36m%s\x1b[0m\n", buf);
-                        continue;
-                case '#':       /* silent comment */
-                case '\0':      /* blank line */
+                if (p == eol || p[0] == '%' || p[0] == '#')
                         continue;
-                }
 
                 /* name */
-                if (sscanf(buf, "Name \"%[^\"]\"", arg) == 1) {
-                        size_t block_size = ((strlen(arg) + 1) * sizeof(char));
-                        if (!(name = malloc(block_size)))
-                                goto error_out;
-                        memset(name, 0, block_size);
-                        strcpy(name, arg);
+                char *arg;
+                if ((arg = scan_quoted(p, eol, "Name", status))) {
+                        free(name);
+                        name = arg;
+                        continue;
                 }
 
                 /* meta */
-                if (sscanf(buf, "Meta \"%[^\"]\"", arg) == 1) {
-                        size_t block_size = ((strlen(arg) + 1) * sizeof(char));
-                        if (!(meta = malloc(block_size)))
-                                goto error_out;
-                        memset(meta, 0, block_size);
-                        strcpy(meta, arg);
+                if ((arg = scan_quoted(p, eol, "Meta", status))) {
+                        free(meta);
+                        meta = arg;
+                        continue;
                 }
 
-                /* end of item */
-                if (strcmp(buf, "EndItem") == 0)
-                        break;
-
                 /* 
                  * Skip to next line if current one is not an input-target
                  * pattern, otherwise parse the pattern.
                  */
-                char *tokens = strtok(buf, " ");
-                if (strcmp(tokens, "Input") != 0)
+                if (!(p = scan_token(p, eol, "Input")))
                         continue;
-                struct vector *input  = create_vector(input_dims);
                 struct vector *target = create_vector(output_dims);
-                add_to_array(inputs, input);
                 add_to_array(targets, target);
-                for (uint32_t i = 0; i < input_dims; i++) {
-                        /* error: vector too short */
-                        if (!(tokens = strtok(NULL, " ")))
-                                goto error_input_vector;
-                        /* error: non-numeric unit */                                
-                        if (sscanf(tokens, "%lf", &input->elements[i]) != 1)
-                                goto error_input_vector;
+                char *q = p;
+                while (q < eol && (*q == ' ' || *q == '\t'))
+                        q++;
+                if (q < eol && *q == '{') {
+                        /* sparse input vector */
+                        struct sparse_vector *input = NULL;
+                        p = scan_sparse(q, eol, input_dims, &input, status);
+                        add_to_array(inputs, NULL);
+                        add_to_array(sparse, input);
+                        has_sparse = true;
+                        if (*status != pstat_ok)
+                                break;
+                } else {
+                        struct vector *input = create_vector(input_dims);
+                        add_to_array(inputs, input);
+                        add_to_array(sparse, NULL);
+                        for (uint32_t i = 0; i < input_dims && p; i++)
+                                p = scan_real(p, eol, &input->elements[i]);
+                }
+                /* error: vector too short, or non-numeric unit */
+                if (!p) {
+                        *status = pstat_input_vector;
+                        break;
                 }
                 /*
                  * Skip to next line if there is no target pattern for this
                  * input.
                  */
-                if ((tokens = strtok(NULL, " ")) == NULL)
+                if (!(p = scan_token(p, eol, "Target")))
                         continue;
-                if (strcmp(tokens, "Target") != 0)
-                        continue;
-                for (uint32_t i = 0; i < output_dims; i++) {
-                        /* error: vector too short */
-                        if (!(tokens = strtok(NULL, " ")))
-                                goto error_target_vector;
-                        /* error: non-numeric input */
-                        if (sscanf(tokens, "%lf", &target->elements[i]) != 1)
-                                goto error_target_vector;
-                        /* error: vector too long */
-                        if (i == output_dims - 1 && strtok(NULL, " ") != NULL)
-                                goto error_target_vector;
-                }
+                for (uint32_t i = 0; i < output_dims && p; i++)
+                        p = scan_real(p, eol, &target->elements[i]);
+                /* error: vector too short, non-numeric unit, or too long */
+                while (p && p < eol && (*p == ' ' || *p == '\t'))
+                        p++;
+                if (!p || p != eol)
+                        *status = pstat_target_vector;
         }
 
         /* error: empty item */
-        if (inputs->num_elements == 0)
-                goto error_format;
+        if (*status == pstat_ok && inputs->num_elements == 0)
+                *status = pstat_empty_item;
+        if (*status != pstat_ok)
+                goto error_item;
 
         /*
          * Move input and target vectors to fixed size arrays, and free the
@@ -489,40 +669,644 @@ struct item *load_item(FILE *fd, uint32_t input_dims, uint32_t output_dims)
          */
         uint32_t num_events = inputs->num_elements;
         struct vector **input_vecs, **target_vecs;
+        struct sparse_vector **sparse_vecs = NULL;
         size_t block_size = num_events * sizeof(struct vector *);
         if (!(input_vecs = malloc(block_size)))
                 goto error_out;
         memset(input_vecs, 0, block_size);
-        if (!(target_vecs = malloc(block_size)))
+        if (!(target_vecs = malloc(block_size))) {
+                free(input_vecs);
                 goto error_out;
+        }
         memset(target_vecs, 0, block_size);
+        if (has_sparse) {
+                block_size = num_events * sizeof(struct sparse_vector *);
+                if (!(sparse_vecs = malloc(block_size))) {
+                        free(input_vecs);
+                        free(target_vecs);
+                        goto error_out;
+                }
+                memset(sparse_vecs, 0, block_size);
+        }
         for (uint32_t i = 0; i < num_events; i++) {
                 input_vecs[i]  = inputs->elements[i];
                 target_vecs[i] = targets->elements[i];
+                if (sparse_vecs)
+                        sparse_vecs[i] = sparse->elements[i];
         }
         free_array(inputs);
         free_array(targets);
+        free_array(sparse);
 
         /* create item */
         struct item *item = create_item(name, meta, num_events,
                 input_vecs, target_vecs);
+        if (item)
+                item->sparse_inputs = sparse_vecs;
 
         return item;
 
-error_input_vector:
-        eprintf("Cannot load set - input vector of incorrect size\n");
+error_out:
+        *status = pstat_out_of_memory;
+error_item:
+        free(name);
+        free(meta);
+        for (uint32_t i = 0; i < inputs->num_elements; i++) {
+                if (inputs->elements[i])
+                        free_vector(inputs->elements[i]);
+                if (sparse->elements[i])
+                        free_sparse_vector(sparse->elements[i]);
+        }
+        for (uint32_t i = 0; i < targets->num_elements; i++)
+                free_vector(targets->elements[i]);
+        free_array(inputs);
+        free_array(targets);
+        free_array(sparse);
         return NULL;
-error_target_vector:
-        eprintf("Cannot load set - target vector of incorrect size\n");
+}
+
+/*
+ * If the line between s and end is of the form 'key "argument"', this
+ * returns a copy of the argument. Otherwise, it returns NULL.
+ */
+char *scan_quoted(char *s, char *end, char *key, enum parse_status *status)
+{
+        size_t len = strlen(key);
+        if (end - s < (ptrdiff_t)len || memcmp(s, key, len) != 0)
+                return NULL;
+        s += len;
+        while (s < end && (*s == ' ' || *s == '\t'))
+                s++;
+        if (s == end || *s++ != '"')
+                return NULL;
+        char *q = memchr(s, '"', end - s);
+        len = (q ? q : end) - s;
+        if (len == 0)
+                return NULL;
+        char *arg;
+        if (!(arg = malloc(len + 1))) {
+                *status = pstat_out_of_memory;
+                return NULL;
+        }
+        memcpy(arg, s, len);
+        arg[len] = '\0';
+        return arg;
+}
+
+/*
+ * If the next token between s and end equals token, this returns a pointer
+ * to the first character after it. Otherwise, it returns NULL.
+ */
+char *scan_token(char *s, char *end, char *token)
+{
+        while (s < end && (*s == ' ' || *s == '\t'))
+                s++;
+        size_t len = strlen(token);
+        if (end - s < (ptrdiff_t)len || memcmp(s, token, len) != 0)
+                return NULL;
+        s += len;
+        if (s < end && *s != ' ' && *s != '\t')
+                return NULL;
+        return s;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Scans the next number between s and end into x, and returns a pointer to
+the first character after it, or NULL if there is no (numeric) token.
+
+Decimal numbers whose digits fit into the significand of a real, and whose
+power of ten is exactly representable as well, are converted with a single
+multiplication or division, which is correctly rounded (Clinger, 1990).
+These cover the vast majority of units in sets. All other numbers are
+converted by strtod() (or strtof()), so that the result is always the same
+as that of sscanf().
+
+References
+
+Clinger, W. D. (1990). How to read floating point numbers accurately. ACM
+        SIGPLAN Notices, 25(6), 92-101.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+char *scan_real(char *s, char *end, real *x)
+{
+#ifdef SINGLE_PRECISION
+        const uint64_t max_significand = 1ULL << 24;
+        const int32_t max_exponent = 10;
+#else
+        const uint64_t max_significand = 1ULL << 53;
+        const int32_t max_exponent = 22;
+#endif /* SINGLE_PRECISION */
+        const real p10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+                1e19, 1e20, 1e21, 1e22 };
+
+        /* find token */
+        while (s < end && (*s == ' ' || *s == '\t'))
+                s++;
+        char *t = s;
+        while (s < end && *s != ' ' && *s != '\t')
+                s++;
+        if (t == s)
+                return NULL;
+
+        /* sign, digits, fraction, and exponent */
+        char *c = t;
+        bool negative = false, digits = false, exact = true;
+        if (*c == '-' || *c == '+')
+                negative = *c++ == '-';
+        uint64_t m = 0;
+        int32_t e = 0;
+        for (; c < s && *c >= '0' && *c <= '9'; c++, digits = true)
+                if ((m = m * 10 + (*c - '0')) > max_significand)
+                        exact = false;
+        if (c < s && *c == '.')
+                for (c++; c < s && *c >= '0' && *c <= '9'; c++, digits = true) {
+                        if ((m = m * 10 + (*c - '0')) > max_significand)
+                                exact = false;
+                        e--;
+                }
+        if (digits && c < s && (*c == 'e' || *c == 'E')) {
+                bool negative_exponent = false, exponent_digits = false;
+                int32_t xe = 0;
+                if (++c < s && (*c == '-' || *c == '+'))
+                        negative_exponent = *c++ == '-';
+                for (; c < s && *c >= '0' && *c <= '9'; c++) {
+                        if (xe < 1000)
+                                xe = xe * 10 + (*c - '0');
+                        exponent_digits = true;
+                }
+                if (!exponent_digits)
+                        exact = false;
+                e += negative_exponent ? -xe : xe;
+        }
+
+        /* fast path */
+        if (exact && digits && c == s
+                && e >= -max_exponent && e <= max_exponent) {
+                real v = (real)m;
+                v = e < 0 ? v / p10[-e] : v * p10[e];
+                *x = negative ? -v : v;
+                return s;
+        }
+
+        /* slow path */
+        char buf[64], *tok = buf;
+        size_t len = s - t;
+        if (len >= sizeof(buf) && !(tok = malloc(len + 1)))
+                return NULL;
+        memcpy(tok, t, len);
+        tok[len] = '\0';
+        char *r;
+#ifdef SINGLE_PRECISION
+        *x = strtof(tok, &r);
+#else
+        *x = strtod(tok, &r);
+#endif /* SINGLE_PRECISION */
+        bool numeric = r > tok;
+        if (tok != buf)
+                free(tok);
+        return numeric ? s : NULL;
+}
+
+/*
+ * Scans a sparse vector of the form '{ i i:# ... }' between s and end into
+ * v, and returns a pointer to the first character after it, or NULL if it
+ * is malformed. Indices should be smaller than dims, and are sorted, such
+ * that each can be listed only once.
+ */
+char *scan_sparse(char *s, char *end, uint32_t dims,
+        struct sparse_vector **v, enum parse_status *status)
+{
+        while (s < end && (*s == ' ' || *s == '\t'))
+                s++;
+        if (s == end || *s++ != '{')
+                goto error_format;
+        char *close = memchr(s, '}', end - s);
+        if (!close)
+                goto error_format;
+
+        /* count the listed units */
+        uint32_t num_elements = 0;
+        for (char *c = s; c < close;) {
+                while (c < close && (*c == ' ' || *c == '\t'))
+                        c++;
+                if (c == close)
+                        break;
+                num_elements++;
+                while (c < close && *c != ' ' && *c != '\t')
+                        c++;
+        }
+        if (!(*v = create_sparse_vector(dims, num_elements))) {
+                *status = pstat_out_of_memory;
+                return NULL;
+        }
+
+        /* scan index, and optional value, of each unit */
+        char *c = s;
+        for (uint32_t i = 0; i < num_elements; i++) {
+                while (*c == ' ' || *c == '\t')
+                        c++;
+                uint64_t x = 0;
+                char *t = c;
+                for (; c < close && *c >= '0' && *c <= '9'; c++)
+                        if ((x = x * 10 + (*c - '0')) >= dims)
+                                goto error_format;
+                if (c == t)
+                        goto error_format;
+                real value = 1.0;
+                if (c < close && *c == ':') {
+                        char *e = ++c;
+                        while (e < close && *e != ' ' && *e != '\t')
+                                e++;
+                        if (c == e || !(c = scan_real(c, e, &value))
+                                || c != e)
+                                goto error_format;
+                }
+                if (c < close && *c != ' ' && *c != '\t')
+                        goto error_format;
+
+                /* insert, in order of index */
+                uint32_t j = i;
+                for (; j > 0 && (*v)->indices[j - 1] > x; j--) {
+                        (*v)->indices[j]  = (*v)->indices[j - 1];
+                        (*v)->elements[j] = (*v)->elements[j - 1];
+                }
+                if (j > 0 && (*v)->indices[j - 1] == x)
+                        goto error_format;
+                (*v)->indices[j]  = x;
+                (*v)->elements[j] = value;
+        }
+
+        return close + 1;
+
+error_format:
+        *status = pstat_input_vector;
+        return NULL;
+}
+
+                /***********************
+                 **** binary format ****
+                 ***********************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Binary sets are sets that have been converted from text (see convertSet), so
+that they can be loaded without parsing. A binary set file is laid out as
+follows:
+
+        +--------+-----------------+------------+--------------+---------+
+        | header | event matrices  | item table | target flags | strings |
+        +--------+-----------------+------------+--------------+---------+
+
+The header (struct set_header) holds the format version, the size of units,
+the input and output dimensions, and the offsets of all other sections. For
+each item, the event matrices hold a matrix of input vectors (one row per
+event), followed by a matrix of target vectors. The item table (struct
+set_item_entry) holds the offset of the event matrices of each item, the
+index of its first event, and the offsets of its name and meta information
+in the strings section. The target flags hold a byte for each event, that
+indicates whether it has a target vector. The strings section holds the
+NUL-terminated names and meta information of all items.
+
+Binary set files are memory-mapped, and the vectors of their items point
+directly into the mapped file, such that loading a set does not copy its
+units, and processes that load the same set share its pages. The mapping is
+private, so that any changes to vectors are not written back to the file.
+
+Note: Binary set files use the byte order of the machine on which they were
+converted, and can only be loaded by builds with units of the same size (see
+SINGLE_PRECISION). Sparse input vectors are stored densely.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+bool is_binary_set(char *filename)
+{
+        FILE *fd;
+        if (!(fd = fopen(filename, "rb")))
+                return false;
+        char magic[sizeof(SET_MAGIC)];
+        bool binary = fread(magic, sizeof(magic), 1, fd) == 1
+                && memcmp(magic, SET_MAGIC, sizeof(magic)) == 0;
+        fclose(fd);
+        return binary;
+}
+
+struct set *load_binary_set(char *name, char *filename)
+{
+        int fd;
+        if ((fd = open(filename, O_RDONLY)) == -1)
+                goto error_file;
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+                close(fd);
+                goto error_out;
+        }
+        size_t size = st.st_size;
+        if (size < sizeof(struct set_header)) {
+                close(fd);
+                goto error_format;
+        }
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+                goto error_out;
+
+        /* verify header */
+        struct set_header *h = data;
+        if (memcmp(h->magic, SET_MAGIC, sizeof(SET_MAGIC)) != 0) {
+                munmap(data, size);
+                goto error_format;
+        }
+        if (h->version != SET_VERSION) {
+                munmap(data, size);
+                goto error_version;
+        }
+        if (h->real_size != sizeof(real)) {
+                munmap(data, size);
+                goto error_precision;
+        }
+        if (h->num_items == 0
+                || h->items_offset > size
+                || h->num_items > (size - h->items_offset)
+                        / sizeof(struct set_item_entry)
+                || h->events_offset > size
+                || h->num_events > size - h->events_offset
+                || h->strings_offset > size
+                || ((char *)data)[size - 1] != '\0') {
+                munmap(data, size);
+                goto error_format;
+        }
+
+        struct set *s = create_set(name);
+        struct set_map *map;
+        if (!(map = malloc(sizeof(struct set_map))))
+                goto error_out;
+        memset(map, 0, sizeof(struct set_map));
+        map->data = data;
+        map->size = size;
+        s->map    = map;
+
+        /* allocate items, and input and target vectors */
+        uint64_t ne = h->num_events;
+        size_t block_size = h->num_items * sizeof(struct item);
+        if (!(map->items = malloc(block_size)))
+                goto error_out;
+        memset(map->items, 0, block_size);
+        block_size = 2 * ne * sizeof(struct vector);
+        if (!(map->vectors = malloc(block_size)))
+                goto error_out;
+        memset(map->vectors, 0, block_size);
+        block_size = 2 * ne * sizeof(struct vector *);
+        if (!(map->vector_ptrs = malloc(block_size)))
+                goto error_out;
+        memset(map->vector_ptrs, 0, block_size);
+
+        /*
+         * Point the vectors of each item into its event matrices. Input
+         * vectors are followed by target vectors.
+         */
+        struct set_item_entry *entries = (void *)((char *)data
+                + h->items_offset);
+        uint8_t *flags = (uint8_t *)data + h->events_offset;
+        char *strings  = (char *)data + h->strings_offset;
+        size_t strings_size = size - h->strings_offset;
+        size_t event_size = ((size_t)h->input_dims + h->output_dims)
+                * sizeof(real);
+        for (uint32_t i = 0; i < h->num_items; i++) {
+                struct set_item_entry *e = &entries[i];
+                if (e->first_event > ne
+                        || e->num_events > ne - e->first_event
+                        || e->data_offset > size
+                        || e->num_events > (size - e->data_offset)
+                                / (event_size > 0 ? event_size : 1)
+                        || (e->name_offset != UINT64_MAX
+                                && e->name_offset >= strings_size)
+                        || (e->meta_offset != UINT64_MAX
+                                && e->meta_offset >= strings_size)) {
+                        free_set(s);
+                        goto error_format;
+                }
+                real *inputs  = (real *)((char *)data + e->data_offset);
+                real *targets = inputs + (size_t)e->num_events
+                        * h->input_dims;
+                for (uint32_t j = 0; j < e->num_events; j++) {
+                        uint64_t x = e->first_event + j;
+                        struct vector *iv = &map->vectors[x];
+                        struct vector *tv = &map->vectors[ne + x];
+                        iv->size     = h->input_dims;
+                        iv->elements = inputs + (size_t)j * h->input_dims;
+                        tv->size     = h->output_dims;
+                        tv->elements = targets + (size_t)j * h->output_dims;
+                        map->vector_ptrs[x]      = iv;
+                        map->vector_ptrs[ne + x] = flags[x] ? tv : NULL;
+                }
+                struct item *item = &map->items[i];
+                item->name = e->name_offset != UINT64_MAX
+                        ? &strings[e->name_offset] : NULL;
+                item->meta = e->meta_offset != UINT64_MAX
+                        ? &strings[e->meta_offset] : NULL;
+                item->num_events = e->num_events;
+                item->inputs     = &map->vector_ptrs[e->first_event];
+                item->targets    = &map->vector_ptrs[ne + e->first_event];
+                add_to_array(s->items, item);
+        }
+
+        /* item order equals read order */
+        block_size = s->items->num_elements * sizeof(uint32_t);
+        if (!(s->order = malloc(block_size)))
+                goto error_out;
+        memset(s->order, 0, block_size);
+        order_set(s);
+
+        return s;
+
+error_file:
+        eprintf("Cannot load set - no such file '%s'\n", filename);
         return NULL;
 error_format:
         eprintf("Cannot load set - file has incorrect format\n");
         return NULL;
+error_version:
+        eprintf("Cannot load set - unsupported binary set version\n");
+        return NULL;
+error_precision:
+        eprintf("Cannot load set - binary set has units of incorrect size\n");
+        return NULL;
 error_out:
-        perror("[load_item()]");
+        perror("[load_binary_set()]");
         return NULL;
 }
 
+/*
+ * Note: The names, meta information, and vectors of the items in a binary
+ * set are part of its mapping, and are therefore not freed individually.
+ */
+void free_binary_set(struct set *s)
+{
+        free(s->map->items);
+        free(s->map->vectors);
+        free(s->map->vector_ptrs);
+        munmap(s->map->data, s->map->size);
+        free(s->map);
+        s->map = NULL;
+}
+
+bool save_binary_set(struct set *s, char *filename)
+{
+        real *zeros = NULL;
+        struct vector *dense = NULL;
+        FILE *fd;
+        if (!(fd = fopen(filename, "wb")))
+                goto error_file;
+
+        /*
+         * Determine the dimensions of the set from its input vectors, and
+         * its (first) target vector.
+         */
+        struct set_header h;
+        memset(&h, 0, sizeof(struct set_header));
+        memcpy(h.magic, SET_MAGIC, sizeof(SET_MAGIC));
+        h.version   = SET_VERSION;
+        h.real_size = sizeof(real);
+        h.num_items = s->items->num_elements;
+        for (uint32_t i = 0; i < s->items->num_elements; i++) {
+                struct item *item = s->items->elements[i];
+                for (uint32_t j = 0; j < item->num_events; j++) {
+                        h.input_dims = item_input_size(item, j);
+                        if (item->targets[j])
+                                h.output_dims = item->targets[j]->size;
+                }
+                h.num_events += item->num_events;
+        }
+        size_t block_size = h.output_dims * sizeof(real);
+        if (!(zeros = malloc(block_size)))
+                goto error_out;
+        memset(zeros, 0, block_size);
+        if (!(dense = create_vector(h.input_dims)))
+                goto error_out;
+
+        /* header (rewritten once all offsets are known) */
+        if (fwrite(&h, sizeof(struct set_header), 1, fd) != 1)
+                goto error_out;
+        uint64_t offset = sizeof(struct set_header);
+
+        /* event matrices */
+        for (uint32_t i = 0; i < s->items->num_elements; i++) {
+                struct item *item = s->items->elements[i];
+                for (uint32_t j = 0; j < item->num_events; j++) {
+                        struct vector *iv = item->inputs[j];
+                        /* sparse input vectors are stored densely */
+                        if (item->sparse_inputs && item->sparse_inputs[j]) {
+                                if (item->sparse_inputs[j]->size
+                                        != h.input_dims)
+                                        goto error_format;
+                                copy_sparse_vector(item->sparse_inputs[j],
+                                        dense);
+                                iv = dense;
+                        }
+                        if (iv->size != h.input_dims)
+                                goto error_format;
+                        if (fwrite(iv->elements, sizeof(real), iv->size, fd)
+                                != iv->size)
+                                goto error_out;
+                }
+                for (uint32_t j = 0; j < item->num_events; j++) {
+                        struct vector *tv = item->targets[j];
+                        if (tv && tv->size != h.output_dims)
+                                goto error_format;
+                        real *elements = tv ? tv->elements : zeros;
+                        if (fwrite(elements, sizeof(real), h.output_dims, fd)
+                                != h.output_dims)
+                                goto error_out;
+                }
+                offset += (uint64_t)item->num_events
+                        * (h.input_dims + h.output_dims) * sizeof(real);
+        }
+
+        /* item table */
+        h.items_offset = offset;
+        uint64_t data_offset = sizeof(struct set_header);
+        uint64_t first_event = 0, string_offset = 0;
+        for (uint32_t i = 0; i < s->items->num_elements; i++) {
+                struct item *item = s->items->elements[i];
+                struct set_item_entry e;
+                memset(&e, 0, sizeof(struct set_item_entry));
+                e.data_offset = data_offset;
+                e.first_event = first_event;
+                e.name_offset = UINT64_MAX;
+                e.meta_offset = UINT64_MAX;
+                e.num_events  = item->num_events;
+                if (item->name) {
+                        e.name_offset  = string_offset;
+                        string_offset += strlen(item->name) + 1;
+                }
+                if (item->meta) {
+                        e.meta_offset  = string_offset;
+                        string_offset += strlen(item->meta) + 1;
+                }
+                if (fwrite(&e, sizeof(struct set_item_entry), 1, fd) != 1)
+                        goto error_out;
+                data_offset += (uint64_t)item->num_events
+                        * (h.input_dims + h.output_dims) * sizeof(real);
+                first_event += item->num_events;
+        }
+        offset += h.num_items * sizeof(struct set_item_entry);
+
+        /* target flags */
+        h.events_offset = offset;
+        for (uint32_t i = 0; i < s->items->num_elements; i++) {
+                struct item *item = s->items->elements[i];
+                for (uint32_t j = 0; j < item->num_events; j++)
+                        if (fputc(item->targets[j] != NULL, fd) == EOF)
+                                goto error_out;
+        }
+        offset += h.num_events;
+
+        /* strings (the file always ends with a NUL character) */
+        h.strings_offset = offset;
+        for (uint32_t i = 0; i < s->items->num_elements; i++) {
+                struct item *item = s->items->elements[i];
+                if (item->name && fwrite(item->name, 1,
+                        strlen(item->name) + 1, fd) != strlen(item->name) + 1)
+                        goto error_out;
+                if (item->meta && fwrite(item->meta, 1,
+                        strlen(item->meta) + 1, fd) != strlen(item->meta) + 1)
+                        goto error_out;
+        }
+        if (fputc('\0', fd) == EOF)
+                goto error_out;
+
+        /* rewrite header */
+        rewind(fd);
+        if (fwrite(&h, sizeof(struct set_header), 1, fd) != 1)
+                goto error_out;
+        if (fclose(fd) != 0) {
+                fd = NULL;
+                goto error_out;
+        }
+        free(zeros);
+        free_vector(dense);
+
+        return true;
+
+error_file:
+        eprintf("Cannot save set - cannot open file '%s'\n", filename);
+        return false;
+error_format:
+        eprintf("Cannot save set - vectors of unequal size\n");
+        fclose(fd);
+        free(zeros);
+        free_vector(dense);
+        return false;
+error_out:
+        perror("[save_binary_set()]");
+        if (fd)
+                fclose(fd);
+        free(zeros);
+        if (dense)
+                free_vector(dense);
+        return false;
+}
+
                 /******************
                  **** ordering ****
                  ******************/
@@ -17,6 +17,7 @@
 #ifndef SET_H
 #define SET_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 
@@ -24,12 +25,17 @@
 #include "pprint.h"
 #include "vector.h"
 
+#define SET_MAGIC "MESHSET"
+#define SET_VERSION 1
+
 /* set */
 struct set
 {
         char *name;                     /* name of this set */
         struct array *items;            /* items */
         uint32_t *order;                /* order in which to present items */
+        struct set_map *map;            /* memory-mapped set (if any) */
+        struct set_stream *stream;      /* streamed set (if any) */
 };
 
 /* item */
@@ -40,6 +46,54 @@ struct item
         char *meta;                     /* meta information */
         struct vector **inputs;         /* input vectors */
         struct vector **targets;        /* target vectors */
+        struct sparse_vector **sparse_inputs; /* sparse input vectors (if any) */
+};
+
+/* item parse status */
+enum parse_status
+{
+        pstat_ok,                       /* parsed */
+        pstat_input_vector,             /* input vector of incorrect size */
+        pstat_target_vector,            /* target vector of incorrect size */
+        pstat_empty_item,               /* item without events */
+        pstat_out_of_memory             /* out of memory */
+};
+
+/* memory-mapped set */
+struct set_map
+{
+        void *data;                     /* mapped set file */
+        size_t size;                    /* size of the mapped file */
+        struct item *items;             /* items */
+        struct vector *vectors;         /* input and target vectors */
+        struct vector **vector_ptrs;    /* pointers to these vectors */
+};
+
+/* binary set file header */
+struct set_header
+{
+        char magic[8];                  /* SET_MAGIC */
+        uint32_t version;               /* format version */
+        uint32_t real_size;             /* size of units (in bytes) */
+        uint32_t input_dims;            /* input dimensions */
+        uint32_t output_dims;           /* output dimensions */
+        uint32_t num_items;             /* number of items */
+        uint32_t reserved;              /* (unused) */
+        uint64_t num_events;            /* total number of events */
+        uint64_t items_offset;          /* offset of item table */
+        uint64_t events_offset;         /* offset of target flags */
+        uint64_t strings_offset;        /* offset of names and meta info */
+};
+
+/* binary set file item table entry */
+struct set_item_entry
+{
+        uint64_t data_offset;           /* offset of event matrices */
+        uint64_t first_event;           /* index of first event */
+        uint64_t name_offset;           /* offset of name in strings */
+        uint64_t meta_offset;           /* offset of meta in strings */
+        uint32_t num_events;            /* number of events */
+        uint32_t reserved;              /* (unused) */
 };
 
 struct set *create_set(char *name);
@@ -50,12 +104,26 @@ struct item *create_item(char *name, char *meta, uint32_t num_events,
 void free_item(struct item *item);
 void print_items(struct set *set);
 void print_item(struct item *item, bool pprint, enum color_scheme scheme);
+void print_item_input(struct item *item, uint32_t event, bool pprint,
+        enum color_scheme scheme);
+uint32_t item_input_size(struct item *item, uint32_t event);
 
 struct set *load_legacy_set(char *name, char *filename, uint32_t input_size,
         uint32_t output_size);
 struct set *load_set(char *name, char *filename, uint32_t input_size,
         uint32_t output_size);
-struct item *load_item(FILE *fd, uint32_t input_dims, uint32_t output_dims);
+struct item *parse_item(char *s, char *end, uint32_t input_dims,
+        uint32_t output_dims, enum parse_status *status);
+char *scan_quoted(char *s, char *end, char *key, enum parse_status *status);
+char *scan_token(char *s, char *end, char *token);
+char *scan_real(char *s, char *end, real *x);
+char *scan_sparse(char *s, char *end, uint32_t dims,
+        struct sparse_vector **v, enum parse_status *status);
+
+bool is_binary_set(char *filename);
+struct set *load_binary_set(char *name, char *filename);
+void free_binary_set(struct set *s);
+bool save_binary_set(struct set *s, char *filename);
 
 void order_set(struct set *s);
 void permute_set(struct set *s);
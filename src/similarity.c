@@ -20,6 +20,7 @@
 #include <stdio.h>
 
 #include "engine.h"
+#include "evaluate.h"
 #include "main.h"
 #include "similarity.h"
 
@@ -51,32 +52,17 @@ struct matrix *similarity_matrix(struct network *n)
 
         keep_running = true;   
         
+        /*
+         * Each item fills its own row of the matrix (see evaluate.c).
+         */
         uint32_t d = n->asp->items->num_elements;
         struct matrix *sm = create_matrix(d, d);
-        for (uint32_t i = 0; i < n->asp->items->num_elements; i++) {
-                if (!keep_running) {
-                        keep_running = true;
-                        goto out;
-                }
-                struct item *item = n->asp->items->elements[i];
-                reset_ticks(n);
-                for (uint32_t j = 0; j < item->num_events; j++) {
-                        if (j > 0)
-                                next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
-                        forward_sweep(n);
-                        if (!(item->targets[j] && j == item->num_events - 1))
-                                continue;
-                        struct vector *ov = output_vector(n);
-                        for (uint32_t x = 0; x < n->asp->items->num_elements; x++) {
-                                struct item *ci   = n->asp->items->elements[x];
-                                struct vector *tv = ci->targets[ci->num_events - 1];
-                                if (!tv)
-                                        continue;
-                                sm->elements[i][x] = n->similarity_metric(ov, tv);
-                        }
-                }
-        }
+        struct evaluator *e;
+        if (!(e = create_evaluator(n)))
+                goto out;
+        if (!evaluate_items(e, 0, d, similarity_item_event, sm, &keep_running))
+                keep_running = true;
+        free_evaluator(e);
 
 out:
         sa.sa_handler = SIG_DFL;
@@ -85,6 +71,22 @@ out:
         return sm;
 }
 
+void similarity_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data)
+{
+        struct matrix *sm = data;
+        if (!(item->targets[j] && j == item->num_events - 1))
+                return;
+        struct vector *ov = output_vector(n);
+        for (uint32_t x = 0; x < n->asp->items->num_elements; x++) {
+                struct item *ci   = n->asp->items->elements[x];
+                struct vector *tv = ci->targets[ci->num_events - 1];
+                if (!tv)
+                        continue;
+                sm->elements[i][x] = n->similarity_metric(ov, tv);
+        }
+}
+
 void print_sm_summary(struct network *n, bool print_sm, bool pprint,
         enum color_scheme scheme)
 {
@@ -22,8 +22,11 @@
 #include "network.h"
 #include "matrix.h"
 #include "pprint.h"
+#include "set.h"
 
 struct matrix *similarity_matrix(struct network *n);
+void similarity_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data);
 void print_sm_summary(struct network *n, bool print_sm, bool pprint,
         enum color_scheme scheme);
 void similarity_signal_handler(int32_t signal);
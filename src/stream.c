@@ -0,0 +1,541 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "network.h"
+#include "stream.h"
+
+                /**********************
+                 **** streamed sets ****
+                 **********************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Streamed sets allow for training on binary set files (see set.c) that are
+larger than memory. Rather than loading all items of a set, a streamed set
+only keeps its set file open, and items are read from disk while the network
+is trained.
+
+Reading is done by a background thread, which fills a ring buffer of item
+slots. Training takes the items of each batch from this buffer, and
+releases them once the batch has been processed, after which their slots
+are reused. The buffer holds the items of one batch, plus
+STREAM_PREFETCH_ITEMS items that are read ahead, such that memory use
+depends on the batch size, and on the size of the largest item, but not on
+the size of the set. Slots grow to fit the largest item read so far.
+
+Items are read in blocks of STREAM_BLOCK_SIZE consecutive items. If the
+training order is ordered, blocks and items are read in the order of the
+set file. Otherwise, the order of blocks is permuted (or randomized) on
+each pass through the set, as is the order of items within each block.
+Apart from the item slots, a streamed set only keeps the order of its
+blocks in memory (one index per STREAM_BLOCK_SIZE items).
+
+The reader thread uses its own random number generator, which is seeded
+from that of Mesh when training starts, such that streamed training is
+reproducible for a given random seed.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct set *load_streamed_set(char *name, char *filename)
+{
+        int fd;
+        if ((fd = open(filename, O_RDONLY)) == -1)
+                goto error_file;
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+                close(fd);
+                goto error_out;
+        }
+        uint64_t size = sb.st_size;
+        struct set_header h;
+        char last = '\0';
+        if (size < sizeof(struct set_header)
+                || !stream_pread(fd, &h, sizeof(struct set_header), 0)
+                || !stream_pread(fd, &last, 1, size - 1)) {
+                close(fd);
+                goto error_format;
+        }
+
+        /* verify header */
+        if (memcmp(h.magic, SET_MAGIC, sizeof(SET_MAGIC)) != 0) {
+                close(fd);
+                goto error_format;
+        }
+        if (h.version != SET_VERSION) {
+                close(fd);
+                goto error_version;
+        }
+        if (h.real_size != sizeof(real)) {
+                close(fd);
+                goto error_precision;
+        }
+        if (h.num_items == 0
+                || h.items_offset > size
+                || h.num_items > (size - h.items_offset)
+                        / sizeof(struct set_item_entry)
+                || h.events_offset > size
+                || h.num_events > size - h.events_offset
+                || h.strings_offset > size
+                || last != '\0') {
+                close(fd);
+                goto error_format;
+        }
+
+        struct set *s = create_set(name);
+        struct set_stream *st;
+        if (!(st = malloc(sizeof(struct set_stream))))
+                goto error_out;
+        memset(st, 0, sizeof(struct set_stream));
+        st->fd     = fd;
+        st->size   = size;
+        st->header = h;
+        s->stream  = st;
+
+        /* blocks, and item table of a block */
+        st->num_blocks = (h.num_items + STREAM_BLOCK_SIZE - 1)
+                / STREAM_BLOCK_SIZE;
+        size_t block_size = st->num_blocks * sizeof(uint32_t);
+        if (!(st->blocks = malloc(block_size)))
+                goto error_out;
+        memset(st->blocks, 0, block_size);
+        block_size = STREAM_BLOCK_SIZE * sizeof(struct set_item_entry);
+        if (!(st->entries = malloc(block_size)))
+                goto error_out;
+        memset(st->entries, 0, block_size);
+
+        pthread_mutex_init(&st->mutex, NULL);
+        pthread_cond_init(&st->filled, NULL);
+        pthread_cond_init(&st->freed, NULL);
+
+        return s;
+
+error_file:
+        eprintf("Cannot stream set - no such file '%s'\n", filename);
+        return NULL;
+error_format:
+        eprintf("Cannot stream set - file has incorrect format\n");
+        return NULL;
+error_version:
+        eprintf("Cannot stream set - unsupported binary set version\n");
+        return NULL;
+error_precision:
+        eprintf("Cannot stream set - binary set has units of incorrect size\n");
+        return NULL;
+error_out:
+        perror("[load_streamed_set()]");
+        return NULL;
+}
+
+void free_streamed_set(struct set *s)
+{
+        struct set_stream *st = s->stream;
+        stop_stream(st);
+        free_stream_slots(st);
+        free(st->blocks);
+        free(st->entries);
+        close(st->fd);
+        pthread_mutex_destroy(&st->mutex);
+        pthread_cond_destroy(&st->filled);
+        pthread_cond_destroy(&st->freed);
+        free(st);
+        s->stream = NULL;
+}
+
+void free_stream_slots(struct set_stream *st)
+{
+        for (uint32_t i = 0; i < st->num_slots; i++) {
+                struct stream_slot *slot = &st->slots[i];
+                free(slot->data);
+                free(slot->vectors);
+                free(slot->vector_ptrs);
+                free(slot->flags);
+                free(slot->name);
+                free(slot->meta);
+        }
+        free(st->slots);
+        st->slots     = NULL;
+        st->num_slots = 0;
+}
+
+/*
+ * Starts reading items from the start of streamed set st into a ring
+ * buffer of num_slots items, in the specified training order.
+ */
+bool start_stream(struct set_stream *st, uint32_t num_slots, uint32_t order)
+{
+        stop_stream(st);
+        if (num_slots != st->num_slots) {
+                free_stream_slots(st);
+                size_t block_size = num_slots * sizeof(struct stream_slot);
+                if (!(st->slots = malloc(block_size)))
+                        goto error_out;
+                memset(st->slots, 0, block_size);
+                st->num_slots = num_slots;
+        }
+
+        st->order    = order;
+        st->seed     = rand();
+        st->head     = 0;
+        st->tail     = 0;
+        st->released = 0;
+        st->stop     = false;
+        st->failed   = false;
+        posix_fadvise(st->fd, 0, 0, order == train_ordered
+                ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+
+        int rc;
+        if ((rc = pthread_create(&st->thread, NULL, stream_reader, st)) != 0) {
+                errno = rc;
+                goto error_out;
+        }
+        st->running = true;
+
+        return true;
+
+error_out:
+        perror("[start_stream()]");
+        return false;
+}
+
+void stop_stream(struct set_stream *st)
+{
+        if (!st->running)
+                return;
+        pthread_mutex_lock(&st->mutex);
+        st->stop = true;
+        pthread_cond_broadcast(&st->freed);
+        pthread_mutex_unlock(&st->mutex);
+        pthread_join(st->thread, NULL);
+        st->running = false;
+}
+
+/*
+ * Takes the next num_items items from streamed set st, waiting for the
+ * reader thread if necessary. Items remain valid until they are released.
+ * Returns false if the reader thread failed.
+ */
+bool stream_items(struct set_stream *st, struct item **items,
+        uint32_t num_items)
+{
+        pthread_mutex_lock(&st->mutex);
+        for (uint32_t i = 0; i < num_items; i++) {
+                while (st->tail == st->head && !st->failed)
+                        pthread_cond_wait(&st->filled, &st->mutex);
+                if (st->tail == st->head) {
+                        pthread_mutex_unlock(&st->mutex);
+                        return false;
+                }
+                items[i] = &st->slots[st->tail++ % st->num_slots].item;
+        }
+        pthread_mutex_unlock(&st->mutex);
+        return true;
+}
+
+/*
+ * Releases all items that have been taken from streamed set st, such that
+ * their slots can be reused by the reader thread.
+ */
+void release_stream_items(struct set_stream *st)
+{
+        pthread_mutex_lock(&st->mutex);
+        st->released = st->tail;
+        pthread_cond_broadcast(&st->freed);
+        pthread_mutex_unlock(&st->mutex);
+}
+
+                /***********************
+                 **** reader thread ****
+                 ***********************/
+
+/*
+ * Reads items into the ring buffer of a streamed set, pass after pass,
+ * until it is stopped. Only the reader thread writes the slot at the head
+ * of the buffer, and it only does so once that slot has been released.
+ */
+void *stream_reader(void *arg)
+{
+        struct set_stream *st = arg;
+        uint32_t order[STREAM_BLOCK_SIZE];
+        for (;;) {
+                stream_order_blocks(st);
+                for (uint32_t b = 0; b < st->num_blocks; b++) {
+                        uint32_t num_entries;
+                        if (!stream_read_block(st, st->blocks[b],
+                                &num_entries))
+                                goto error_out;
+                        stream_order_entries(st, num_entries, order);
+                        for (uint32_t i = 0; i < num_entries; i++) {
+                                /* wait for a free slot */
+                                pthread_mutex_lock(&st->mutex);
+                                while (st->head - st->released
+                                        == st->num_slots && !st->stop)
+                                        pthread_cond_wait(&st->freed,
+                                                &st->mutex);
+                                bool stop = st->stop;
+                                pthread_mutex_unlock(&st->mutex);
+                                if (stop)
+                                        return NULL;
+
+                                struct stream_slot *slot = &st->slots[
+                                        st->head % st->num_slots];
+                                if (!stream_read_item(st,
+                                        &st->entries[order[i]], slot))
+                                        goto error_out;
+
+                                pthread_mutex_lock(&st->mutex);
+                                st->head++;
+                                pthread_cond_signal(&st->filled);
+                                pthread_mutex_unlock(&st->mutex);
+                        }
+                }
+        }
+
+error_out:
+        pthread_mutex_lock(&st->mutex);
+        st->failed = true;
+        pthread_cond_broadcast(&st->filled);
+        pthread_mutex_unlock(&st->mutex);
+        return NULL;
+}
+
+/*
+ * Determines the order in which the blocks of a streamed set are read
+ * during the next pass through the set.
+ */
+void stream_order_blocks(struct set_stream *st)
+{
+        for (uint32_t i = 0; i < st->num_blocks; i++)
+                st->blocks[i] = i;
+        if (st->order == train_ordered)
+                return;
+        for (uint32_t i = 0; i < st->num_blocks; i++) {
+                double r = (double)rand_r(&st->seed)
+                        / ((double)RAND_MAX + 1.0);
+                if (st->order == train_permuted) {
+                        uint32_t x = i + r * (st->num_blocks - i);
+                        uint32_t b = st->blocks[i];
+                        st->blocks[i] = st->blocks[x];
+                        st->blocks[x] = b;
+                } else {
+                        st->blocks[i] = r * st->num_blocks;
+                }
+        }
+}
+
+/*
+ * Reads the item table entries of a block of a streamed set.
+ */
+bool stream_read_block(struct set_stream *st, uint32_t block,
+        uint32_t *num_entries)
+{
+        uint32_t first = block * STREAM_BLOCK_SIZE;
+        *num_entries = st->header.num_items - first;
+        if (*num_entries > STREAM_BLOCK_SIZE)
+                *num_entries = STREAM_BLOCK_SIZE;
+        if (!stream_pread(st->fd, st->entries,
+                *num_entries * sizeof(struct set_item_entry),
+                st->header.items_offset
+                        + (uint64_t)first * sizeof(struct set_item_entry)))
+                goto error_out;
+
+        return true;
+
+error_out:
+        perror("[stream_read_block()]");
+        return false;
+}
+
+/*
+ * Determines the order in which the items of the current block of a
+ * streamed set are read.
+ */
+void stream_order_entries(struct set_stream *st, uint32_t num_entries,
+        uint32_t *order)
+{
+        for (uint32_t i = 0; i < num_entries; i++)
+                order[i] = i;
+        if (st->order == train_ordered)
+                return;
+        for (uint32_t i = 0; i < num_entries; i++) {
+                double r = (double)rand_r(&st->seed)
+                        / ((double)RAND_MAX + 1.0);
+                if (st->order == train_permuted) {
+                        uint32_t x = i + r * (num_entries - i);
+                        uint32_t e = order[i];
+                        order[i] = order[x];
+                        order[x] = e;
+                } else {
+                        order[i] = r * num_entries;
+                }
+        }
+}
+
+/*
+ * Reads the item described by item table entry e into a slot. The vectors
+ * of the item point into the event matrices of the slot, which are laid
+ * out as in the set file: input vectors are followed by target vectors.
+ */
+bool stream_read_item(struct set_stream *st, struct set_item_entry *e,
+        struct stream_slot *slot)
+{
+        struct set_header *h = &st->header;
+        uint64_t ne = h->num_events;
+        uint64_t strings_size = st->size - h->strings_offset;
+        size_t event_size = ((size_t)h->input_dims + h->output_dims)
+                * sizeof(real);
+        if (e->first_event > ne
+                || e->num_events > ne - e->first_event
+                || e->data_offset > st->size
+                || e->num_events > (st->size - e->data_offset)
+                        / (event_size > 0 ? event_size : 1)
+                || (e->name_offset != UINT64_MAX
+                        && e->name_offset >= strings_size)
+                || (e->meta_offset != UINT64_MAX
+                        && e->meta_offset >= strings_size))
+                goto error_format;
+
+        /* grow slot if necessary */
+        uint32_t num_events = e->num_events;
+        if (num_events > slot->max_events) {
+                void *p;
+                if (!(p = realloc(slot->data, num_events * event_size)))
+                        goto error_out;
+                slot->data = p;
+                if (!(p = realloc(slot->vectors,
+                        2 * num_events * sizeof(struct vector))))
+                        goto error_out;
+                slot->vectors = p;
+                if (!(p = realloc(slot->vector_ptrs,
+                        2 * num_events * sizeof(struct vector *))))
+                        goto error_out;
+                slot->vector_ptrs = p;
+                if (!(p = realloc(slot->flags, num_events * sizeof(uint8_t))))
+                        goto error_out;
+                slot->flags = p;
+                slot->max_events = num_events;
+        }
+
+        /* event matrices and target flags */
+        if (!stream_pread(st->fd, slot->data, num_events * event_size,
+                e->data_offset))
+                goto error_out;
+        if (!stream_pread(st->fd, slot->flags, num_events,
+                h->events_offset + e->first_event))
+                goto error_out;
+        real *inputs  = slot->data;
+        real *targets = inputs + (size_t)num_events * h->input_dims;
+        for (uint32_t j = 0; j < num_events; j++) {
+                struct vector *iv = &slot->vectors[j];
+                struct vector *tv = &slot->vectors[num_events + j];
+                iv->size     = h->input_dims;
+                iv->elements = inputs + (size_t)j * h->input_dims;
+                tv->size     = h->output_dims;
+                tv->elements = targets + (size_t)j * h->output_dims;
+                slot->vector_ptrs[j]              = iv;
+                slot->vector_ptrs[num_events + j] = slot->flags[j] ? tv : NULL;
+        }
+
+        /* name and meta information */
+        struct item *item = &slot->item;
+        item->name = NULL;
+        item->meta = NULL;
+        if (e->name_offset != UINT64_MAX) {
+                if (!stream_read_string(st, h->strings_offset
+                        + e->name_offset, &slot->name, &slot->name_size))
+                        goto error_out;
+                item->name = slot->name;
+        }
+        if (e->meta_offset != UINT64_MAX) {
+                if (!stream_read_string(st, h->strings_offset
+                        + e->meta_offset, &slot->meta, &slot->meta_size))
+                        goto error_out;
+                item->meta = slot->meta;
+        }
+        item->num_events = num_events;
+        item->inputs     = slot->vector_ptrs;
+        item->targets    = &slot->vector_ptrs[num_events];
+
+        return true;
+
+error_format:
+        eprintf("Cannot stream set - file has incorrect format\n");
+        return false;
+error_out:
+        perror("[stream_read_item()]");
+        return false;
+}
+
+/*
+ * Reads the NUL-terminated string at offset into buffer s of the given
+ * size, which is grown as necessary. As set files always end with a NUL
+ * character, each string that starts within the file is terminated.
+ */
+bool stream_read_string(struct set_stream *st, uint64_t offset,
+        char **s, size_t *size)
+{
+        size_t len = 0;
+        for (;;) {
+                if (len == *size) {
+                        size_t block_size = *size > 0 ? 2 * *size : 64;
+                        void *p;
+                        if (!(p = realloc(*s, block_size)))
+                                return false;
+                        *s    = p;
+                        *size = block_size;
+                }
+                size_t chunk = *size - len;
+                if (chunk > st->size - (offset + len))
+                        chunk = st->size - (offset + len);
+                if (chunk == 0) {
+                        errno = EIO;
+                        return false;
+                }
+                if (!stream_pread(st->fd, *s + len, chunk, offset + len))
+                        return false;
+                if (memchr(*s + len, '\0', chunk))
+                        return true;
+                len += chunk;
+        }
+}
+
+/*
+ * Reads size bytes at offset from file descriptor fd, retrying reads that
+ * are interrupted or that return fewer bytes.
+ */
+bool stream_pread(int fd, void *buf, size_t size, uint64_t offset)
+{
+        char *p = buf;
+        while (size > 0) {
+                ssize_t n = pread(fd, p, size, offset);
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n <= 0) {
+                        if (n == 0)
+                                errno = EIO;
+                        return false;
+                }
+                p      += n;
+                size   -= n;
+                offset += n;
+        }
+        return true;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2012-2022 Harm Brouwer <me@hbrouwer.eu>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "set.h"
+#include "vector.h"
+
+/*
+ * Number of consecutive items that are read as one block, and number of
+ * items that are read ahead of training.
+ */
+#define STREAM_BLOCK_SIZE 256
+#define STREAM_PREFETCH_ITEMS (4 * STREAM_BLOCK_SIZE)
+
+/* item slot of a streamed set */
+struct stream_slot
+{
+        struct item item;               /* item */
+        uint32_t max_events;            /* number of allocated events */
+        real *data;                     /* event matrices */
+        struct vector *vectors;         /* input and target vectors */
+        struct vector **vector_ptrs;    /* pointers to these vectors */
+        uint8_t *flags;                 /* target flags */
+        char *name;                     /* name buffer */
+        size_t name_size;               /* size of name buffer */
+        char *meta;                     /* meta information buffer */
+        size_t meta_size;               /* size of meta buffer */
+};
+
+/* streamed set */
+struct set_stream
+{
+        int fd;                         /* set file */
+        uint64_t size;                  /* size of the set file */
+        struct set_header header;       /* set file header */
+        uint32_t num_blocks;            /* number of blocks */
+        uint32_t *blocks;               /* order in which to read blocks */
+        struct set_item_entry *entries; /* item table of current block */
+        uint32_t order;                 /* training order */
+        unsigned int seed;              /* seed of the reader thread */
+        struct stream_slot *slots;      /* ring buffer of item slots */
+        uint32_t num_slots;             /* number of item slots */
+        uint64_t head;                  /* number of items read */
+        uint64_t tail;                  /* number of items handed out */
+        uint64_t released;              /* number of items released */
+        bool running;                   /* reader thread is running */
+        bool stop;                      /* reader thread should stop */
+        bool failed;                    /* reader thread failed */
+        pthread_t thread;               /* reader thread */
+        pthread_mutex_t mutex;          /* protects the ring buffer */
+        pthread_cond_t filled;          /* signals that an item was read */
+        pthread_cond_t freed;           /* signals that slots were freed */
+};
+
+struct set *load_streamed_set(char *name, char *filename);
+void free_streamed_set(struct set *s);
+void free_stream_slots(struct set_stream *st);
+
+bool start_stream(struct set_stream *st, uint32_t num_slots,
+        uint32_t order);
+void stop_stream(struct set_stream *st);
+bool stream_items(struct set_stream *st, struct item **items,
+        uint32_t num_items);
+void release_stream_items(struct set_stream *st);
+
+void *stream_reader(void *arg);
+void stream_order_blocks(struct set_stream *st);
+bool stream_read_block(struct set_stream *st, uint32_t block,
+        uint32_t *num_entries);
+void stream_order_entries(struct set_stream *st, uint32_t num_entries,
+        uint32_t *order);
+bool stream_read_item(struct set_stream *st, struct set_item_entry *e,
+        struct stream_slot *slot);
+bool stream_read_string(struct set_stream *st, uint64_t offset,
+        char **s, size_t *size);
+bool stream_pread(int fd, void *buf, size_t size, uint64_t offset);
+
+#endif /* STREAM_H */
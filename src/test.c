@@ -18,9 +18,11 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "engine.h"
 #include "error.h"
+#include "evaluate.h"
 #include "main.h"
 #include "pprint.h"
 #include "test.h"
@@ -41,36 +43,46 @@ void test_network(struct network *n, bool verbose)
 
         keep_running = true;
 
+        /*
+         * Determine the error for each item, and combine these in item
+         * order (see evaluate.c).
+         */
+        uint32_t ni = n->asp->items->num_elements;
+        struct test_scores ts = {NULL, NULL};
+        if (!(ts.errors = malloc(ni * sizeof(double))))
+                goto error_out;
+        if (!(ts.scored = calloc(ni, sizeof(bool))))
+                goto error_out;
+        struct evaluator *e;
+        if (!(e = create_evaluator(n)))
+                goto out;
+        bool done = evaluate_items(e, 0, ni, test_item_event, &ts,
+                &keep_running);
+        free_evaluator(e);
+        if (!done) {
+                keep_running = true;
+                goto out;
+        }
+
         n->status->error = 0.0;
         uint32_t tr      = 0;
         if (verbose)
                 cprintf("\n");
-        for (uint32_t i = 0; i < n->asp->items->num_elements; i++) {
-                if (!keep_running) {
-                        keep_running = true;
-                        goto out;
-                }
+        for (uint32_t i = 0; i < ni; i++) {
+                if (!ts.scored[i])
+                        continue;
                 struct item *item = n->asp->items->elements[i];
-                reset_ticks(n);
-                for (uint32_t j = 0; j < item->num_events; j++) {
-                        if (j > 0)
-                                next_tick(n);
-                        clamp_input_vector(n, item->inputs[j]);
-                        forward_sweep(n);
-                        if (!(item->targets[j] && j == item->num_events - 1))
-                                continue;
-                        double error = output_error(n, item->targets[j]);
-                        n->status->error += error;
-                        if (error <= n->pars->error_threshold)
-                                tr++;
-                        if (!verbose)
-                                continue;
-                        error <= n->pars->error_threshold
-                                ? pprintf("%d: \x1b[32m%s: %f\x1b[0m\n",
-                                        i + 1, item->name, error)
-                                : pprintf("%d: \x1b[31m%s: %f\x1b[0m\n",
-                                        i + 1, item->name, error);
-                }
+                double error = ts.errors[i];
+                n->status->error += error;
+                if (error <= n->pars->error_threshold)
+                        tr++;
+                if (!verbose)
+                        continue;
+                error <= n->pars->error_threshold
+                        ? pprintf("%d: \x1b[32m%s: %f\x1b[0m\n",
+                                i + 1, item->name, error)
+                        : pprintf("%d: \x1b[31m%s: %f\x1b[0m\n",
+                                i + 1, item->name, error);
         }
         
         cprintf("\n");
@@ -88,8 +100,30 @@ void test_network(struct network *n, bool verbose)
         cprintf("\n");
 
 out:
+        free(ts.errors);
+        free(ts.scored);
+
         sa.sa_handler = SIG_DFL;
         sigaction(SIGINT, &sa, NULL);
+
+        return;
+
+error_out:
+        perror("[test_network()]");
+        goto out;
+}
+
+/*
+ * Stores the error of an item, if it has a target for its final event.
+ */
+void test_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data)
+{
+        struct test_scores *ts = data;
+        if (!(item->targets[j] && j == item->num_events - 1))
+                return;
+        ts->errors[i] = output_error(n, item->targets[j]);
+        ts->scored[i] = true;
 }
 
                 /********************************
@@ -112,13 +146,12 @@ void test_network_with_item(struct network *n, struct item *item,
         for (uint32_t i = 0; i < item->num_events; i++) {
                 if(i > 0)
                         next_tick(n);
-                clamp_input_vector(n, item->inputs[i]);
+                clamp_input_event(n, item, i);
                 forward_sweep(n);
                 cprintf("\n");
                 cprintf("E: %d\n", i + 1);
                 cprintf("I: ");
-                pprint ? pprint_vector(item->inputs[i], scheme)
-                       : print_vector(item->inputs[i]);
+                print_item_input(item, i, pprint, scheme);
                 if (item->targets[i]) {
                         cprintf("T: ");
                         pprint ? pprint_vector(item->targets[i], scheme)
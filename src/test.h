@@ -17,6 +17,7 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "network.h"
@@ -24,7 +25,18 @@
 #include "session.h"
 #include "set.h"
 
+/*
+ * Per-item test results, indexed by item.
+ */
+struct test_scores
+{
+        double *errors;                 /* error per item */
+        bool *scored;                   /* flags whether item has error */
+};
+
 void test_network(struct network *n, bool verbose);
+void test_item_event(struct network *n, struct item *item, uint32_t i,
+        uint32_t j, void *data);
 void test_network_with_item(struct network *n, struct item *item,
         bool pprint, enum color_scheme scheme);
 void test_signal_handler(int32_t signal);
@@ -14,15 +14,23 @@
  * limitations under the License.
  */
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 #include "act.h"
+#include "batch.h"
 #include "bp.h"
 #include "engine.h"
 #include "main.h"
+#include "replica.h"
 #include "rnn_unfold.h"
+#include "stream.h"
 #include "train.h"
 
 static bool keep_running = true;
@@ -38,7 +46,10 @@ void train_network(struct network *n)
         sa.sa_flags = SA_RESTART;
         sigaction(SIGINT, &sa, NULL);
         keep_running = true;
+        adjust_projection_matrices(n, true);
         n->learning_algorithm(n);
+        bp_catch_up_network(n);
+        n->status->report = true;
         sa.sa_handler = SIG_DFL;
         sigaction(SIGINT, &sa, NULL);
         cprintf("\n");
@@ -56,121 +67,371 @@ updated after each batch.
 
 void train_network_with_bp(struct network *n)
 {
+        train_network_in_batches(n, train_item_with_bp);
+}
+
+double train_item_with_bp(struct network *n, struct item *item)
+{
+        double error = 0.0;
+        reset_ticks(n);
+        for (uint32_t j = 0; j < item->num_events; j++) {
+                if (j > 0)
+                        next_tick(n);
+                clamp_input_event(n, item, j);
+                forward_sweep(n);
+                if (!item->targets[j])
+                        continue;
+                reset_error_signals(n);
+                inject_error(n, item->targets[j]);
+                backward_sweep(n);
+                if (n->ts_bw_group) /* two-stage backward sweep */
+                        two_stage_backward_sweep(n, item, j);
+                if (j == item->num_events - 1)
+                        error += output_error(n, item->targets[j]);
+                if (n->ts_fw_group) /* two-stage forward sweep */
+                        two_stage_forward_sweep(n, item, j);
+        }
+        return error;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Mini-batch backpropagation training for feed forward networks (see batch.c).
+Items are clamped onto the network in batches of at most BATCH_MAX_ROWS
+items, which are propagated forward and backward at once. This returns the
+summed error of all items.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double train_items_with_batched_bp(struct network *n, struct batch *b,
+        struct item **items, uint32_t num_items)
+{
+        double error = 0.0;
+        struct vector *targets[b->max_rows];
+        for (uint32_t i = 0; i < num_items;) {
+                if (!keep_running)
+                        break;
+                batch_reset(n, b);
+                for (; i < num_items && b->num_rows < b->max_rows; i++) {
+                        if (!items[i]->targets[0])
+                                continue;
+                        targets[b->num_rows] = items[i]->targets[0];
+                        batch_clamp_input_event(n, b, items[i], 0);
+                }
+                if (b->num_rows == 0)
+                        continue;
+                batch_forward_sweep(n, b);
+                error += batch_inject_error(n, b, targets);
+                batch_backward_sweep(n, b);
+        }
+        return error;
+}
+
+                /**************************************
+                 **** backpropagation through time ****
+                 **************************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Backpropagation Through Time (BPTT) training. For each event of an item,
+error is injected if a target pattern is present. Error is only
+backpropagated once all events of an item have been processed. Weights are
+updated after each batch.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void train_network_with_bptt(struct network *n)
+{
+        train_network_in_batches(n, train_item_with_bptt);
+}
+
+double train_item_with_bptt(struct network *n, struct item *item)
+{
+        double error = 0.0;
+        reset_ticks(n);
+        reset_error_signals(n);
+        for (uint32_t j = 0; j < item->num_events; j++) {
+                if (j > 0)
+                        next_tick(n);
+                clamp_input_event(n, item, j);
+                forward_sweep(n);
+                if (!item->targets[j])
+                        continue;
+                inject_error(n, item->targets[j]);
+                if (n->unfolded_net->sp == n->unfolded_net->stack_size - 1
+                        || j == item->num_events - 1) {
+                        backward_sweep(n);
+                        if (n->ts_bw_group) /* two-stage backward sweep */
+                                two_stage_backward_sweep(n, item, j);
+                        error += output_error(n, item->targets[j]);
+                }
+                if (n->ts_fw_group) /* two-stage forward sweep */
+                        two_stage_forward_sweep(n, item, j);
+        }
+        return error;
+}
+
+                /*************************
+                 **** hogwild training ****
+                 *************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Asynchronous ("Hogwild!") backpropagation training (see bp.c). Worker
+threads repeatedly claim the next item of an epoch through a shared cursor,
+train on that item using their own replica of the network (see replica.c),
+and directly adjust the shared weights using steepest descent. Each epoch
+covers batch_size items. As weights are adjusted after each item, the
+update algorithm of the network is not used. Hogwild training is available
+for feed forward and simple recurrent networks.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void train_network_with_hogwild(struct network *n)
+{
+        if (n->flags->type == ntype_rnn) {
+                eprintf("Cannot train network - Hogwild training requires an 'ffn' or 'srn' network\n");
+                return;
+        }
+        if (n->asp->stream) {
+                eprintf("Cannot train network - Hogwild training does not support streamed sets\n");
+                return;
+        }
+
+        uint32_t bs = n->pars->batch_size;
+        uint32_t num_workers = 1;
+#ifdef _OPENMP
+        if (!n->flags->dcs)
+                num_workers = omp_get_max_threads();
+#endif /* _OPENMP */
+        struct network *workers[num_workers];
+        for (uint32_t t = 0; t < num_workers; t++)
+                workers[t] = t == 0 ? n : create_replica(n);
+
+        struct timespec ts0, ts1;
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        uint64_t num_items = 0;
+
         uint32_t z = 0;
         for (uint32_t epoch = 1; epoch <= n->pars->max_epochs; epoch++) {
                 n->status->epoch      = epoch;
                 n->status->prev_error = n->status->error;
                 n->status->error      = 0.0;
+                n->status->report     = report_epoch(n);
                 if (z == 0)
                         reorder_training_set(n);
-                for (uint32_t i = 0; i < n->pars->batch_size; i++) {
-                        if (!keep_running) {
-                                keep_running = true;
-                                return;
-                        }
-                        uint32_t x = n->asp->order[z++];
-                        struct item *item = n->asp->items->elements[x];
-                        if (z == n->asp->items->num_elements)
-                                z = 0;
-                        reset_ticks(n);
-                        for (uint32_t j = 0; j < item->num_events; j++) {
-                                if (j > 0)
-                                        next_tick(n);
-                                clamp_input_vector(n, item->inputs[j]);
-                                forward_sweep(n);
-                                if (!item->targets[j])
-                                        continue;
-                                reset_error_signals(n);
-                                inject_error(n, item->targets[j]);
-                                backward_sweep(n);
-                                if (n->ts_bw_group) /* two-stage backward sweep */
-                                        two_stage_backward_sweep(n, item, j);
-                                if (j == item->num_events - 1)
-                                        n->status->error += output_error(n,
-                                                item->targets[j])
-                                                / n->pars->batch_size;
-                                if (n->ts_fw_group) /* two-stage forward sweep */
-                                        two_stage_forward_sweep(n, item, j);
+                uint32_t cursor = 0;
+                double error = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_workers) reduction(+:error) if (num_workers > 1)
+#endif /* _OPENMP */
+                {
+                        uint32_t t = 0;
+#ifdef _OPENMP
+                        t = omp_get_thread_num();
+#endif /* _OPENMP */
+                        struct network *w = workers[t];
+                        for (;;) {
+                                uint32_t k;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif /* _OPENMP */
+                                k = cursor++;
+                                if (k >= bs || !keep_running)
+                                        break;
+                                uint32_t x = n->asp->order[(z + k)
+                                        % n->asp->items->num_elements];
+                                error += train_item_with_bp(w,
+                                        n->asp->items->elements[x]);
+                                bp_update_hogwild(w);
                         }
                 }
+                z = (z + bs) % n->asp->items->num_elements;
+                if (!keep_running) {
+                        keep_running = true;
+                        break;
+                }
+                num_items += bs;
+                n->status->error = error / bs;
                 if (n->status->error < n->pars->error_threshold) {
                         print_training_summary(n);
                         break;
                 }
-                update_weights(n);
+                if (n->status->report)
+                        determine_weight_cost(n);
+                n->status->gradient_linearity = 0.0;
                 scale_learning_rate(n);
-                scale_momentum(n);
                 scale_weight_decay(n);
                 print_training_progress(n);
         }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts1);
+        double secs = (ts1.tv_sec - ts0.tv_sec)
+                + (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+        mprintf("Hogwild training ... \t\t ( %lu items, %.0f items/s, %u thread(s) )\n",
+                (unsigned long)num_items, secs > 0.0 ? num_items / secs : 0.0,
+                num_workers);
+
+        for (uint32_t t = 1; t < num_workers; t++)
+                free_replica(workers[t]);
 }
 
-                /**************************************
-                 **** backpropagation through time ****
-                 **************************************/
+                /************************
+                 **** batch training ****
+                 ************************/
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-Backpropagation Through Time (BPTT) training. For each event of an item,
-error is injected if a target pattern is present. Error is only
-backpropagated once all events of an item have been processed. Weights are
-updated after each batch.
+This runs the training epochs that are shared by all learning algorithms.
+Each epoch, the next batch_size items are taken from the (reordered)
+active set, and processed by the item training function of the learning
+algorithm. Once all items have been processed, weights are updated on the
+basis of the gradients that have accumulated.
+
+If data parallelism is enabled (OpenMP only), the items of a batch are
+divided into one contiguous slice per thread. Each thread processes its
+slice on its own replica of the network (see replica.c), and once all
+threads are done, the gradients of the replicas are added to those of the
+network. The first thread uses the network itself. As gradients are only
+summed, this yields the same weight updates as sequential training (up to
+the order in which floating point numbers are summed). Networks with DSS
+context groups are always trained sequentially, and so are recurrent
+networks whose context groups are not reset between items, as each item
+then starts from the context left by the item processed before it.
+
+Feed forward networks that meet the conditions for mini-batch processing
+(see batch.c) process their slices in mini-batches.
+
+If the active set is streamed (see stream.c), the items of each batch are
+taken from its stream instead, in the order in which they are read, and
+released once the batch has been processed.
+
+If weight decay is applied lazily to the rows of projections from the input
+group (see bp.c), the rows that are read for the items of a batch are
+brought up to date before these are processed.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void train_network_with_bptt(struct network *n)
+void train_network_in_batches(struct network *n,
+        double (*train_item)(struct network *n, struct item *item))
 {
+        uint32_t bs = n->pars->batch_size;
+
+        /* determine the number of workers */
+        uint32_t num_workers = 1;
+#ifdef _OPENMP
+        if (n->flags->data_parallel && !n->flags->dcs
+                && (n->flags->type == ntype_ffn || n->flags->reset_contexts))
+                num_workers = omp_get_max_threads();
+        if (num_workers > bs)
+                num_workers = bs;
+#endif /* _OPENMP */
+        struct network *workers[num_workers];
+        struct batch *batches[num_workers];
+        uint32_t max_rows = (bs + num_workers - 1) / num_workers;
+        if (max_rows > BATCH_MAX_ROWS)
+                max_rows = BATCH_MAX_ROWS;
+        struct item **items;
+        if (!(items = malloc(bs * sizeof(struct item *))))
+                goto error_out;
+        struct set_stream *st = n->asp->stream;
+        if (st && !start_stream(st, bs + STREAM_PREFETCH_ITEMS,
+                n->flags->training_order)) {
+                free(items);
+                return;
+        }
+        bool batched = train_item == train_item_with_bp
+                && batchable_network(n);
+        for (uint32_t t = 0; t < num_workers; t++) {
+                workers[t] = t == 0 ? n : create_replica(n);
+                batches[t] = batched ? create_batch(workers[t], max_rows)
+                        : NULL;
+        }
+
         uint32_t z = 0;
         for (uint32_t epoch = 1; epoch <= n->pars->max_epochs; epoch++) {
-                if (!keep_running)
-                        return;
                 n->status->epoch      = epoch;
                 n->status->prev_error = n->status->error;
                 n->status->error      = 0.0;
-                if (z == 0)
-                        reorder_training_set(n);
-                for (uint32_t i = 0; i < n->pars->batch_size; i++) {
-                        if (!keep_running) {
-                                keep_running = true;
-                                return;
+                n->status->report     = report_epoch(n);
+                if (st) {
+                        if (!stream_items(st, items, bs)) {
+                                eprintf("Cannot train network - failed to read streamed set\n");
+                                break;
                         }
-                        uint32_t x = n->asp->order[z++];
-                        struct item *item = n->asp->items->elements[x];
-                        if (z == n->asp->items->num_elements)
-                                z = 0;
-                        reset_ticks(n);
-                        reset_error_signals(n);
-                        for (uint32_t j = 0; j < item->num_events; j++) {
-                                if (j > 0)
-                                        next_tick(n);
-                                clamp_input_vector(n, item->inputs[j]);
-                                forward_sweep(n);
-                                if (!item->targets[j])
-                                        continue;
-                                inject_error(n, item->targets[j]);
-                                if (n->unfolded_net->sp
-                                        == n->unfolded_net->stack_size - 1
-                                        || j == item->num_events - 1) {
-                                        // inject_error(n, item->targets[j]);
-                                        backward_sweep(n);
-                                        if (n->ts_bw_group) /* two-stage backward sweep */
-                                                two_stage_backward_sweep(n, item, j);
-                                        n->status->error += output_error(n,
-                                                item->targets[j])
-                                                / n->pars->batch_size;                                          
-                                }
-                                if (n->ts_fw_group) /* two-stage forward sweep */
-                                        two_stage_forward_sweep(n, item, j);  
+                } else {
+                        if (z == 0)
+                                reorder_training_set(n);
+                        for (uint32_t i = 0; i < bs; i++) {
+                                items[i] = n->asp->items->elements[
+                                        n->asp->order[z++]];
+                                if (z == n->asp->items->num_elements)
+                                        z = 0;
                         }
                 }
+                bp_reset_gradients_sd(n);
+                bp_catch_up_items(n, items, bs);
+                double error = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_workers) reduction(+:error) if (num_workers > 1)
+#endif /* _OPENMP */
+                {
+                        uint32_t t = 0;
+#ifdef _OPENMP
+                        t = omp_get_thread_num();
+#endif /* _OPENMP */
+                        uint32_t i0 = (uint64_t)t * bs / num_workers;
+                        uint32_t i1 = (uint64_t)(t + 1) * bs / num_workers;
+                        error += train_items(workers[t], batches[t],
+                                &items[i0], i1 - i0, train_item);
+                }
+                for (uint32_t t = 1; t < num_workers; t++)
+                        replica_add_and_reset_gradients(n, workers[t]);
+                if (st)
+                        release_stream_items(st);
+                if (!keep_running) {
+                        keep_running = true;
+                        break;
+                }
+                n->status->error = error / bs;
                 if (n->status->error < n->pars->error_threshold) {
                         print_training_summary(n);
                         break;
-                }                       
+                }
                 update_weights(n);
                 scale_learning_rate(n);
                 scale_momentum(n);
                 scale_weight_decay(n);
                 print_training_progress(n);
         }
+
+        if (st)
+                stop_stream(st);
+        for (uint32_t t = 0; t < num_workers; t++) {
+                if (batches[t])
+                        free_batch(batches[t]);
+                if (t > 0)
+                        free_replica(workers[t]);
+        }
+        free(items);
+
+        return;
+
+error_out:
+        perror("[train_network_in_batches()]");
+        return;
+}
+
+/*
+ * Trains network n on a slice of items, either one item at a time, or in
+ * mini-batches (if b is non-NULL), and returns the summed error of these
+ * items.
+ */
+double train_items(struct network *n, struct batch *b, struct item **items,
+        uint32_t num_items,
+        double (*train_item)(struct network *n, struct item *item))
+{
+        if (b)
+                return train_items_with_batched_bp(n, b, items, num_items);
+        double error = 0.0;
+        for (uint32_t i = 0; i < num_items; i++) {
+                if (!keep_running)
+                        break;
+                error += train_item(n, items[i]);
+        }
+        return error;
 }
 
 void reorder_training_set(struct network *n)
@@ -188,15 +449,37 @@ void reorder_training_set(struct network *n)
         }
 }
 
+/*
+ * Returns whether the status of network n is reported in the current
+ * epoch. The update algorithms only compute their status statistics in
+ * such epochs.
+ */
+bool report_epoch(struct network *n)
+{
+        return n->status->epoch == 1
+                || n->status->epoch % n->pars->report_after == 0;
+}
+
+/*
+ * Prints the status of network n, if it is reported in the current epoch.
+ * The gradient linearity is computed from the previous weight deltas, and
+ * is not available if these are not kept (see network.c).
+ */
 void print_training_progress(struct network *n)
 {
-        if (n->status->epoch == 1 || 
-                n->status->epoch % n->pars->report_after == 0)
+        if (!n->status->report)
+                return;
+        if (keeps_prev_deltas(n))
                 pprintf("%.4d \t\t %lf \t %lf \t %lf\n",
                         n->status->epoch,
                         n->status->error,
                         n->status->weight_cost,
                         n->status->gradient_linearity);
+        else
+                pprintf("%.4d \t\t %lf \t %lf \t n/a\n",
+                        n->status->epoch,
+                        n->status->error,
+                        n->status->weight_cost);
 }
 
 void print_training_summary(struct network *n)
@@ -232,6 +515,8 @@ void scale_weight_decay(struct network *n)
 {
         uint32_t sa = n->pars->wd_scale_after * n->pars->max_epochs;
         if (sa > 0 && n->status->epoch % sa == 0) {
+                /* apply pending weight decay at the old rate (see bp.c) */
+                bp_catch_up_network(n);
                 double wd = n->pars->weight_decay;
                 n->pars->weight_decay *= n->pars->wd_scale_factor;
                 mprintf("Scaled weight decay ... \t ( %lf => %lf)\n",
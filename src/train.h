@@ -19,15 +19,28 @@
 
 #include <stdint.h>
 
+#include "batch.h"
 #include "network.h"
 #include "set.h"
 
 void train_network(struct network *n);
 void train_network_with_bp(struct network *n);
+double train_item_with_bp(struct network *n, struct item *item);
+double train_items_with_batched_bp(struct network *n, struct batch *b,
+        struct item **items, uint32_t num_items);
 void train_network_with_bptt(struct network *n);
+double train_item_with_bptt(struct network *n, struct item *item);
+void train_network_with_hogwild(struct network *n);
+
+void train_network_in_batches(struct network *n,
+        double (*train_item)(struct network *n, struct item *item));
+double train_items(struct network *n, struct batch *b, struct item **items,
+        uint32_t num_items,
+        double (*train_item)(struct network *n, struct item *item));
 
 void reorder_training_set(struct network *n);
 
+bool report_epoch(struct network *n);
 void print_training_progress(struct network *n);
 void print_training_summary(struct network *n);
 
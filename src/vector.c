@@ -29,9 +29,9 @@ struct vector *create_vector(uint32_t size)
         memset(v, 0, sizeof(struct vector));
 
         v->size = size;
-        if (!(v->elements = malloc(v->size * sizeof(double))))
+        if (!(v->elements = malloc(v->size * sizeof(real))))
                 goto error_out;
-        memset(v->elements, 0, v->size * sizeof(double));
+        memset(v->elements, 0, v->size * sizeof(real));
 
         return v;
         
@@ -99,3 +99,95 @@ void print_vector(struct vector *v)
         }
         cprintf(" ]\n");
 }
+
+                /************************
+                 **** sparse vectors ****
+                 ************************/
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Sparse vectors list only their non-zero elements, as index/value pairs, in
+ascending order of their indices. They are used for localist input vectors
+(one-hot or few-hot), which can then be clamped and propagated without
+touching their zero elements (see engine.c and act.c).
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct sparse_vector *create_sparse_vector(uint32_t size,
+        uint32_t num_elements)
+{
+        struct sparse_vector *v;
+        if (!(v = malloc(sizeof(struct sparse_vector))))
+                goto error_out;
+        memset(v, 0, sizeof(struct sparse_vector));
+
+        v->size         = size;
+        v->num_elements = num_elements;
+        size_t block_size = (num_elements > 0 ? num_elements : 1)
+                * sizeof(uint32_t);
+        if (!(v->indices = malloc(block_size)))
+                goto error_out;
+        memset(v->indices, 0, block_size);
+        block_size = (num_elements > 0 ? num_elements : 1) * sizeof(real);
+        if (!(v->elements = malloc(block_size)))
+                goto error_out;
+        memset(v->elements, 0, block_size);
+
+        return v;
+
+error_out:
+        perror("[create_sparse_vector()]");
+        return NULL;
+}
+
+void free_sparse_vector(struct sparse_vector *v)
+{
+        free(v->indices);
+        free(v->elements);
+        free(v);
+}
+
+/*
+ * Copies sparse vector sv into dense vector dv, zeroing all elements that
+ * are not listed.
+ */
+void copy_sparse_vector(struct sparse_vector *sv, struct vector *dv)
+{
+        if (sv->size != dv->size)
+                return;
+
+        zero_out_vector(dv);
+        for (uint32_t i = 0; i < sv->num_elements; i++)
+                dv->elements[sv->indices[i]] = sv->elements[i];
+}
+
+double sparse_vector_minimum(struct sparse_vector *v)
+{
+        double min = v->num_elements < v->size ? 0.0 : v->elements[0];
+
+        for (uint32_t i = 0; i < v->num_elements; i++)
+                if (v->elements[i] < min)
+                        min = v->elements[i];
+
+        return min;
+}
+
+double sparse_vector_maximum(struct sparse_vector *v)
+{
+        double max = v->num_elements < v->size ? 0.0 : v->elements[0];
+
+        for (uint32_t i = 0; i < v->num_elements; i++)
+                if (v->elements[i] > max)
+                        max = v->elements[i];
+
+        return max;
+}
+
+void print_sparse_vector(struct sparse_vector *v)
+{
+        cprintf("{ ");
+        for (uint32_t i = 0; i < v->num_elements; i++) {
+                if (i > 0)
+                        cprintf(", ");
+                cprintf("%d:%lf", v->indices[i], v->elements[i]);
+        }
+        cprintf(" }\n");
+}
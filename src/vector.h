@@ -19,10 +19,21 @@
 
 #include <stdint.h>
 
+#include "real.h"
+
 struct vector
 {
         uint32_t size;                  /* vector size */
-        double *elements;               /* elements */
+        real *elements;                 /* elements */
+};
+
+/* sparse vector (all elements not listed are zero) */
+struct sparse_vector
+{
+        uint32_t size;                  /* vector size */
+        uint32_t num_elements;          /* number of listed elements */
+        uint32_t *indices;              /* indices of listed elements */
+        real *elements;                 /* listed elements */
 };
 
 struct vector *create_vector(uint32_t size);
@@ -37,4 +48,14 @@ double vector_maximum(struct vector *v);
 
 void print_vector(struct vector *v);
 
+struct sparse_vector *create_sparse_vector(uint32_t size,
+        uint32_t num_elements);
+void free_sparse_vector(struct sparse_vector *v);
+void copy_sparse_vector(struct sparse_vector *sv, struct vector *dv);
+
+double sparse_vector_minimum(struct sparse_vector *v);
+double sparse_vector_maximum(struct sparse_vector *v);
+
+void print_sparse_vector(struct sparse_vector *v);
+
 #endif /* VECTOR_H */
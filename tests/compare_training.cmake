@@ -0,0 +1,28 @@
+# Runs MESH on the scripts FIRST and SECOND (in the current directory), and
+# fails unless both report the same training progress.
+
+foreach(script FIRST SECOND)
+        execute_process(
+                COMMAND ${MESH} ${${script}}
+                INPUT_FILE /dev/null
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE errors
+                RESULT_VARIABLE result)
+        if(NOT result EQUAL 0)
+                message(FATAL_ERROR "${${script}} exited with ${result}:\n"
+                        "${errors}")
+        endif()
+        string(REGEX MATCHALL "% [0-9]+[ \t][^\n]*" progress "${output}")
+        if(NOT progress)
+                message(FATAL_ERROR "${${script}} reported no progress")
+        endif()
+        set(${script}_PROGRESS "${progress}")
+endforeach()
+
+if(NOT FIRST_PROGRESS STREQUAL SECOND_PROGRESS)
+        string(REPLACE ";" "\n" FIRST_PROGRESS "${FIRST_PROGRESS}")
+        string(REPLACE ";" "\n" SECOND_PROGRESS "${SECOND_PROGRESS}")
+        message(FATAL_ERROR "Training progress differs:\n"
+                "${FIRST}:\n${FIRST_PROGRESS}\n"
+                "${SECOND}:\n${SECOND_PROGRESS}")
+endif()